@@ -8,6 +8,16 @@ namespace RTXSimplified
 		return 0;
 	}
 
+	int RTX_BLAS::addIndexedVertexBuffer(ID3D12Resource* _vertexBuffer, UINT64 _vertexOffsetInBytes, uint32_t _vertexCount, UINT _vertexSizeInBytes, ID3D12Resource* _indexBuffer, UINT64 _indexOffsetInBytes, uint32_t _indexCount, ID3D12Resource* _transformBuffer, UINT64 _transformOffsetInBytes, bool _isOpaque)
+	{
+		if (_indexBuffer == nullptr || _indexCount % 3 != 0) // Error check
+		{
+			RTX_Exception::handleError("Indexed vertex buffer needs an index buffer with 3 indices per triangle.", true);
+		}
+		addVertexBufferLimited(_vertexBuffer, _vertexOffsetInBytes, _vertexCount, _vertexSizeInBytes, _indexBuffer, _indexOffsetInBytes, _indexCount, _transformBuffer, _transformOffsetInBytes, _isOpaque); // Call the limited variant
+		return 0;
+	}
+
 	int RTX_BLAS::addVertexBufferLimited(
 		ID3D12Resource* _vertexBuffer,		// Contains vertex coords
 		UINT64 _vertexOffsetInBytes,		// Offset of the first vertex
@@ -50,12 +60,17 @@ namespace RTXSimplified
 		ID3D12Device5* _device,			    // Device on which the build will be performed
 		bool _allowUpdate,					// if true, allow iterative updates
 		UINT64* _scratchSizeInBytes,		// Temporary scratch memory
-		UINT64* _resultSizeInBytes			// Temporary result memory
+		UINT64* _resultSizeInBytes,			// Temporary result memory
+		bool _fastBuild						// if true, prefer fast builds over fast traces
 	)
 	{
 		flags = _allowUpdate				// Set whether updates are allowed or not
 			? D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE
 			: D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+		if (_fastBuild)						// Ask the driver to favour build speed, otherwise leave it its default
+		{
+			flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD;
+		}
 
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildDesc;					// Contains info about work requested.
 		prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;		// its a bottom level AS
@@ -87,12 +102,12 @@ namespace RTXSimplified
 	)
 	{
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS localFlags = flags; // Use the flags generated before to check if update or construct.
-		if (localFlags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && _updateOnly)
-			localFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+		if ((localFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) && _updateOnly)
+			localFlags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE; // Updates keep the build flags and add perform update
 
 		/*ERROR CHECKS*/
 		// Check you're not trying to update on a non-updateable struct
-		if (flags != D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && _updateOnly)
+		if (!(flags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) && _updateOnly)
 		{
 			RTX_Exception::handleError("Trying to update a BLAS not built for updates.", true);
 		}
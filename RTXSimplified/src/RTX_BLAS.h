@@ -57,7 +57,8 @@ namespace RTXSimplified
 			ID3D12Device5* _device,			    ///< Device on which the build will be performed.
 			bool _allowUpdate,					///< if true, allow iterative updates.
 			UINT64* _scratchSizeInBytes,		///< Temporary scratch memory.
-			UINT64* _resultSizeInBytes			///< Temporary result memory.
+			UINT64* _resultSizeInBytes,			///< Temporary result memory.
+			bool _fastBuild = false				///< if true, prefer fast builds over fast traces.
 		); ///< Computes the size of the accelleration structure based on device and data.
 
 		int addVertexBuffer(
@@ -69,6 +70,19 @@ namespace RTXSimplified
 			UINT64 _transformOffsetInBytes,		///< Offset of the transform matrix.
 			bool _isOpaque						///< Used to optimize search for closes hit.
 		); ///< Allocates the buffers on the GPU.
+
+		int addIndexedVertexBuffer(
+			ID3D12Resource* _vertexBuffer,		///< Contains vertex coords.
+			UINT64 _vertexOffsetInBytes,		///< Offset of the first vertex.
+			uint32_t _vertexCount,				///< Number of vertices in the buffer.
+			UINT _vertexSizeInBytes,			///< Size of a vertex.
+			ID3D12Resource* _indexBuffer,		///< Contains 32 bit vertex indices, 3 per triangle.
+			UINT64 _indexOffsetInBytes,			///< Offset to the first index.
+			uint32_t _indexCount,				///< Number of indices in the buffer.
+			ID3D12Resource* _transformBuffer,	///< Contains 4x4 transform matrix.
+			UINT64 _transformOffsetInBytes,		///< Offset of the transform matrix.
+			bool _isOpaque						///< Used to optimize search for closes hit.
+		); ///< Allocates the buffers on the GPU, for meshes that share vertices between triangles.
 	};
 }
 #endif // !RTX_BLAS_H
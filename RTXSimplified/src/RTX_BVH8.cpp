@@ -0,0 +1,307 @@
+#include "RTX_BVH8.h"
+#include <algorithm> // std::upper_bound
+#include "RTX_Serialize.h" // Disk cache
+
+namespace RTXSimplified
+{
+	struct BVH8StackEntry
+	{
+		uint32_t child;		///< Node index or first triangle.
+		uint32_t count;		///< Triangles for a leaf, 0 for a node.
+		float distance;		///< Entry distance, used to skip entries behind the closest hit.
+	}; ///< Traversal stack entry.
+
+	int RTX_BVH8::collapse(const RTX_CPUBVH& _source)
+	{
+		const std::vector<BVHNode>& sourceNodes = _source.getNodes();
+		if (sourceNodes.empty()) // Error check
+		{
+			RTX_Exception::handleError("Trying to collapse a CPU BLAS that was not built.", true);
+		}
+
+		nodes.clear();
+		triangles.clear();
+		primitiveIds.clear();
+		geometryOffsets = _source.getGeometryOffsets();
+		bounds = _source.getBounds();
+
+		if (sourceNodes[0].triCount > 0) // The whole tree is a single leaf, wrap it in a root with one child
+		{
+			BVH8Node root;
+			for (int i = 0; i < 8; i++)
+			{
+				root.minX[i] = root.minY[i] = root.minZ[i] = FLT_MAX; // Empty slots use +inf on both corners so they never hit
+				root.maxX[i] = root.maxY[i] = root.maxZ[i] = FLT_MAX;
+				root.child[i] = UINT32_MAX;
+				root.count[i] = 0;
+			}
+			root.minX[0] = sourceNodes[0].aabbMin.x; root.minY[0] = sourceNodes[0].aabbMin.y; root.minZ[0] = sourceNodes[0].aabbMin.z;
+			root.maxX[0] = sourceNodes[0].aabbMax.x; root.maxY[0] = sourceNodes[0].aabbMax.y; root.maxZ[0] = sourceNodes[0].aabbMax.z;
+			root.child[0] = 0;
+			root.count[0] = sourceNodes[0].triCount;
+			for (uint32_t i = 0; i < sourceNodes[0].triCount; i++)
+			{
+				uint32_t triangle = _source.getTriIndices()[sourceNodes[0].leftFirst + i];
+				triangles.push_back(_source.getTriangles()[triangle]);
+				primitiveIds.push_back(triangle);
+			}
+			nodes.push_back(root);
+			return 0;
+		}
+
+		collapseNode(_source, 0);
+		return 0;
+	}
+
+	uint32_t RTX_BVH8::collapseNode(const RTX_CPUBVH& _source, uint32_t _binaryNode)
+	{
+		const std::vector<BVHNode>& sourceNodes = _source.getNodes();
+
+		// Start from the two children and keep opening the biggest inner child until there are 8
+		uint32_t slots[8] = { sourceNodes[_binaryNode].leftFirst, sourceNodes[_binaryNode].leftFirst + 1 };
+		uint32_t slotCount = 2;
+		while (slotCount < 8)
+		{
+			int best = -1;
+			float bestArea = -1.0f;
+			for (uint32_t i = 0; i < slotCount; i++)
+			{
+				const BVHNode& node = sourceNodes[slots[i]];
+				if (node.triCount > 0) // Leaves can not be opened
+				{
+					continue;
+				}
+				AABB box;
+				box.grow(node.aabbMin);
+				box.grow(node.aabbMax);
+				if (box.area() > bestArea)
+				{
+					bestArea = box.area();
+					best = static_cast<int>(i);
+				}
+			}
+			if (best < 0) // Only leaves left
+			{
+				break;
+			}
+			uint32_t opened = slots[best];
+			slots[best] = sourceNodes[opened].leftFirst;
+			slots[slotCount++] = sourceNodes[opened].leftFirst + 1;
+		}
+
+		uint32_t index = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+		for (int i = 0; i < 8; i++) // Empty slots use +inf on both corners so they never hit
+		{
+			nodes[index].minX[i] = nodes[index].minY[i] = nodes[index].minZ[i] = FLT_MAX;
+			nodes[index].maxX[i] = nodes[index].maxY[i] = nodes[index].maxZ[i] = FLT_MAX;
+			nodes[index].child[i] = UINT32_MAX;
+			nodes[index].count[i] = 0;
+		}
+
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			const BVHNode& node = sourceNodes[slots[i]];
+			nodes[index].minX[i] = node.aabbMin.x; nodes[index].minY[i] = node.aabbMin.y; nodes[index].minZ[i] = node.aabbMin.z;
+			nodes[index].maxX[i] = node.aabbMax.x; nodes[index].maxY[i] = node.aabbMax.y; nodes[index].maxZ[i] = node.aabbMax.z;
+
+			if (node.triCount > 0) // Leaf, copy its triangles next to each other
+			{
+				nodes[index].child[i] = static_cast<uint32_t>(triangles.size());
+				nodes[index].count[i] = node.triCount;
+				for (uint32_t t = 0; t < node.triCount; t++)
+				{
+					uint32_t triangle = _source.getTriIndices()[node.leftFirst + t];
+					triangles.push_back(_source.getTriangles()[triangle]);
+					primitiveIds.push_back(triangle);
+				}
+			}
+			else
+			{
+				uint32_t child = collapseNode(_source, slots[i]); // Can reallocate the node array, so index again after
+				nodes[index].child[i] = child;
+				nodes[index].count[i] = 0;
+			}
+		}
+
+		return index;
+	}
+
+	template <bool anyHit>
+	bool RTX_BVH8::traverse(const Ray& _ray, RayHit* _hit) const
+	{
+		if (nodes.empty())
+		{
+			return false;
+		}
+
+		Float3 invDirection = { 1.0f / _ray.direction.x, 1.0f / _ray.direction.y, 1.0f / _ray.direction.z };
+		float closest = _ray.tMax;
+		uint32_t hitTriangle = UINT32_MAX;
+		float hitU = 0.0f, hitV = 0.0f;
+
+#if defined(RTX_SIMD_AVX2)
+		const __m256 originX = _mm256_set1_ps(_ray.origin.x), originY = _mm256_set1_ps(_ray.origin.y), originZ = _mm256_set1_ps(_ray.origin.z);
+		const __m256 invX = _mm256_set1_ps(invDirection.x), invY = _mm256_set1_ps(invDirection.y), invZ = _mm256_set1_ps(invDirection.z);
+		const __m256 rayMin = _mm256_set1_ps(_ray.tMin);
+#endif
+
+		BVH8StackEntry stack[1024]; // Depth is capped by the binary build, each level pushes at most 7 siblings
+		uint32_t stackSize = 0;
+		stack[stackSize++] = { 0, 0, _ray.tMin };
+
+		while (stackSize > 0)
+		{
+			BVH8StackEntry entry = stack[--stackSize];
+			if (entry.distance >= closest) // Behind the closest hit already
+			{
+				continue;
+			}
+
+			if (entry.count > 0) // Leaf
+			{
+				for (uint32_t i = 0; i < entry.count; i++)
+				{
+					const BVHTriangle& tri = triangles[entry.child + i];
+					if (intersectTriangle(_ray, tri.v0, tri.v1, tri.v2, closest, hitU, hitV))
+					{
+						if (anyHit) // Shadow rays only need to know something is in the way
+						{
+							return true;
+						}
+						hitTriangle = entry.child + i;
+					}
+				}
+				continue;
+			}
+
+			const BVH8Node& node = nodes[entry.child];
+			float distances[8];
+			uint32_t hitMask = 0;
+
+#if defined(RTX_SIMD_AVX2)
+			// Slab test of all 8 children at once
+			__m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), originX), invX);
+			__m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), originX), invX);
+			__m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), originY), invY);
+			__m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), originY), invY);
+			__m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), originZ), invZ);
+			__m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), originZ), invZ);
+			__m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)), _mm256_max_ps(_mm256_min_ps(tz0, tz1), rayMin));
+			__m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)), _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_set1_ps(closest)));
+			hitMask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+			_mm256_storeu_ps(distances, tNear);
+#else
+			for (int i = 0; i < 8; i++) // Scalar fallback, same maths one child at a time
+			{
+				float tx0 = (node.minX[i] - _ray.origin.x) * invDirection.x, tx1 = (node.maxX[i] - _ray.origin.x) * invDirection.x;
+				float ty0 = (node.minY[i] - _ray.origin.y) * invDirection.y, ty1 = (node.maxY[i] - _ray.origin.y) * invDirection.y;
+				float tz0 = (node.minZ[i] - _ray.origin.z) * invDirection.z, tz1 = (node.maxZ[i] - _ray.origin.z) * invDirection.z;
+				float tNear = maxFloat(maxFloat(minFloat(tx0, tx1), minFloat(ty0, ty1)), maxFloat(minFloat(tz0, tz1), _ray.tMin));
+				float tFar = minFloat(minFloat(maxFloat(tx0, tx1), maxFloat(ty0, ty1)), minFloat(maxFloat(tz0, tz1), closest));
+				distances[i] = tNear;
+				hitMask |= (tNear <= tFar ? 1u : 0u) << i;
+			}
+#endif
+
+			// Push the hit children, furthest first so the nearest is popped next, in any order for shadow rays
+			uint32_t first = stackSize;
+			while (hitMask != 0)
+			{
+				uint32_t i = 0;
+				while (!(hitMask & (1u << i)))
+				{
+					i++;
+				}
+				hitMask &= hitMask - 1; // Clear the lowest bit
+
+				BVH8StackEntry child = { node.child[i], node.count[i], distances[i] };
+				uint32_t position = stackSize++;
+				while (!anyHit && position > first && stack[position - 1].distance < child.distance) // Insertion sort, at most 8 entries
+				{
+					stack[position] = stack[position - 1];
+					position--;
+				}
+				stack[position] = child;
+			}
+		}
+
+		if (anyHit || hitTriangle == UINT32_MAX)
+		{
+			return false;
+		}
+
+		uint32_t triangle = primitiveIds[hitTriangle];
+		_hit->t = closest;
+		_hit->u = hitU;
+		_hit->v = hitV;
+		_hit->geometryIndex = static_cast<uint32_t>(std::upper_bound(geometryOffsets.begin(), geometryOffsets.end(), triangle) - geometryOffsets.begin()) - 1;
+		_hit->primitiveIndex = triangle - geometryOffsets[_hit->geometryIndex];
+		return true;
+	}
+
+	bool RTX_BVH8::intersect(const Ray& _ray, RayHit& _hit) const
+	{
+		return traverse<false>(_ray, &_hit);
+	}
+
+	bool RTX_BVH8::occluded(const Ray& _ray) const
+	{
+		return traverse<true>(_ray, nullptr);
+	}
+
+	int RTX_BVH8::serialize(std::vector<char>& _out) const
+	{
+		writeValue(_out, bounds);
+		writeArray(_out, nodes);
+		writeArray(_out, triangles);
+		writeArray(_out, primitiveIds);
+		writeArray(_out, geometryOffsets);
+		return 0;
+	}
+
+	bool RTX_BVH8::deserialize(const char* _data, size_t _size, size_t& _offset)
+	{
+		bool valid = readValue(_data, _size, _offset, bounds)
+			&& readArray(_data, _size, _offset, nodes)
+			&& readArray(_data, _size, _offset, triangles)
+			&& readArray(_data, _size, _offset, primitiveIds)
+			&& readArray(_data, _size, _offset, geometryOffsets);
+		if (!valid || nodes.empty() || primitiveIds.size() != triangles.size()) // Truncated or corrupt
+		{
+			nodes.clear();
+			return false;
+		}
+		return true;
+	}
+
+	const std::vector<BVH8Node>& RTX_BVH8::getNodes() const
+	{
+		return nodes;
+	}
+
+	const std::vector<BVHTriangle>& RTX_BVH8::getTriangles() const
+	{
+		return triangles;
+	}
+
+	const std::vector<uint32_t>& RTX_BVH8::getPrimitiveIds() const
+	{
+		return primitiveIds;
+	}
+
+	const std::vector<uint32_t>& RTX_BVH8::getGeometryOffsets() const
+	{
+		return geometryOffsets;
+	}
+
+	AABB RTX_BVH8::getBounds() const
+	{
+		return bounds;
+	}
+
+	size_t RTX_BVH8::getMemorySize() const
+	{
+		return nodes.size() * sizeof(BVH8Node) + triangles.size() * (sizeof(BVHTriangle) + sizeof(uint32_t));
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef RTX_BVH8_H
+#define RTX_BVH8_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Float3, Ray, RayHit
+#include "RTX_CPUBVH.h" // Source binary tree
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	struct BVH8Node
+	{
+		float minX[8], minY[8], minZ[8]; ///< Lower corners of the children, one AVX2 register per axis.
+		float maxX[8], maxY[8], maxZ[8]; ///< Upper corners of the children.
+		uint32_t child[8];	///< Inner child: node index. Leaf child: first triangle. Empty slot: UINT32_MAX.
+		uint32_t count[8];	///< Triangles in a leaf child, 0 for inner children.
+	}; ///< 8 wide node, children stored as SoA so all 8 boxes are tested in one pass.
+
+	/**
+	*	\brief The class responsible for the 8 wide CPU BVH.
+	*
+	*	Made by collapsing the binary tree of an RTX_CPUBVH. Traversal tests all 8 child boxes
+	*	of a node at once with AVX2, falling back to a scalar loop on older CPUs.
+	*/
+	class RTX_BVH8
+	{
+	private:
+		std::vector<BVH8Node> nodes; ///< Nodes, root first.
+		std::vector<BVHTriangle> triangles; ///< Triangles in leaf order.
+		std::vector<uint32_t> primitiveIds; ///< Original index of each triangle.
+		std::vector<uint32_t> geometryOffsets; ///< First triangle of each geometry, copied from the source.
+		AABB bounds; ///< Bounds of the whole tree.
+
+		uint32_t collapseNode(const RTX_CPUBVH& _source, uint32_t _binaryNode); ///< Emits the 8 wide node for a binary inner node, returns its index.
+		template <bool anyHit>
+		bool traverse(const Ray& _ray, RayHit* _hit) const; ///< Shared by intersect and occluded, any hit stops at the first triangle and skips sorting the children.
+
+	public:
+		int collapse(const RTX_CPUBVH& _source); ///< Builds the 8 wide tree from a built binary tree.
+		bool intersect(const Ray& _ray, RayHit& _hit) const; ///< Finds the closest hit, returns false on miss.
+		bool occluded(const Ray& _ray) const; ///< True if any triangle lies between tMin and tMax, stops at the first one found.
+		int serialize(std::vector<char>& _out) const; ///< Appends the tree to a pointer free blob.
+		bool deserialize(const char* _data, size_t _size, size_t& _offset); ///< Loads a tree written by serialize, returns false if the blob is invalid.
+
+		/*GETTERS*/
+		const std::vector<BVH8Node>& getNodes() const;
+		const std::vector<BVHTriangle>& getTriangles() const;
+		const std::vector<uint32_t>& getPrimitiveIds() const;
+		const std::vector<uint32_t>& getGeometryOffsets() const;
+		AABB getBounds() const;
+		size_t getMemorySize() const; ///< Bytes used by nodes and triangles.
+	};
+}
+#endif // !RTX_BVH8_H
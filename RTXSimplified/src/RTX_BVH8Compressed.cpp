@@ -0,0 +1,265 @@
+#include "RTX_BVH8Compressed.h"
+#include <algorithm> // std::upper_bound
+
+namespace RTXSimplified
+{
+	struct BVH8CompressedStackEntry
+	{
+		uint32_t child;		///< Node index or first triangle.
+		uint32_t count;		///< Triangles for a leaf, 0 for a node.
+		float distance;		///< Entry distance, used to skip entries behind the closest hit.
+	}; ///< Traversal stack entry.
+
+#if defined(RTX_SIMD_AVX2)
+	/**
+	*	Widens 8 quantized steps to floats and turns them into ray distances.
+	*/
+	static inline __m256 decodeDistances(const uint8_t* _steps, __m256 _stepDistance, __m256 _baseDistance)
+	{
+		__m256 steps = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(_steps))));
+		return _mm256_add_ps(_mm256_mul_ps(steps, _stepDistance), _baseDistance);
+	}
+#endif
+
+	void RTX_BVH8Compressed::quantize(float _min, float _max, float _origin, float _scale, uint8_t& _qMin, uint8_t& _qMax)
+	{
+		if (_scale <= 0.0f) // Flat parent on this axis, every child sits on the origin
+		{
+			_qMin = 0;
+			_qMax = 0;
+			return;
+		}
+
+		int qMin = static_cast<int>(floorf((_min - _origin) / _scale));
+		int qMax = static_cast<int>(ceilf((_max - _origin) / _scale));
+		qMin = (std::max)(0, (std::min)(255, qMin));
+		qMax = (std::max)(0, (std::min)(255, qMax));
+
+		// Division rounding can land a step inside the real box, walk outwards until the decoded box contains it
+		while (qMin > 0 && _origin + qMin * _scale > _min)
+		{
+			qMin--;
+		}
+		while (qMax < 255 && _origin + qMax * _scale < _max)
+		{
+			qMax++;
+		}
+
+		_qMin = static_cast<uint8_t>(qMin);
+		_qMax = static_cast<uint8_t>(qMax);
+	}
+
+	int RTX_BVH8Compressed::compress(const RTX_BVH8& _source, std::shared_ptr<const RTX_CPUBVH> _binary)
+	{
+		const std::vector<BVH8Node>& sourceNodes = _source.getNodes();
+		if (sourceNodes.empty()) // Error check
+		{
+			RTX_Exception::handleError("Trying to compress a BVH8 that was not built.", true);
+		}
+		if (!_binary || _binary->getGeometryOffsets() != _source.getGeometryOffsets()) // Error check, the ids would index another mesh
+		{
+			RTX_Exception::handleError("Compressed BVH needs the binary tree its BVH8 was collapsed from.", true);
+		}
+
+		// Leaves point at the binary tree's triangles through the ids, only the nodes are new
+		binary = _binary;
+		primitiveIds = _source.getPrimitiveIds();
+		bounds = _source.getBounds();
+		nodes.resize(sourceNodes.size());
+
+		for (size_t n = 0; n < sourceNodes.size(); n++) // Node indices stay the same, so nodes can be compressed independently
+		{
+			const BVH8Node& source = sourceNodes[n];
+			BVH8CompressedNode& node = nodes[n];
+
+			AABB parent; // Union of the used child boxes
+			for (int i = 0; i < 8; i++)
+			{
+				if (source.child[i] == UINT32_MAX)
+				{
+					continue;
+				}
+				parent.grow(Float3{ source.minX[i], source.minY[i], source.minZ[i] });
+				parent.grow(Float3{ source.maxX[i], source.maxY[i], source.maxZ[i] });
+			}
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.origin[axis] = parent.min[axis];
+				node.scale[axis] = (parent.max[axis] - parent.min[axis]) / 255.0f * 1.0001f; // Slightly over so step 255 reaches past the parent
+			}
+
+			for (int i = 0; i < 8; i++)
+			{
+				if (source.child[i] == UINT32_MAX) // Empty slot, the traversal masks these out
+				{
+					node.qMinX[i] = node.qMinY[i] = node.qMinZ[i] = 0;
+					node.qMaxX[i] = node.qMaxY[i] = node.qMaxZ[i] = 0;
+					node.child[i] = UINT32_MAX;
+					node.count[i] = 0;
+					continue;
+				}
+				if (source.count[i] > 255) // Error check
+				{
+					RTX_Exception::handleError("Leaf too big for a compressed BVH node.", true);
+				}
+
+				quantize(source.minX[i], source.maxX[i], node.origin[0], node.scale[0], node.qMinX[i], node.qMaxX[i]);
+				quantize(source.minY[i], source.maxY[i], node.origin[1], node.scale[1], node.qMinY[i], node.qMaxY[i]);
+				quantize(source.minZ[i], source.maxZ[i], node.origin[2], node.scale[2], node.qMinZ[i], node.qMaxZ[i]);
+				node.child[i] = source.child[i];
+				node.count[i] = static_cast<uint8_t>(source.count[i]);
+			}
+		}
+
+		return 0;
+	}
+
+	template <bool anyHit>
+	bool RTX_BVH8Compressed::traverse(const Ray& _ray, RayHit* _hit) const
+	{
+		if (nodes.empty())
+		{
+			return false;
+		}
+
+		// Axis aligned rays would give 0 * inf = NaN for children on the origin, so keep the inverse finite
+		Float3 invDirection;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float d = _ray.direction[axis];
+			invDirection[axis] = 1.0f / (fabsf(d) > 1e-20f ? d : (d < 0.0f ? -1e-20f : 1e-20f));
+		}
+		float closest = _ray.tMax;
+		uint32_t hitTriangle = UINT32_MAX;
+		float hitU = 0.0f, hitV = 0.0f;
+		const std::vector<BVHTriangle>& triangles = binary->getTriangles();
+
+		BVH8CompressedStackEntry stack[1024]; // Depth is capped by the binary build, each level pushes at most 7 siblings
+		uint32_t stackSize = 0;
+		stack[stackSize++] = { 0, 0, _ray.tMin };
+
+		while (stackSize > 0)
+		{
+			BVH8CompressedStackEntry entry = stack[--stackSize];
+			if (entry.distance >= closest) // Behind the closest hit already
+			{
+				continue;
+			}
+
+			if (entry.count > 0) // Leaf
+			{
+				for (uint32_t i = 0; i < entry.count; i++)
+				{
+					const BVHTriangle& tri = triangles[primitiveIds[entry.child + i]];
+					if (intersectTriangle(_ray, tri.v0, tri.v1, tri.v2, closest, hitU, hitV))
+					{
+						if (anyHit) // Shadow rays only need to know something is in the way
+						{
+							return true;
+						}
+						hitTriangle = entry.child + i;
+					}
+				}
+				continue;
+			}
+
+			const BVH8CompressedNode& node = nodes[entry.child];
+
+			// Decode folded into the slab test: t = (origin + q * scale - rayOrigin) * inv = q * (scale * inv) + (origin - rayOrigin) * inv
+			float stepX = node.scale[0] * invDirection.x, stepY = node.scale[1] * invDirection.y, stepZ = node.scale[2] * invDirection.z;
+			float baseX = (node.origin[0] - _ray.origin.x) * invDirection.x;
+			float baseY = (node.origin[1] - _ray.origin.y) * invDirection.y;
+			float baseZ = (node.origin[2] - _ray.origin.z) * invDirection.z;
+			float distances[8];
+			uint32_t hitMask = 0;
+
+#if defined(RTX_SIMD_AVX2)
+			const __m256 sx = _mm256_set1_ps(stepX), sy = _mm256_set1_ps(stepY), sz = _mm256_set1_ps(stepZ);
+			const __m256 bx = _mm256_set1_ps(baseX), by = _mm256_set1_ps(baseY), bz = _mm256_set1_ps(baseZ);
+			__m256 tx0 = decodeDistances(node.qMinX, sx, bx), tx1 = decodeDistances(node.qMaxX, sx, bx);
+			__m256 ty0 = decodeDistances(node.qMinY, sy, by), ty1 = decodeDistances(node.qMaxY, sy, by);
+			__m256 tz0 = decodeDistances(node.qMinZ, sz, bz), tz1 = decodeDistances(node.qMaxZ, sz, bz);
+			__m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)), _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_set1_ps(_ray.tMin)));
+			__m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)), _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_set1_ps(closest)));
+			hitMask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+			_mm256_storeu_ps(distances, tNear);
+#else
+			for (int i = 0; i < 8; i++) // Scalar fallback, same maths one child at a time
+			{
+				float tx0 = node.qMinX[i] * stepX + baseX, tx1 = node.qMaxX[i] * stepX + baseX;
+				float ty0 = node.qMinY[i] * stepY + baseY, ty1 = node.qMaxY[i] * stepY + baseY;
+				float tz0 = node.qMinZ[i] * stepZ + baseZ, tz1 = node.qMaxZ[i] * stepZ + baseZ;
+				float tNear = maxFloat(maxFloat(minFloat(tx0, tx1), minFloat(ty0, ty1)), maxFloat(minFloat(tz0, tz1), _ray.tMin));
+				float tFar = minFloat(minFloat(maxFloat(tx0, tx1), maxFloat(ty0, ty1)), minFloat(maxFloat(tz0, tz1), closest));
+				distances[i] = tNear;
+				hitMask |= (tNear <= tFar ? 1u : 0u) << i;
+			}
+#endif
+
+			// Push the hit children, furthest first so the nearest is popped next, in any order for shadow rays
+			uint32_t first = stackSize;
+			while (hitMask != 0)
+			{
+				uint32_t i = 0;
+				while (!(hitMask & (1u << i)))
+				{
+					i++;
+				}
+				hitMask &= hitMask - 1; // Clear the lowest bit
+				if (node.child[i] == UINT32_MAX) // Empty slots decode to a point box, skip them
+				{
+					continue;
+				}
+
+				BVH8CompressedStackEntry child = { node.child[i], node.count[i], distances[i] };
+				uint32_t position = stackSize++;
+				while (!anyHit && position > first && stack[position - 1].distance < child.distance) // Insertion sort, at most 8 entries
+				{
+					stack[position] = stack[position - 1];
+					position--;
+				}
+				stack[position] = child;
+			}
+		}
+
+		if (anyHit || hitTriangle == UINT32_MAX)
+		{
+			return false;
+		}
+
+		uint32_t triangle = primitiveIds[hitTriangle];
+		const std::vector<uint32_t>& geometryOffsets = binary->getGeometryOffsets();
+		_hit->t = closest;
+		_hit->u = hitU;
+		_hit->v = hitV;
+		_hit->geometryIndex = static_cast<uint32_t>(std::upper_bound(geometryOffsets.begin(), geometryOffsets.end(), triangle) - geometryOffsets.begin()) - 1;
+		_hit->primitiveIndex = triangle - geometryOffsets[_hit->geometryIndex];
+		return true;
+	}
+
+	bool RTX_BVH8Compressed::intersect(const Ray& _ray, RayHit& _hit) const
+	{
+		return traverse<false>(_ray, &_hit);
+	}
+
+	bool RTX_BVH8Compressed::occluded(const Ray& _ray) const
+	{
+		return traverse<true>(_ray, nullptr);
+	}
+
+	const std::vector<BVH8CompressedNode>& RTX_BVH8Compressed::getNodes() const
+	{
+		return nodes;
+	}
+
+	AABB RTX_BVH8Compressed::getBounds() const
+	{
+		return bounds;
+	}
+
+	size_t RTX_BVH8Compressed::getMemorySize() const
+	{
+		return nodes.size() * sizeof(BVH8CompressedNode) + primitiveIds.size() * sizeof(uint32_t);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef RTX_BVH8COMPRESSED_H
+#define RTX_BVH8COMPRESSED_H
+
+#include <vector> // std::vector
+#include <memory> // std::shared_ptr
+#include <stdint.h> // uint8_t, uint32_t
+#include "RTX_CPUMath.h" // Float3, Ray, RayHit
+#include "RTX_BVH8.h" // Source 8 wide tree
+#include "RTX_CPUBVH.h" // Shared triangles
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	struct BVH8CompressedNode
+	{
+		float origin[3];	///< Lower corner of this node's box, children are stored relative to it.
+		float scale[3];		///< Size of one quantization step on each axis.
+		uint8_t qMinX[8], qMinY[8], qMinZ[8]; ///< Lower corners of the children in steps, rounded down.
+		uint8_t qMaxX[8], qMaxY[8], qMaxZ[8]; ///< Upper corners of the children in steps, rounded up.
+		uint32_t child[8];	///< Inner child: node index. Leaf child: first triangle. Empty slot: UINT32_MAX.
+		uint8_t count[8];	///< Triangles in a leaf child, 0 for inner children.
+	}; ///< 112 byte quantized 8 wide node, under half the size of a BVH8Node.
+
+	/**
+	*	\brief The class responsible for the compressed 8 wide CPU BVH.
+	*
+	*	Made from an RTX_BVH8 by storing every child box as 8 bit steps inside its parent box.
+	*	Boxes are rounded outwards so they still contain their geometry, the decode is folded
+	*	into the slab test so traversal costs one extra multiply-add per axis.
+	*	Triangles are not copied: leaves index the triangles of the binary tree the source was
+	*	collapsed from, which the CPU BLAS keeps for packets anyway, so a compressed BLAS only
+	*	adds its nodes and 4 bytes per triangle reference on top of the binary tree.
+	*/
+	class RTX_BVH8Compressed
+	{
+	private:
+		std::vector<BVH8CompressedNode> nodes; ///< Nodes, root first.
+		std::shared_ptr<const RTX_CPUBVH> binary; ///< Owner of the triangles and geometry offsets, kept alive with the tree.
+		std::vector<uint32_t> primitiveIds; ///< Index in the binary tree's triangles of each leaf entry, in leaf order.
+		AABB bounds; ///< Bounds of the whole tree.
+
+		static void quantize(float _min, float _max, float _origin, float _scale, uint8_t& _qMin, uint8_t& _qMax); ///< Conservative 8 bit quantization of one child extent.
+		template <bool anyHit>
+		bool traverse(const Ray& _ray, RayHit* _hit) const; ///< Shared by intersect and occluded, any hit stops at the first triangle and skips sorting the children.
+
+	public:
+		int compress(
+			const RTX_BVH8& _source,						///< Collapsed 8 wide tree.
+			std::shared_ptr<const RTX_CPUBVH> _binary		///< Binary tree _source was collapsed from, its triangles are shared.
+		); ///< Builds the compressed tree, _source can be dropped afterwards.
+		bool intersect(const Ray& _ray, RayHit& _hit) const; ///< Finds the closest hit, returns false on miss.
+		bool occluded(const Ray& _ray) const; ///< True if any triangle lies between tMin and tMax, stops at the first one found.
+
+		/*GETTERS*/
+		const std::vector<BVH8CompressedNode>& getNodes() const;
+		AABB getBounds() const;
+		size_t getMemorySize() const; ///< Bytes used by nodes and triangle references, the shared triangles are counted by the binary tree.
+	};
+}
+#endif // !RTX_BVH8COMPRESSED_H
@@ -0,0 +1,189 @@
+#include "RTX_BVHCache.h"
+#include "RTX_Hash.h" // Payload checksum
+#include <vector> // std::vector
+#include <fstream> // Writing cache files
+#include <cstdio> // std::rename, std::remove
+#include <cstring> // memcmp
+#if defined(_WIN32)
+#include <windows.h> // CreateFileMapping, MapViewOfFile
+#else
+#include <sys/mman.h> // mmap
+#include <sys/stat.h> // fstat, mkdir
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#endif
+
+namespace RTXSimplified
+{
+	static const char cacheMagic[8] = { 'R', 'T', 'X', 'B', 'V', 'H', 0, 0 };
+
+	/**
+	*	Read only view of a whole file, unmapped when it goes out of scope.
+	*/
+	class MappedFile
+	{
+	private:
+#if defined(_WIN32)
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#endif
+		const char* data = nullptr;
+		size_t size = 0;
+
+	public:
+		MappedFile(const std::string& _path)
+		{
+#if defined(_WIN32)
+			file = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			{
+				return;
+			}
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping)
+			{
+				return;
+			}
+			data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			size = data ? static_cast<size_t>(fileSize.QuadPart) : 0;
+#else
+			int descriptor = open(_path.c_str(), O_RDONLY);
+			if (descriptor < 0)
+			{
+				return;
+			}
+			struct stat info;
+			if (fstat(descriptor, &info) == 0 && info.st_size > 0)
+			{
+				void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+				if (view != MAP_FAILED)
+				{
+					data = static_cast<const char*>(view);
+					size = static_cast<size_t>(info.st_size);
+				}
+			}
+			close(descriptor); // The mapping keeps the file alive
+#endif
+		}
+		~MappedFile()
+		{
+#if defined(_WIN32)
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (data) munmap(const_cast<char*>(data), size);
+#endif
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* getData() const { return data; }
+		size_t getSize() const { return size; }
+	};
+
+	RTX_BVHCache::RTX_BVHCache(const std::string& _directory)
+		: directory(_directory)
+	{
+#if defined(_WIN32)
+		CreateDirectoryA(directory.c_str(), nullptr); // Fails harmlessly if it already exists
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+
+	std::string RTX_BVHCache::getPath(uint64_t _hash, uint32_t _stride, uint32_t _vertexCount)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "%016llx_%u_%u.bvh", static_cast<unsigned long long>(_hash), _stride, _vertexCount);
+		return directory + "/" + name;
+	}
+
+	bool RTX_BVHCache::load(uint64_t _hash, uint32_t _stride, uint32_t _vertexCount, RTX_CPUBVH& _binary, RTX_BVH8& _wide)
+	{
+		MappedFile file(getPath(_hash, _stride, _vertexCount));
+		if (!file.getData() || file.getSize() < sizeof(BVHCacheHeader)) // Not built yet
+		{
+			misses++;
+			return false;
+		}
+
+		BVHCacheHeader header;
+		memcpy(&header, file.getData(), sizeof(header));
+		const char* payload = file.getData() + sizeof(header);
+		size_t payloadSize = file.getSize() - sizeof(header);
+		if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != version
+			|| header.hash != _hash || header.stride != _stride || header.vertexCount != _vertexCount
+			|| header.payloadSize != payloadSize || header.payloadHash != hashBytes(payload, payloadSize)) // Stale, foreign or damaged, rebuild it
+		{
+			RTX_Exception::handleError("Ignoring invalid BVH cache file.", false);
+			misses++;
+			return false;
+		}
+
+		size_t offset = 0;
+		if (!_binary.deserialize(payload, payloadSize, offset) || !_wide.deserialize(payload, payloadSize, offset))
+		{
+			RTX_Exception::handleError("Ignoring unreadable BVH cache file.", false);
+			_binary = RTX_CPUBVH(); // Drop the partial load so the caller can build into them
+			_wide = RTX_BVH8();
+			misses++;
+			return false;
+		}
+
+		hits++;
+		return true;
+	}
+
+	int RTX_BVHCache::store(uint64_t _hash, uint32_t _stride, uint32_t _vertexCount, const RTX_CPUBVH& _binary, const RTX_BVH8& _wide)
+	{
+		std::vector<char> payload;
+		_binary.serialize(payload);
+		_wide.serialize(payload);
+
+		BVHCacheHeader header = {};
+		memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = version;
+		header.stride = _stride;
+		header.hash = _hash;
+		header.vertexCount = _vertexCount;
+		header.payloadSize = payload.size();
+		header.payloadHash = hashBytes(payload.data(), payload.size());
+
+		// Write next to the final file and rename, so a crash never leaves a half written cache entry
+		std::string path = getPath(_hash, _stride, _vertexCount);
+		std::string temporaryPath = path + ".tmp";
+		{
+			std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				RTX_Exception::handleError("Could not write the BVH cache file.", false);
+				return 1;
+			}
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+		}
+		std::remove(path.c_str()); // rename does not overwrite on Windows
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+		{
+			RTX_Exception::handleError("Could not write the BVH cache file.", false);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	uint32_t RTX_BVHCache::getHits()
+	{
+		return hits;
+	}
+	uint32_t RTX_BVHCache::getMisses()
+	{
+		return misses;
+	}
+}
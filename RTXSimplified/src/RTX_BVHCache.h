@@ -0,0 +1,65 @@
+#ifndef RTX_BVHCACHE_H
+#define RTX_BVHCACHE_H
+
+#include <string> // std::string
+#include <stdint.h> // uint64_t
+#include <atomic> // counters shared by concurrent builds
+#include "RTX_CPUBVH.h" // Binary tree
+#include "RTX_BVH8.h" // 8 wide tree
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	struct BVHCacheHeader
+	{
+		char magic[8];			///< "RTXBVH\0\0", rejects foreign files.
+		uint32_t version;		///< Bumped whenever the layout of a node or the builder changes.
+		uint32_t stride;		///< Vertex stride of the source geometry.
+		uint64_t hash;			///< Content hash of the source geometry.
+		uint32_t vertexCount;	///< Vertex count of the source geometry.
+		uint32_t padding;		///< Keeps the payload 16 byte aligned.
+		uint64_t payloadSize;	///< Bytes following the header.
+		uint64_t payloadHash;	///< Hash of those bytes, catches truncated or corrupted files.
+	}; ///< Start of every cache file.
+
+	/**
+	*	\brief The class responsible for keeping built CPU BVHs on disk between runs.
+	*
+	*	Trees are written once after their first build, as a header followed by plain arrays with no
+	*	pointers, so the file can be mapped anywhere. On the next run the file is memory mapped and the
+	*	arrays are copied straight out of it instead of rebuilding.
+	*/
+	class RTX_BVHCache
+	{
+	private:
+		static const uint32_t version = 1; ///< Format version written to every file.
+		std::string directory; ///< Where the cache files live.
+		std::atomic<uint32_t> hits{ 0 }; ///< Trees loaded from disk, BLAS are loaded from several threads at once.
+		std::atomic<uint32_t> misses{ 0 }; ///< Trees that had to be built.
+
+		std::string getPath(uint64_t _hash, uint32_t _stride, uint32_t _vertexCount); ///< File name of one tree.
+
+	public:
+		RTX_BVHCache(const std::string& _directory); ///< Constructor, creates the directory if needed.
+
+		bool load(
+			uint64_t _hash,			///< Content hash of the geometry.
+			uint32_t _stride,		///< Vertex stride.
+			uint32_t _vertexCount,	///< Vertex count.
+			RTX_CPUBVH& _binary,	///< Filled with the binary tree.
+			RTX_BVH8& _wide			///< Filled with the 8 wide tree.
+		); ///< Loads a tree built on a previous run, returns false if there is no valid file.
+		int store(
+			uint64_t _hash,				///< Content hash of the geometry.
+			uint32_t _stride,			///< Vertex stride.
+			uint32_t _vertexCount,		///< Vertex count.
+			const RTX_CPUBVH& _binary,	///< Built binary tree.
+			const RTX_BVH8& _wide		///< Collapsed 8 wide tree.
+		); ///< Writes a freshly built tree for the next run.
+
+		/*GETTERS*/
+		uint32_t getHits();
+		uint32_t getMisses();
+	};
+}
+#endif // !RTX_BVHCACHE_H
@@ -1,6 +1,11 @@
 #include "RTX_BVHmanager.h"
 #include "RTX_Manager.h"
 #include "RTX_Initializer.h"
+#include "RTX_Pipeline.h"
+#include <iostream> // BLAS cache report
+#include <cstring> // memcmp, memcpy
+#include <algorithm> // std::max
+#include "RTX_Hash.h" // Keys of buffers without a CPU copy
 
 namespace RTXSimplified
 {
@@ -35,16 +40,32 @@ namespace RTXSimplified
 		return pBuffer;
 	}
 
-	AccelerationStructureBuffers RTX_BVHmanager::createBLAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> _vertexBuffers)
+	AccelerationStructureBuffers RTX_BVHmanager::createBLAS(const std::vector<BLASGeometry>& _geometries, const BLASBuildOptions& _options)
 	{
 		RTX_BLAS blastemp;
 		// Add all vertex buffers
-		for (const auto& buffer : _vertexBuffers)
+		for (const auto& geometry : _geometries)
 		{
+			if (geometry.indexBuffer) // Indexed mesh
+			{
+				blastemp.addIndexedVertexBuffer(	// Add a new indexed vertex buffer
+					geometry.vertexBuffer.Get(),	// from this resource
+					0,								// no offset
+					geometry.vertexCount,			// with these many vertices
+					sizeof(Vertex),					// the stride of one Vertex
+					geometry.indexBuffer.Get(),		// indexed by this resource
+					0,								// no offset
+					geometry.indexCount,			// with these many indices
+					0,								// with no transform buffer
+					0,								// nor transform offset
+					true							// and make it opaque
+				);
+				continue;
+			}
 			blastemp.addVertexBuffer(				// Add a new vertex buffer
-				buffer.first.Get(),					// from this resource
+				geometry.vertexBuffer.Get(),		// from this resource
 				0,									// no offset
-				buffer.second,						// with these many bufferse
+				geometry.vertexCount,				// with these many bufferse
 				sizeof(Vertex),						// the stride of one Vertex
 				0,									// with no transform buffer
 				0,									// nor transform offset
@@ -56,62 +77,240 @@ namespace RTXSimplified
 		UINT64 resultSizeInBytes = 0;  // Temporary result storage space
 
 		// Calculate the buffer sizes
-		blastemp.computeASBufferSize(rtxManager->getInitializer()->getRTXDevice().Get(), false, &scratchSizeInBytes, &resultSizeInBytes);
+		blastemp.computeASBufferSize(rtxManager->getInitializer()->getRTXDevice().Get(), false, &scratchSizeInBytes, &resultSizeInBytes, _options.fastBuild);
 
-		AccelerationStructureBuffers buffers; // Struct for buffers info (scratch, result, instanceDesc)
-		buffers.scratch = createBuffer(								// Create a buffer
-			rtxManager->getInitializer()->getRTXDevice().Get(),		// for this device
-			scratchSizeInBytes,										// using the size computed
-			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,				// allow unordered access
-			D3D12_RESOURCE_STATE_COMMON,							// common type
-			defaultHeapProperties									// using default heap properties
-		);
+		if (!scratchPool) // Scratch memory is shared by every BLAS of a batch
+		{
+			scratchPool = std::make_shared<RTX_ScratchPool>([this](UINT64 _size)
+			{
+				ComPtr<ID3D12Resource> scratch;
+				scratch.Attach(createBuffer(							// Take ownership of a new buffer
+					rtxManager->getInitializer()->getRTXDevice().Get(),	// for this device
+					_size,												// using the batch maximum
+					D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,			// allow unordered access
+					D3D12_RESOURCE_STATE_COMMON,						// common type
+					defaultHeapProperties								// using default heap properties
+				));
+				return scratch;
+			});
+		}
+		scratchPool->reserve(scratchSizeInBytes); // Only grows the arena if this is the biggest build so far
 
-		buffers.result = createBuffer(								// Create a buffer
+		AccelerationStructureBuffers buffers; // Struct for buffers info (scratch, result, instanceDesc), scratch stays empty
+		buffers.result.Attach(createBuffer(							// Take ownership of a new buffer
 			rtxManager->getInitializer()->getRTXDevice().Get(),		// for this device
 			resultSizeInBytes,										// using the size computed
 			D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,				// allow unordered access
 			D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,	// acceleration structure type
 			defaultHeapProperties									// using default heap properties
-		);
+		));
 
-		blastemp.generate(											// Generate the new AS
-			rtxManager->getInitializer()->getCommandList().Get(),	// using the command list created earlier
-			buffers.scratch.Get(),									// and the two buffers we just created
-			buffers.result.Get(),									// 
-			false,													// this is not and update
-			nullptr													// so no previous instance
-		);
+		PendingBLAS pending; // The build is recorded once the whole batch is sized
+		pending.generator = std::make_shared<RTX_BLAS>(blastemp);
+		pending.result = buffers.result;
+		pendingBLAS.push_back(pending);
 
 		return buffers;
 	}
 
-	int RTX_BVHmanager::createTLAS(std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& _instances, bool _updateOnly)
+	int RTX_BVHmanager::buildPendingBLAS()
+	{
+		for (size_t i = 0; i < pendingBLAS.size(); i++)
+		{
+			pendingBLAS[i].generator->generate(						// Generate the new AS
+				rtxManager->getInitializer()->getCommandList().Get(),	// using the command list created earlier
+				scratchPool->acquire(rtxManager->getInitializer()->getCommandList().Get()), // the shared scratch arena
+				pendingBLAS[i].result.Get(),							// and the result buffer
+				false,													// this is not and update
+				nullptr													// so no previous instance
+			);
+		}
+		pendingBLAS.clear();
+		return 0;
+	}
+
+	AccelerationStructureBuffers RTX_BVHmanager::acquireBLAS(const Model& _model)
 	{
-		if (!_updateOnly) // If this is generating a TLAS
+		BLASKey key;
+		key.hash = _model.vertices.empty()												// Without a CPU copy only
+			? mixHash(reinterpret_cast<uintptr_t>(_model.buffer.Get())					// the same vertex and index
+				^ mixHash(reinterpret_cast<uintptr_t>(_model.indexBuffer.Get())))		// buffers can be shared
+			: _model.contentHash;														// otherwise identical bytes can
+		key.stride = sizeof(Vertex);
+		key.count = _model.verticesAmount;
+		key.indexCount = _model.indexBuffer ? _model.indicesAmount : 0;
+
+		std::pair<std::multimap<BLASKey, BLASCacheEntry>::iterator, std::multimap<BLASKey, BLASCacheEntry>::iterator> range = blasCache.equal_range(key);
+		for (std::multimap<BLASKey, BLASCacheEntry>::iterator it = range.first; it != range.second; it++)
 		{
-			if (rtxManager->getShadowsEnabled())
+			bool identical = it->second.options == _model.buildOptions // Same builder, then confirm the hash match byte by byte
+				&& (_model.vertices.empty() || (it->second.vertices.size() == _model.vertices.size()
+				&& memcmp(it->second.vertices.data(), _model.vertices.data(), sizeof(Vertex) * _model.vertices.size()) == 0
+				&& it->second.indices == _model.indices));
+			if (identical) // Cache hit
 			{
-				for (size_t i = 0; i < _instances.size(); i++) // Group up all the instances.
-				{
-					TLASmanager.addInstance(		// Add a new instance
-						_instances[i].first.Get(),	// Using the BLAS
-						_instances[i].second,		// and the transform matrix linked to it
-						static_cast<UINT>(i),		// with a new ID
-						static_cast<UINT>(2 * i));	// and a hit group index of 2 * ID (One for base hit group, one for shadow hit group)
-				}
+				it->second.refCount++;
+				return it->second.buffers;
+			}
+		}
+
+		BLASCacheEntry entry; // Cache miss, build it
+		BLASGeometry geometry;
+		geometry.vertexBuffer = _model.buffer;
+		geometry.vertexCount = _model.verticesAmount;
+		geometry.indexBuffer = _model.indexBuffer;
+		geometry.indexCount = _model.indicesAmount;
+		entry.buffers = createBLAS({ geometry }, _model.buildOptions);
+		entry.vertices = _model.vertices;
+		entry.indices = _model.indices;
+		entry.options = _model.buildOptions;
+		entry.refCount = 1;
+		std::multimap<BLASKey, BLASCacheEntry>::iterator inserted = blasCache.insert(std::make_pair(key, entry));
+		if (!_model.vertices.empty()) // Mirror it on the CPU when the vertices are available
+		{
+			PendingCPUBLAS pending; // Built by the scene task graph, alongside the other BLAS
+			pending.blas = entry.buffers.result.Get();
+			pending.vertices = &inserted->second.vertices;
+			pending.indices = &inserted->second.indices;
+			pending.contentHash = _model.contentHash;
+			pending.options = _model.buildOptions;
+			pendingCPUBLAS.push_back(pending);
+		}
+
+		return entry.buffers;
+	}
+
+	CPUAccelerationStructure RTX_BVHmanager::acquireCPUBLAS(const Model& _model)
+	{
+		if (_model.vertices.empty()) // Error check
+		{
+			RTX_Exception::handleError("Trying to build a CPU BLAS for a model without a CPU copy of its vertices.", false);
+			return CPUAccelerationStructure();
+		}
+
+		BLASKey key;
+		key.hash = _model.contentHash;
+		key.stride = sizeof(Vertex);
+		key.count = _model.verticesAmount;
+		key.indexCount = static_cast<uint32_t>(_model.indices.size());
+
+		std::pair<std::multimap<BLASKey, CPUBLASCacheEntry>::iterator, std::multimap<BLASKey, CPUBLASCacheEntry>::iterator> range = cpuOnlyCache.equal_range(key);
+		for (std::multimap<BLASKey, CPUBLASCacheEntry>::iterator it = range.first; it != range.second; it++)
+		{
+			if (it->second.vertices.size() == _model.vertices.size() // Confirm the hash match byte by byte
+				&& memcmp(it->second.vertices.data(), _model.vertices.data(), sizeof(Vertex) * _model.vertices.size()) == 0
+				&& it->second.indices == _model.indices
+				&& it->second.options == _model.buildOptions) // Cache hit
+			{
+				return it->second.structure;
+			}
+		}
+
+		CPUBLASCacheEntry entry; // Cache miss, build it now, there is no GPU build to overlap with
+		entry.vertices = _model.vertices;
+		entry.indices = _model.indices;
+		entry.options = _model.buildOptions;
+		entry.structure = createCPUBLAS(entry.vertices, entry.indices, _model.contentHash, entry.options);
+		cpuOnlyCache.insert(std::make_pair(key, entry));
+
+		return entry.structure;
+	}
+
+	int RTX_BVHmanager::releaseBLAS(ID3D12Resource* _blas)
+	{
+		for (std::multimap<BLASKey, BLASCacheEntry>::iterator it = blasCache.begin(); it != blasCache.end(); it++)
+		{
+			if (it->second.buffers.result.Get() != _blas)
+			{
+				continue;
+			}
+			if (--it->second.refCount == 0) // Last user, free the GPU and CPU copies
+			{
+				cpuBLAS.erase(_blas);
+				blasCache.erase(it);
+			}
+			return 0;
+		}
+
+		RTX_Exception::handleError("Trying to release a BLAS that is not in the cache.", false);
+		return 1;
+	}
+
+	CPUAccelerationStructure RTX_BVHmanager::createCPUBLAS(const std::vector<Vertex>& _vertices, const std::vector<uint32_t>& _indices, uint64_t _contentHash, const BLASBuildOptions& _options)
+	{
+		CPUAccelerationStructure structure;
+		structure.binary = std::make_shared<RTX_CPUBVH>();
+		structure.wide = std::make_shared<RTX_BVH8>();
+		uint32_t vertexCount = static_cast<uint32_t>(_vertices.size());
+		BVHBuildMode mode = _options.fastBuild ? BVH_BUILD_LBVH					// LBVH for geometry rebuilt often
+			: (_options.spatialSplits ? BVH_BUILD_SBVH : BVH_BUILD_SAH);			// SBVH when asked for, SAH otherwise
+		uint64_t diskKey = _contentHash; // SAH keeps the keys of earlier runs
+		if (mode != BVH_BUILD_SAH) // Other builders, and other split budgets, get their own files
+		{
+			uint32_t budgetBits = 0;
+			if (mode == BVH_BUILD_SBVH)
+			{
+				memcpy(&budgetBits, &_options.spatialSplitBudget, sizeof(budgetBits));
+			}
+			diskKey = mixHash(_contentHash ^ mode ^ (static_cast<uint64_t>(budgetBits) << 32));
+		}
+
+		if (!diskCache || !diskCache->load(diskKey, sizeof(Vertex), vertexCount, *structure.binary, *structure.wide)) // Not built on a previous run
+		{
+			if (!threadPool) // Start the workers on first use
+			{
+				threadPool = std::make_shared<RTX_ThreadPool>();
+			}
+
+			if (!_indices.empty()) // Indexed mesh
+			{
+				structure.binary->addIndexedVertexBuffer(	// Add the CPU vertices
+					_vertices.data(),						// from the model copy
+					0,										// no offset
+					vertexCount,							// all of them
+					sizeof(Vertex),							// the stride of one Vertex
+					_indices.data(),						// indexed by the model copy
+					static_cast<uint32_t>(_indices.size()),	// all of them
+					true									// and make it opaque, like the GPU BLAS
+				);
 			}
 			else
 			{
-				for (size_t i = 0; i < _instances.size(); i++) // Group up all the instances.
-				{
-					TLASmanager.addInstance(		// Add a new instance
-						_instances[i].first.Get(),	// Using the BLAS
-						_instances[i].second,		// and the transform matrix linked to it
-						static_cast<UINT>(i),		// with a new ID
-						static_cast<UINT>(i));	// and a hit group index of ID (One for base hit group)
-				}
+				structure.binary->addVertexBuffer(		// Add the CPU vertices
+					_vertices.data(),					// from the model copy
+					0,									// no offset
+					vertexCount,						// all of them
+					sizeof(Vertex),						// the stride of one Vertex
+					true								// and make it opaque, like the GPU BLAS
+				);
+			}
+			structure.binary->setSpatialSplitBudget(_options.spatialSplitBudget); // Only read by SBVH
+			structure.binary->build(threadPool.get(), mode); // Binned SAH, LBVH or SBVH build
+			structure.wide->collapse(*structure.binary); // Collapse for 8 wide traversal
+
+			if (diskCache) // Keep it for the next run
+			{
+				diskCache->store(diskKey, sizeof(Vertex), vertexCount, *structure.binary, *structure.wide);
 			}
+		}
+
+		if (compressCPUBLAS) // Quantize the nodes and drop the 8 wide tree with its triangle copy, the binary tree stays for packets and its triangles are shared
+		{
+			structure.compressed = std::make_shared<RTX_BVH8Compressed>();
+			structure.compressed->compress(*structure.wide, structure.binary);
+			structure.wide.reset();
+		}
+
+		return structure;
+	}
+
+	int RTX_BVHmanager::createTLAS(bool _updateOnly)
+	{
+		bool grow = !_updateOnly && (!TLASBuffers.result || TLASmanager.getInstanceCount() > TLASmanager.getCapacity()); // Full builds reuse the buffers while the instances fit
+		if (grow) // If the TLAS needs new buffers
+		{
+			bool moved = TLASBuffers.result != nullptr; // The shaders still point at the old TLAS
+			TLASmanager.reserve(moved ? 2 * TLASmanager.getInstanceCount() : TLASmanager.getInstanceCount()); // Streaming worlds keep growing, leave room
 
 			// Note: instance descriptor is also stored on the GPU for this.
 			UINT64 scratchSize = 0, resultSize = 0, instanceDescsSize = 0; // Stores the memory needed for each component.
@@ -123,33 +322,39 @@ namespace RTXSimplified
 				&instanceDescsSize
 			);
 
-			TLASBuffers.scratch = createBuffer(							// Create a new buffer
+			// Attach takes over the reference createBuffer returns and releases the old buffers, assigning would AddRef and leak them
+			TLASBuffers.scratch.Attach(createBuffer(					// Take ownership of a new buffer
 				rtxManager->getInitializer()->getRTXDevice().Get(),		// for this device
 				scratchSize,											// using size computed
 				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,				// allow unordered access
 				D3D12_RESOURCE_STATE_UNORDERED_ACCESS,					// state required for unordered access
 				defaultHeapProperties									// using default heap properties
-			);
-			TLASBuffers.result = createBuffer(							// Create a new buffer
+			));
+			TLASBuffers.result.Attach(createBuffer(						// Take ownership of a new buffer
 				rtxManager->getInitializer()->getRTXDevice().Get(),		// for this device
 				resultSize,												// using size computed
 				D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,				// allow unordered access
 				D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,	// using AS state
 				defaultHeapProperties									// using default heap properties
-			);
-			TLASBuffers.instanceDesc = createBuffer(					// Create a new buffer
+			));
+			TLASBuffers.instanceDesc.Attach(createBuffer(				// Take ownership of a new buffer
 				rtxManager->getInitializer()->getRTXDevice().Get(),		// for this device
 				instanceDescsSize,										// using size computed
 				D3D12_RESOURCE_FLAG_NONE,								// no options specified
-				D3D12_RESOURCE_STATE_GENERIC_READ,						// required starting state for an upload heap
-				uploadHeapProperties									// using upload heap properties
-			);
+				D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,			// state builds read descriptors in
+				defaultHeapProperties									// filled from the upload ring
+			));
+			if (moved) // The previous frame finished before recording started, so releasing the old buffers above was safe
+			{
+				rtxManager->getInitializer()->getPipeline()->updateTLASView();
+			}
 		}
 		TLASmanager.generate(										// Generate the AS
 			rtxManager->getInitializer()->getCommandList().Get(),	// using the command list created earlier
 			TLASBuffers.scratch.Get(),								// and the three buffers just created
 			TLASBuffers.result.Get(),								//
 			TLASBuffers.instanceDesc.Get(),							//
+			rtxManager->getInitializer()->getUploadRing().get(),	// writing the descriptors through the upload ring
 			_updateOnly,											// is this an update
 			TLASBuffers.result.Get()								// previous instance
 		);
@@ -163,27 +368,114 @@ namespace RTXSimplified
 		HRESULT hr; // Error handling
 
 		std::vector<AccelerationStructureBuffers> buffers; // Stores all the buffers
-		for (int i = 0; i < rtxManager->getModels().size(); i++) // For each model 
+		std::vector<Model> models = rtxManager->getModels();
+		for (size_t i = 0; i < models.size(); i++) // For each model 
 		{
-			AccelerationStructureBuffers BLASbuffer = createBLAS({ {
-				rtxManager->getModels()[i].buffer.Get(),
-				rtxManager->getModels()[i].verticesAmount
-				} }); // Create a new blas.
-			buffers.push_back(BLASbuffer); // And store it locally
+			buffers.push_back(acquireBLAS(models[i])); // Get its BLAS, shared with any identical model, and store it locally
 		}
 		
 		// Add all BLAS to instances of the TLAS.
 		/*Note -> better way to do this is once per model but for demo purposes its like this*/
-		instances =
+		std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> sceneInstances =
 		{
 				{ buffers[0].result, DirectX::XMMatrixIdentity() },
 				{ buffers[0].result, DirectX::XMMatrixTranslation(0.f, .5f, 0) },
 				{ buffers[0].result, DirectX::XMMatrixTranslation(-.5f, 0.f, 0) },
 				{ buffers[1].result, DirectX::XMMatrixTranslation(-.5f, 0.5f, 0) }
 		};
+		for (size_t i = 0; i < sceneInstances.size(); i++) // Group up all the instances.
+		{
+			addInstance(								// Add a new instance
+				sceneInstances[i].first.Get(),			// Using the BLAS
+				sceneInstances[i].second,				// and the transform matrix linked to it
+				static_cast<UINT>(i),					// with a new ID
+				static_cast<UINT>(rtxManager->getShadowsEnabled() ? 2 * i : i)); // and a hit group index of 2 * ID with shadows (One for base hit group, one for shadow hit group), ID without
+		}
+
+		if (!threadPool) // Start the workers before any task needs them
+		{
+			threadPool = std::make_shared<RTX_ThreadPool>();
+		}
 
-		createTLAS(instances); // Create TLAS
+		// Independent CPU BLAS builds run on every core, the command list is recorded by one task at a time
+		// in dependency order, and the GPU starts on its builds while the CPU copies are still being made.
+		RTX_TaskGraph graph;
+		std::vector<uint32_t> cpuTLASDependencies;
+		for (size_t i = 0; i < pendingCPUBLAS.size(); i++)
+		{
+			PendingCPUBLAS pending = pendingCPUBLAS[i];
+			CPUAccelerationStructure* target = &cpuBLAS[pending.blas]; // Inserted here, the tasks only fill their own entry
+			cpuTLASDependencies.push_back(graph.addTask("CPU BLAS " + std::to_string(i), [this, pending, target]()
+			{
+				*target = createCPUBLAS(*pending.vertices, *pending.indices, pending.contentHash, pending.options);
+			}));
+		}
+		uint32_t gpuBLASTask = graph.addTask("GPU BLAS", [this]() { buildPendingBLAS(); }); // Record the builds now the scratch arena size is known
+		uint32_t tlasTask = graph.addTask("TLAS", [this]() { createTLAS(); }, { gpuBLASTask });
+		graph.addTask("Submit", [this]() { submitCommandList(); }, { tlasTask });
+		cpuTLASDependencies.push_back(tlasTask); // The TLAS task sets up the masks and flags the CPU TLAS copies
+		graph.addTask("CPU TLAS", [this]() { createCPUTLAS(); }, cpuTLASDependencies);
+
+		graph.run(*threadPool);
+		pendingCPUBLAS.clear();
+		buildTimings = graph.getTimings();
+		buildTimeMs = graph.getTotalTimeMs();
+
+		WaitForSingleObject(rtxManager->getInitializer()->getFenceEvent(), INFINITE); // Wait for the GPU builds to finish
+		rtxManager->getInitializer()->getUploadRing()->releaseCompleted(rtxManager->getInitializer()->getFence()->GetCompletedValue());
+
+		if (scratchPool) // The builds are done, the scratch arena can go
+		{
+			scratchPool->endBatch(rtxManager->getInitializer()->getFenceValue());
+			scratchPool->releaseCompleted(rtxManager->getInitializer()->getFence()->GetCompletedValue());
+		}
 
+		//Reset the command list
+		hr = rtxManager->getInitializer()->getCommandList()->Reset(
+			rtxManager->getInitializer()->getCommandAllocator().Get(),
+			rtxManager->getInitializer()->getPipelineState().Get()
+		);
+
+		RTX_Exception::handleError(&hr, "Error reseting the command list.");
+
+		return 0;
+	}
+	int RTX_BVHmanager::createCPUAccelerationStructure()
+	{
+		std::vector<CPUAccelerationStructure> structures; // Stores all the CPU BLAS
+		std::vector<Model> models = rtxManager->getModels();
+		if (models.size() < 2) // Error check
+		{
+			RTX_Exception::handleError("The sample scene needs two models, see addSampleModels.", false);
+			return 1;
+		}
+		for (size_t i = 0; i < models.size(); i++) // For each model
+		{
+			structures.push_back(acquireCPUBLAS(models[i])); // Get its CPU BLAS, shared with any identical model
+		}
+
+		// Same instances as createAccelerationStructure, so the hit group indices match the CPU hit group records
+		std::vector<std::pair<CPUAccelerationStructure, DirectX::XMMATRIX>> sceneInstances =
+		{
+				{ structures[0], DirectX::XMMatrixIdentity() },
+				{ structures[0], DirectX::XMMatrixTranslation(0.f, .5f, 0) },
+				{ structures[0], DirectX::XMMatrixTranslation(-.5f, 0.f, 0) },
+				{ structures[1], DirectX::XMMatrixTranslation(-.5f, 0.5f, 0) }
+		};
+		for (size_t i = 0; i < sceneInstances.size(); i++)
+		{
+			addCPUInstance(								// Add a new instance
+				sceneInstances[i].first,				// using the CPU BLAS
+				sceneInstances[i].second,				// and the transform matrix linked to it
+				static_cast<UINT>(i),					// with a new ID
+				static_cast<UINT>(rtxManager->getShadowsEnabled() ? 2 * i : i)); // and the same hit group index as on the GPU
+		}
+
+		createCPUTLAS();
+		return 0;
+	}
+	int RTX_BVHmanager::submitCommandList()
+	{
 		// Flush the command list
 		rtxManager->getInitializer()->getCommandList().Get()->Close();
 		ID3D12CommandList* commandLists[] = { rtxManager->getInitializer()->getCommandList().Get() };
@@ -191,45 +483,359 @@ namespace RTXSimplified
 		rtxManager->getInitializer()->setFenceValue(rtxManager->getInitializer()->getFenceValue() + 1);
 		rtxManager->getInitializer()->getCommandQueue()->Signal(
 			rtxManager->getInitializer()->getFence().Get(), rtxManager->getInitializer()->getFenceValue());
+		rtxManager->getInitializer()->getUploadRing()->endFrame(rtxManager->getInitializer()->getFenceValue()); // Uploads of the build are free once it is done
 		rtxManager->getInitializer()->getFence()->SetEventOnCompletion(rtxManager->getInitializer()->getFenceValue(), rtxManager->getInitializer()->getFenceEvent());
-		WaitForSingleObject(rtxManager->getInitializer()->getFenceEvent(), INFINITE); // Wait for it to finish
+		return 0;
+	}
+	int RTX_BVHmanager::updateCPUTLAS()
+	{
+		if (cpuTLASStale) // Instances were added, removed or point to another BLAS
+		{
+			createCPUTLAS();
+		}
+		else // Only the inverses and bounds of moved instances are recomputed
+		{
+			uint32_t forcedRebuilds = cpuTLAS.getUpdateStats().forcedRebuildCount;
+			cpuTLAS.update();
+			if (cpuTLAS.getUpdateStats().forcedRebuildCount != forcedRebuilds) // The driver's tree is opaque, the CPU mirror was refitted the same way so its quality stands in for it
+			{
+				TLASmanager.requestRebuild();
+			}
+		}
+		return 0;
+	}
+	int RTX_BVHmanager::updateTLAS()
+	{
+		updateCPUTLAS();
 
-		//Reset the command list
-		hr = rtxManager->getInitializer()->getCommandList()->Reset(
-			rtxManager->getInitializer()->getCommandAllocator().Get(),
-			rtxManager->getInitializer()->getPipelineState().Get()
-		);
+		if (!TLASmanager.isDirty()) // No instance changed since the last frame, keep the current TLAS
+		{
+			return 0;
+		}
+		createTLAS(!TLASmanager.needsRebuild()); // A changed instance count can not be refitted
+		return 0;
+	}
+	int RTX_BVHmanager::printBuildStats()
+	{
+		double busyTimeMs = 0.0;
+		for (size_t i = 0; i < buildTimings.size(); i++)
+		{
+			busyTimeMs += buildTimings[i].durationMs;
+		}
+		std::cout << "BLAS cache: " << rtxManager->getModels().size() << " models, " << blasCache.size() + cpuOnlyCache.size() << " unique BLAS" << std::endl;
+		std::cout << "Scene build: " << buildTimeMs << " ms, " << buildTimings.size() << " tasks, "
+			<< busyTimeMs / (std::max)(buildTimeMs, 1e-3) << "x parallel on " << (threadPool ? threadPool->getThreadCount() : 1) << " threads" << std::endl;
 
-		RTX_Exception::handleError(&hr, "Error reseting the command list.");
+		// CPU builders, stats of trees loaded from disk are those of their original build
+		uint32_t cpuTreeCount = 0, triangleCount = 0, referenceCount = 0;
+		double cpuBuildTimeMs = 0.0, sahCost = 0.0;
+		auto addCPUStats = [&](const CPUAccelerationStructure& _structure)
+		{
+			if (!_structure.binary)
+			{
+				return;
+			}
+			BVHBuildStats stats = _structure.binary->getStats();
+			cpuTreeCount++;
+			triangleCount += stats.triangleCount;
+			referenceCount += stats.referenceCount;
+			cpuBuildTimeMs += stats.buildTimeMs;
+			sahCost += stats.sahCost;
+		};
+		for (std::map<ID3D12Resource*, CPUAccelerationStructure>::iterator it = cpuBLAS.begin(); it != cpuBLAS.end(); it++)
+		{
+			addCPUStats(it->second);
+		}
+		for (std::multimap<BLASKey, CPUBLASCacheEntry>::iterator it = cpuOnlyCache.begin(); it != cpuOnlyCache.end(); it++)
+		{
+			addCPUStats(it->second.structure);
+		}
+		if (cpuTreeCount > 0)
+		{
+			std::cout << "CPU BLAS: " << cpuTreeCount << " trees, " << triangleCount << " triangles, " << referenceCount << " references, "
+				<< cpuBuildTimeMs << " ms building, mean SAH cost " << sahCost / cpuTreeCount << std::endl;
+		}
+		if (scratchPool)
+		{
+			std::cout << "BLAS scratch: " << scratchPool->getPeakBytes() / 1024 << " KB peak, " << scratchPool->getAllocationCount() << " allocations" << std::endl;
+		}
+		return 0;
+	}
+	int RTX_BVHmanager::printTLASStats()
+	{
+		const TLASUpdateStats& stats = cpuTLAS.getUpdateStats();
+		std::cout << "TLAS: " << TLASmanager.getRebuildCount() << " GPU builds, " << TLASmanager.getRefitCount() << " GPU refits" << std::endl;
+		std::cout << "CPU TLAS: " << stats.rebuildCount << " builds (" << stats.forcedRebuildCount << " for quality) in " << stats.rebuildTimeMs << " ms, "
+			<< stats.refitCount << " refits in " << stats.refitTimeMs << " ms, SAH cost " << stats.builtCost << " -> " << stats.currentCost
+			<< " (" << cpuTLAS.getDegradation() << "x)" << std::endl;
+		return 0;
+	}
+	int RTX_BVHmanager::createCPUTLAS()
+	{
+		const std::vector<Instance>& instances = TLASmanager.getInstances();
+		const std::vector<InstanceTransform>& transforms = TLASmanager.getTransforms(); // Same 3x4 layout the CPU TLAS uses
+		cpuTLAS.clear();
+		cpuInstanceOf.assign(instances.size(), UINT32_MAX);
+		gpuInstanceOf.clear();
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			std::map<ID3D12Resource*, CPUAccelerationStructure>::iterator it = cpuBLAS.find(instances[i].bottomLevelAS);
+			if (it == cpuBLAS.end() || !it->second.binary) // No CPU copy, the instance is skipped
+			{
+				continue;
+			}
+			cpuTLAS.addInstance(						// Add a new instance
+				it->second.binary.get(),				// using the CPU BLAS
+				it->second.wide.get(),					// in every layout it has
+				it->second.compressed.get(),			//
+				&transforms[i].rows[0][0],				// the transform matrix linked to it
+				instances[i].instanceID,				// the same ID as on the GPU
+				instances[i].hitGroupIndex,				// the same hit group index
+				instances[i].instanceMask,				// the same mask
+				static_cast<uint32_t>(instances[i].flags)); // and the same flags, CPUInstanceFlags shares their bits
+			cpuInstanceOf[i] = static_cast<uint32_t>(gpuInstanceOf.size());
+			gpuInstanceOf.push_back(static_cast<uint32_t>(i));
+		}
+		for (size_t i = 0; i < cpuOnlyInstances.size(); i++) // Then the instances without a GPU BLAS
+		{
+			const CPUOnlyInstance& instance = cpuOnlyInstances[i];
+			cpuTLAS.addInstance(
+				instance.blas.binary.get(),
+				instance.blas.wide.get(),
+				instance.blas.compressed.get(),
+				&instance.transform.rows[0][0],
+				instance.instanceID,
+				instance.hitGroupIndex,
+				instance.instanceMask,
+				static_cast<uint32_t>(instance.flags));
+			gpuInstanceOf.push_back(static_cast<uint32_t>(instances.size() + i)); // Numbered after the TLAS instances
+		}
+		cpuTLAS.update();
+		cpuTLASStale = false;
+		return 0;
+	}
+	int RTX_BVHmanager::tracePackets(const std::vector<RayPacket>& _packets, std::vector<RayPacketHit>& _hits, UINT _instanceInclusionMask)
+	{
+		if (!threadPool) // Start the workers on first use
+		{
+			threadPool = std::make_shared<RTX_ThreadPool>();
+		}
+
+		_hits.resize(_packets.size());
+		threadPool->parallelFor(static_cast<uint32_t>(_packets.size()), 64, [&](uint32_t _begin, uint32_t _end)
+		{
+			for (uint32_t p = _begin; p < _end; p++)
+			{
+				_hits[p].reset();
+				cpuTLAS.intersect(_packets[p], _hits[p], _instanceInclusionMask);
+				for (uint32_t lane = 0; lane < packetWidth; lane++)
+				{
+					if (_hits[p].primitiveIndex[lane] != UINT32_MAX) // Report the TLAS instance, not the CPU one
+					{
+						_hits[p].instanceIndex[lane] = gpuInstanceOf[_hits[p].instanceIndex[lane]];
+					}
+				}
+			}
+		});
 
 		return 0;
 	}
-	int RTX_BVHmanager::updateTLAS()
+	int RTX_BVHmanager::occludedPackets(const std::vector<RayPacket>& _packets, std::vector<uint32_t>& _occluded, UINT _instanceInclusionMask)
 	{
-		createTLAS(instances, true);
+		if (!threadPool) // Start the workers on first use
+		{
+			threadPool = std::make_shared<RTX_ThreadPool>();
+		}
+
+		_occluded.assign(_packets.size(), 0);
+		threadPool->parallelFor(static_cast<uint32_t>(_packets.size()), 64, [&](uint32_t _begin, uint32_t _end)
+		{
+			for (uint32_t p = _begin; p < _end; p++)
+			{
+				_occluded[p] = cpuTLAS.occluded(_packets[p], 0, _instanceInclusionMask);
+			}
+		});
+
 		return 0;
 	}
+	uint32_t RTX_BVHmanager::occludedRays(const std::vector<Ray>& _rays, std::vector<uint8_t>& _occluded, UINT _instanceInclusionMask)
+	{
+		if (!threadPool) // Start the workers on first use
+		{
+			threadPool = std::make_shared<RTX_ThreadPool>();
+		}
+
+		_occluded.assign(_rays.size(), 0);
+		std::atomic<uint32_t> blockedCount(0);
+		threadPool->parallelFor(static_cast<uint32_t>(_rays.size()), 256, [&](uint32_t _begin, uint32_t _end)
+		{
+			blockedCount.fetch_add(cpuTLAS.occluded(&_rays[_begin], _end - _begin, &_occluded[_begin], _instanceInclusionMask));
+		});
+
+		return blockedCount.load();
+	}
+	uint32_t RTX_BVHmanager::traceCameraPackets(uint32_t _width, uint32_t _height, std::vector<RayPacketHit>& _hits)
+	{
+		std::vector<DirectX::XMMATRIX> camera = rtxManager->getInitializer()->getCameraMatrices();
+		if (camera.size() < 4) // Error check
+		{
+			RTX_Exception::handleError("Tracing camera rays before the camera buffer was updated.", false);
+			return 0;
+		}
+
+		DirectX::XMFLOAT4X4 viewInverse, projectionInverse;
+		DirectX::XMStoreFloat4x4(&viewInverse, camera[2]);
+		DirectX::XMStoreFloat4x4(&projectionInverse, camera[3]);
+		std::vector<RayPacket> packets;
+		uint32_t blocksPerRow = RTX_PacketTraversal::generateCameraPackets(&viewInverse.m[0][0], &projectionInverse.m[0][0], _width, _height, packets);
+		tracePackets(packets, _hits);
+
+		return blocksPerRow;
+	}
+	bool RTX_BVHmanager::traceRay(const Ray& _ray, TLASHit& _hit, uint32_t _rayContribution, uint32_t _geometryMultiplier, UINT _instanceInclusionMask)
+	{
+		if (!cpuTLAS.intersect(_ray, _hit, _rayContribution, _geometryMultiplier, _instanceInclusionMask))
+		{
+			return false;
+		}
+		_hit.instanceIndex = gpuInstanceOf[_hit.instanceIndex]; // Report the TLAS instance, not the CPU one
+		return true;
+	}
 	AccelerationStructureBuffers RTX_BVHmanager::getTLASBuffers()
 	{
 		return TLASBuffers;
 	}
-	std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> RTX_BVHmanager::getInstances()
+	const std::vector<Instance>& RTX_BVHmanager::getInstances()
+	{
+		return TLASmanager.getInstances();
+	}
+	InstanceHandle RTX_BVHmanager::getInstanceHandle(UINT _instanceIndex)
+	{
+		return TLASmanager.getHandle(_instanceIndex);
+	}
+	CPUAccelerationStructure RTX_BVHmanager::getCPUBLAS(ID3D12Resource* _blas)
+	{
+		std::map<ID3D12Resource*, CPUAccelerationStructure>::iterator it = cpuBLAS.find(_blas);
+		if (it == cpuBLAS.end()) // Error check
+		{
+			RTX_Exception::handleError("No CPU copy of this BLAS.", false);
+			return CPUAccelerationStructure();
+		}
+		return it->second;
+	}
+	size_t RTX_BVHmanager::getBLASCacheSize()
+	{
+		return blasCache.size();
+	}
+	std::shared_ptr<RTX_ScratchPool> RTX_BVHmanager::getScratchPool()
+	{
+		return scratchPool;
+	}
+	std::shared_ptr<RTX_ThreadPool> RTX_BVHmanager::getThreadPool()
+	{
+		if (!threadPool) // Start the workers on first use
+		{
+			threadPool = std::make_shared<RTX_ThreadPool>();
+		}
+		return threadPool;
+	}
+	std::vector<TaskTiming> RTX_BVHmanager::getBuildTimings()
 	{
-		return instances;
+		return buildTimings;
+	}
+	const RTX_CPUTLAS& RTX_BVHmanager::getCPUTLAS()
+	{
+		return cpuTLAS;
 	}
 	void RTX_BVHmanager::setRTXManager(std::shared_ptr<RTX_Manager> _rtxManager)
 	{
 		rtxManager = _rtxManager;
 	}
-	void RTX_BVHmanager::setInstance(int _instanceNo, int _paramNumber, DirectX::XMMATRIX _valueSecond, ComPtr<ID3D12Resource> _valueFirst)
+	void RTX_BVHmanager::setCompressCPUBLAS(bool _value)
+	{
+		compressCPUBLAS = _value;
+	}
+	void RTX_BVHmanager::setBVHCacheDirectory(const std::string& _directory)
+	{
+		diskCache = _directory.empty() ? nullptr : std::make_shared<RTX_BVHCache>(_directory);
+	}
+	InstanceHandle RTX_BVHmanager::addInstance(ID3D12Resource* _bottomLevelAS, const DirectX::XMMATRIX& _transform, UINT _instanceID, UINT _hitGroupIndex, UINT _instanceMask, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
+	{
+		cpuTLASStale = true; // Instance indices on the CPU are rebuilt with the next update
+		return TLASmanager.addInstance(_bottomLevelAS, _transform, _instanceID, _hitGroupIndex, _instanceMask, _flags);
+	}
+	int RTX_BVHmanager::addCPUInstance(const CPUAccelerationStructure& _blas, const DirectX::XMMATRIX& _transform, UINT _instanceID, UINT _hitGroupIndex, UINT _instanceMask, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
+	{
+		if (!_blas.binary) // Error check
+		{
+			RTX_Exception::handleError("Trying to add a CPU instance without a CPU BLAS.", false);
+			return 1;
+		}
+
+		CPUOnlyInstance instance;
+		instance.blas = _blas;
+		RTX_TLAS::toInstanceTransform(_transform, instance.transform); // Same layout as the TLAS instances
+		instance.instanceID = _instanceID;
+		instance.hitGroupIndex = _hitGroupIndex;
+		instance.instanceMask = _instanceMask & 0xFF; // Only 8 bits, like on the GPU
+		instance.flags = _flags;
+		cpuOnlyInstances.push_back(instance);
+		cpuTLASStale = true; // Added on the next update
+		return 0;
+	}
+	int RTX_BVHmanager::removeInstance(InstanceHandle _instance)
+	{
+		cpuTLASStale = true; // The last instance moved into its place
+		return TLASmanager.removeInstance(_instance);
+	}
+	void RTX_BVHmanager::setInstance(InstanceHandle _instance, int _paramNumber, DirectX::XMMATRIX _valueSecond, ComPtr<ID3D12Resource> _valueFirst)
 	{
+		UINT index = TLASmanager.getInstanceIndex(_instance);
+		if (index == UINT32_MAX) // Error check
+		{
+			RTX_Exception::handleError("Trying to set an instance that does not exist.", false);
+			return;
+		}
 		if (_paramNumber == 1)
 		{
-			instances[_instanceNo].first = _valueFirst;
+			TLASmanager.setInstanceBLAS(_instance, _valueFirst.Get()); // Also flags it dirty
+			cpuTLASStale = true; // The CPU BLAS it points to changed too
 		}
 		if (_paramNumber == 2)
 		{
-			instances[_instanceNo].second = _valueSecond;
+			TLASmanager.setInstanceTransform(_instance, _valueSecond); // Only this descriptor gets rewritten on the next update
+			if (!cpuTLASStale && cpuInstanceOf[index] != UINT32_MAX) // Mirror the move on the CPU
+			{
+				cpuTLAS.setTransform(cpuInstanceOf[index], &TLASmanager.getTransforms()[index].rows[0][0]);
+			}
+		}
+	}
+	void RTX_BVHmanager::setInstanceMask(InstanceHandle _instance, UINT _instanceMask)
+	{
+		UINT index = TLASmanager.getInstanceIndex(_instance);
+		if (index == UINT32_MAX) // Error check
+		{
+			RTX_Exception::handleError("Trying to set the mask of an instance that does not exist.", false);
+			return;
+		}
+		TLASmanager.setInstanceMask(_instance, _instanceMask); // Also flags it dirty
+		if (!cpuTLASStale && cpuInstanceOf[index] != UINT32_MAX) // Mirror it on the CPU
+		{
+			cpuTLAS.setMask(cpuInstanceOf[index], _instanceMask);
+		}
+	}
+	void RTX_BVHmanager::setInstanceFlags(InstanceHandle _instance, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
+	{
+		UINT index = TLASmanager.getInstanceIndex(_instance);
+		if (index == UINT32_MAX) // Error check
+		{
+			RTX_Exception::handleError("Trying to set the flags of an instance that does not exist.", false);
+			return;
+		}
+		TLASmanager.setInstanceFlags(_instance, _flags); // Also flags it dirty
+		if (!cpuTLASStale && cpuInstanceOf[index] != UINT32_MAX) // Mirror it on the CPU
+		{
+			cpuTLAS.setFlags(cpuInstanceOf[index], static_cast<uint32_t>(_flags));
 		}
 	}
 }
\ No newline at end of file
@@ -3,7 +3,17 @@
 
 #include "RTX_TLAS.h" // TLAS generator
 #include "RTX_BLAS.h" // BLAS generator
+#include "RTX_CPUBVH.h" // CPU BLAS
+#include "RTX_BVH8.h" // 8 wide CPU BLAS
+#include "RTX_BVH8Compressed.h" // Quantized 8 wide CPU BLAS
+#include "RTX_ThreadPool.h" // CPU builds
+#include "RTX_ScratchPool.h" // Shared BLAS scratch memory
+#include "RTX_BVHCache.h" // CPU BLAS kept on disk
+#include "RTX_PacketTraversal.h" // Coherent ray packets
+#include "RTX_CPUTLAS.h" // CPU two level traversal
+#include "RTX_TaskGraph.h" // Scene build scheduling
 #include <memory> // smart pointers
+#include <map> // CPU BLAS lookup
 #include <DirectXMath.h> // XMFLOAT
 #include "RTX_Exception.h"
 
@@ -11,6 +21,7 @@ namespace RTXSimplified
 {
 	/*FORWARD DECLARES*/
 	class RTX_Manager;
+	struct Model;
 
 	struct AccelerationStructureBuffers
 	{
@@ -25,6 +36,98 @@ namespace RTXSimplified
 		DirectX::XMFLOAT4 color;	///< Colour of the vertx.
 	}; ///< Stores properties for a vertex.
 
+	struct CPUAccelerationStructure
+	{
+		std::shared_ptr<RTX_CPUBVH> binary; ///< Binary tree, built with binned SAH.
+		std::shared_ptr<RTX_BVH8> wide;		///< Same tree collapsed to 8 wide nodes, used for traversal.
+		std::shared_ptr<RTX_BVH8Compressed> compressed; ///< Quantized 8 wide nodes, replaces wide when compression is on.
+
+		bool intersect(const Ray& _ray, RayHit& _hit) const
+		{
+			if (compressed) return compressed->intersect(_ray, _hit);
+			if (wide) return wide->intersect(_ray, _hit);
+			return binary ? binary->intersect(_ray, _hit) : false;
+		} ///< Traces the most compact layout available.
+	}; ///< CPU copy of a BLAS.
+
+	struct BLASBuildOptions
+	{
+		bool fastBuild = false;				///< Rebuilt often: PREFER_FAST_BUILD on the GPU, LBVH on the CPU.
+		bool spatialSplits = false;			///< SBVH on the CPU, for long thin triangles. The driver builds its own tree, fastBuild wins.
+		float spatialSplitBudget = 0.3f;	///< Extra references spatial splits may add, 0.3 = up to 30% more than triangles.
+
+		bool operator==(const BLASBuildOptions& _other) const
+		{
+			return fastBuild == _other.fastBuild && spatialSplits == _other.spatialSplits && spatialSplitBudget == _other.spatialSplitBudget;
+		}
+	}; ///< How the GPU and CPU builds of one BLAS trade build speed for trace speed.
+
+	struct BLASKey
+	{
+		uint64_t hash;			///< Hash of the vertex and index bytes, or the buffer addresses when there is no CPU copy.
+		uint32_t stride;		///< Size of one vertex.
+		uint32_t count;			///< Number of vertices.
+		uint32_t indexCount;	///< Number of indices, 0 for a triangle soup.
+
+		bool operator<(const BLASKey& _other) const
+		{
+			if (hash != _other.hash) return hash < _other.hash;
+			if (stride != _other.stride) return stride < _other.stride;
+			if (count != _other.count) return count < _other.count;
+			return indexCount < _other.indexCount;
+		}
+	}; ///< Identifies the geometry a BLAS was built from.
+
+	struct BLASCacheEntry
+	{
+		AccelerationStructureBuffers buffers;	///< The shared BLAS.
+		std::vector<Vertex> vertices;			///< Vertices it was built from, to rule out hash collisions.
+		std::vector<uint32_t> indices;			///< Indices it was built from.
+		BLASBuildOptions options;				///< Options it was built with, models asking for others get their own BLAS.
+		uint32_t refCount = 0;					///< Models using this BLAS.
+	}; ///< One shared BLAS in the cache.
+
+	struct CPUBLASCacheEntry
+	{
+		CPUAccelerationStructure structure;		///< The shared CPU BLAS.
+		std::vector<Vertex> vertices;			///< Vertices it was built from, to rule out hash collisions.
+		std::vector<uint32_t> indices;			///< Indices it was built from.
+		BLASBuildOptions options;				///< Options it was built with.
+	}; ///< One shared BLAS of the CPU only cache, it has no GPU counterpart.
+
+	struct CPUOnlyInstance
+	{
+		CPUAccelerationStructure blas;			///< CPU BLAS, kept alive by the instance.
+		InstanceTransform transform;			///< 3x4 row major, the layout of the TLAS instances.
+		UINT instanceID;						///< Instance ID the hit programs see.
+		UINT hitGroupIndex;						///< Hit group index.
+		UINT instanceMask;						///< Visibility mask.
+		D3D12_RAYTRACING_INSTANCE_FLAGS flags;	///< Culling and opacity overrides.
+	}; ///< Instance added with addCPUInstance, it only exists in the CPU TLAS.
+
+	struct BLASGeometry
+	{
+		ComPtr<ID3D12Resource> vertexBuffer;	///< Vertices of the geometry.
+		uint32_t vertexCount;					///< Number of vertices.
+		ComPtr<ID3D12Resource> indexBuffer;		///< 32 bit indices, null for a triangle soup.
+		uint32_t indexCount;					///< Number of indices.
+	}; ///< One geometry of a BLAS build.
+
+	struct PendingBLAS
+	{
+		std::shared_ptr<RTX_BLAS> generator;	///< Sized BLAS waiting for its build to be recorded.
+		ComPtr<ID3D12Resource> result;			///< Where the build goes.
+	}; ///< BLAS build deferred until the whole batch is sized.
+
+	struct PendingCPUBLAS
+	{
+		ID3D12Resource* blas;					///< GPU BLAS the copy mirrors.
+		const std::vector<Vertex>* vertices;	///< Vertices, owned by the BLAS cache entry.
+		const std::vector<uint32_t>* indices;	///< Indices, owned by the BLAS cache entry.
+		uint64_t contentHash;					///< Key of the disk cache.
+		BLASBuildOptions options;				///< Builder to use.
+	}; ///< CPU copy of a BLAS waiting to be built by the scene task graph.
+
 	static const D3D12_HEAP_PROPERTIES defaultHeapProperties = {
 		D3D12_HEAP_TYPE_DEFAULT,			///< Default heap.
 		D3D12_CPU_PAGE_PROPERTY_UNKNOWN,	///< Unknown cpu page property.
@@ -49,26 +152,85 @@ namespace RTXSimplified
 	private:
 		RTX_TLAS TLASmanager; ///< Stores an instance of the top level acceleration structure generator.
 		std::shared_ptr<RTX_Manager> rtxManager; ///< Store a reference to the RTX manager class.
-		std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> instances; ///< Stores references to top level acceleration structures.
 		AccelerationStructureBuffers TLASBuffers; ///< Storage for the top level acceleration structure buffers.
 		ComPtr<ID3D12Resource> bottomLevelAS; ///< Storage for the bottom level acceleration structure.
+		std::map<ID3D12Resource*, CPUAccelerationStructure> cpuBLAS; ///< CPU copies of each BLAS, keyed by the GPU BLAS they mirror.
+		std::shared_ptr<RTX_ThreadPool> threadPool; ///< Workers used by the CPU builds.
+		std::shared_ptr<RTX_ScratchPool> scratchPool; ///< One scratch arena shared by each batch of BLAS builds.
+		std::vector<PendingBLAS> pendingBLAS; ///< BLAS sized but not recorded yet.
+		std::vector<PendingCPUBLAS> pendingCPUBLAS; ///< CPU copies not built yet.
+		std::vector<TaskTiming> buildTimings; ///< Tasks of the last scene build.
+		double buildTimeMs = 0.0; ///< Wall time of the last scene build.
+		std::shared_ptr<RTX_BVHCache> diskCache; ///< Built CPU BLAS from previous runs, null when disabled.
+		bool compressCPUBLAS = false; ///< Store CPU BLAS with quantized nodes, for memory bound scenes.
+		std::multimap<BLASKey, BLASCacheEntry> blasCache; ///< BLAS shared between models with identical vertices, multimap so hash collisions can coexist.
+		std::multimap<BLASKey, CPUBLASCacheEntry> cpuOnlyCache; ///< CPU BLAS built without a device, shared the same way.
+		std::vector<CPUOnlyInstance> cpuOnlyInstances; ///< Instances with no GPU counterpart, they follow the TLAS ones in the CPU TLAS.
+		RTX_CPUTLAS cpuTLAS; ///< CPU mirror of the TLAS, over the instances that have a CPU BLAS.
+		std::vector<uint32_t> cpuInstanceOf; ///< CPU TLAS index of each instance, UINT32_MAX when it has no CPU BLAS.
+		std::vector<uint32_t> gpuInstanceOf; ///< Instance index of each CPU TLAS instance, what InstanceIndex() returns on the GPU.
+		bool cpuTLASStale = false; ///< Instances were added, removed or changed BLAS, the CPU TLAS is rebuilt on the next update.
 
-		AccelerationStructureBuffers createBLAS(std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t>> _vertexBuffers); ///< Creates the BLAS.
-		int createTLAS(std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>>& _instances, bool _updateOnly = false); ///< Creates the TLAS, by default its not an update operation.
+		AccelerationStructureBuffers createBLAS(const std::vector<BLASGeometry>& _geometries, const BLASBuildOptions& _options); ///< Creates the BLAS result buffer and queues its build.
+		int buildPendingBLAS(); ///< Records every queued BLAS build on the shared scratch arena.
+		AccelerationStructureBuffers acquireBLAS(const Model& _model); ///< Returns the cached BLAS for this geometry, sizing it and queuing its GPU and CPU builds on a miss.
+		int submitCommandList(); ///< Closes the command list and sends it to the GPU, signalling the next fence value.
+		CPUAccelerationStructure createCPUBLAS(const std::vector<Vertex>& _vertices, const std::vector<uint32_t>& _indices, uint64_t _contentHash, const BLASBuildOptions& _options); ///< Builds the CPU copy of a BLAS, or loads it from the disk cache. Empty indices = triangle soup.
+		int createTLAS(bool _updateOnly = false); ///< Builds the TLAS over the current instances, by default its not an update operation. Buffers grow when the instances no longer fit.
 		
 
 	public:
 		ID3D12Resource* createBuffer(ID3D12Device* _device, uint64_t _size, D3D12_RESOURCE_FLAGS _flags,
 			D3D12_RESOURCE_STATES _initState, const D3D12_HEAP_PROPERTIES& _heapProps); ///< Creates a buffer based on the device properties, data properties and control flags.
-		int createAccelerationStructure(); ///< Creates the acceleration structure.
-		int updateTLAS(); ///< Updates the TLAS.
+		int createAccelerationStructure(); ///< Creates the acceleration structure, CPU BLAS are built concurrently while the GPU builds run.
+		int createCPUAccelerationStructure(); ///< Same scene as createAccelerationStructure on the CPU only, no D3D12 call is made.
+		CPUAccelerationStructure acquireCPUBLAS(const Model& _model); ///< Returns the cached CPU BLAS for this geometry, building it on a miss. Needs the model's CPU copy, never touches the GPU.
+		int createCPUTLAS(); ///< Mirrors the instances with a CPU BLAS, with the same IDs and hit group indices as the GPU TLAS, then adds the CPU only instances.
+		int releaseBLAS(ID3D12Resource* _blas); ///< Drops one reference to a cached BLAS, freeing it with the last one.
+		int updateCPUTLAS(); ///< Brings the CPU mirror of the TLAS up to date with the instances, without touching the GPU.
+		int updateTLAS(); ///< Refits the TLAS, skipped when no instance changed since the last frame, rebuilt when instances were added or removed or refits degraded it too much.
+		int printBuildStats(); ///< Writes the BLAS sharing, scene build parallelism, CPU BLAS build stats and scratch use of the last createAccelerationStructure to the console.
+		int printTLASStats(); ///< Writes the rebuild and refit counts, timings and tree quality to the console.
+		InstanceHandle addInstance(
+			ID3D12Resource* _bottomLevelAS,		///< BLAS, from the BLAS cache.
+			const DirectX::XMMATRIX& _transform, ///< Transform matrix.
+			UINT _instanceID,					///< Instance ID visible in the shader.
+			UINT _hitGroupIndex,				///< Hit group index.
+			UINT _instanceMask = INSTANCE_MASK_ALL, ///< Visibility mask.
+			D3D12_RAYTRACING_INSTANCE_FLAGS _flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE ///< Culling and opacity overrides.
+		); ///< Adds an instance in O(1), it is in the TLAS from the next updateTLAS.
+		int removeInstance(InstanceHandle _instance); ///< Removes an instance in O(1), its handle goes stale.
+		int addCPUInstance(
+			const CPUAccelerationStructure& _blas,	///< CPU BLAS, from acquireCPUBLAS.
+			const DirectX::XMMATRIX& _transform,	///< Transform matrix.
+			UINT _instanceID,						///< Instance ID visible in the hit programs.
+			UINT _hitGroupIndex,					///< Hit group index.
+			UINT _instanceMask = INSTANCE_MASK_ALL,	///< Visibility mask.
+			D3D12_RAYTRACING_INSTANCE_FLAGS _flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE ///< Culling and opacity overrides.
+		); ///< Adds an instance to the CPU TLAS only, from the next updateCPUTLAS. Hits on it report an instance index after the TLAS ones.
+		int tracePackets(const std::vector<RayPacket>& _packets, std::vector<RayPacketHit>& _hits, UINT _instanceInclusionMask = INSTANCE_MASK_ALL); ///< Closest hits of coherent ray packets against every instance with a CPU BLAS.
+		int occludedPackets(const std::vector<RayPacket>& _packets, std::vector<uint32_t>& _occluded, UINT _instanceInclusionMask = INSTANCE_MASK_SHADOW); ///< Mask of blocked lanes of each shadow ray packet, instances without the shadow bit are skipped.
+		uint32_t occludedRays(const std::vector<Ray>& _rays, std::vector<uint8_t>& _occluded, UINT _instanceInclusionMask = INSTANCE_MASK_SHADOW); ///< 1 for each blocked shadow ray, stopping at the first hit. For incoherent rays that would not fill a packet, returns how many are blocked.
+		uint32_t traceCameraPackets(uint32_t _width, uint32_t _height, std::vector<RayPacketHit>& _hits); ///< Primary rays of the current camera, one packet per 4x2 pixel block. Returns the blocks per row.
+		bool traceRay(const Ray& _ray, TLASHit& _hit, uint32_t _rayContribution = 0, uint32_t _geometryMultiplier = 1, UINT _instanceInclusionMask = INSTANCE_MASK_ALL); ///< Closest hit of one ray, with the hit group the shader binding table would run.
 
 		/*GETTERS*/
 		AccelerationStructureBuffers getTLASBuffers();
-		std::vector<std::pair<ComPtr<ID3D12Resource>, DirectX::XMMATRIX>> getInstances();
+		const std::vector<Instance>& getInstances(); ///< Packed instances, in InstanceIndex() order.
+		InstanceHandle getInstanceHandle(UINT _instanceIndex); ///< Handle of the instance a hit reported.
+		CPUAccelerationStructure getCPUBLAS(ID3D12Resource* _blas); ///< CPU copy of the GPU BLAS an instance points to.
+		size_t getBLASCacheSize(); ///< Number of unique BLAS currently alive.
+		std::shared_ptr<RTX_ScratchPool> getScratchPool();
+		std::shared_ptr<RTX_ThreadPool> getThreadPool(); ///< Workers of the CPU builds and traces, started on first use.
+		std::vector<TaskTiming> getBuildTimings(); ///< Per task timings of the last createAccelerationStructure.
+		const RTX_CPUTLAS& getCPUTLAS(); ///< CPU mirror of the TLAS, instance indices are its own, see traceRay for TLAS ones.
 		/*SETTERS*/
 		void setRTXManager(std::shared_ptr<RTX_Manager> _rtxManager);
-		void setInstance(int _instanceNo, int _paramNumber, DirectX::XMMATRIX _valueSecond, ComPtr<ID3D12Resource> _valueFirst);
+		void setCompressCPUBLAS(bool _value); ///< Applies to CPU BLAS built after the call.
+		void setBVHCacheDirectory(const std::string& _directory); ///< Enables the on disk CPU BLAS cache, an empty string disables it.
+		void setInstance(InstanceHandle _instance, int _paramNumber, DirectX::XMMATRIX _valueSecond, ComPtr<ID3D12Resource> _valueFirst); ///< Changes an instance and flags it for the next TLAS update.
+		void setInstanceMask(InstanceHandle _instance, UINT _instanceMask); ///< Changes which rays see an instance, on the GPU and CPU, from the next TLAS update.
+		void setInstanceFlags(InstanceHandle _instance, D3D12_RAYTRACING_INSTANCE_FLAGS _flags); ///< Changes the culling and opacity overrides of an instance.
 		
 
 	};
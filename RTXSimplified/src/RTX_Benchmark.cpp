@@ -0,0 +1,405 @@
+#include "RTX_Benchmark.h"
+#include <chrono> // timing
+#include <random> // ray generation
+#include <iostream> // output
+#include <algorithm> // std::max
+#include <cstring> // memcmp
+
+namespace RTXSimplified
+{
+	/**
+	*	Traces every ray through a structure with an intersect(const Ray&, RayHit&) method and times it.
+	*/
+	template <typename Structure>
+	static BenchmarkResult traceAll(const std::string& _name, const Structure& _structure, const std::vector<Ray>& _rays, size_t _memoryBytes, uint32_t _triangleCount)
+	{
+		BenchmarkResult result;
+		result.name = _name;
+		result.memoryBytes = _memoryBytes;
+		result.bytesPerTriangle = _triangleCount > 0 ? static_cast<double>(_memoryBytes) / _triangleCount : 0.0;
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (const Ray& ray : _rays)
+		{
+			RayHit hit;
+			if (_structure.intersect(ray, hit))
+			{
+				result.hits++;
+			}
+		}
+		result.timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		result.raysPerSecond = result.timeMs > 0.0 ? _rays.size() / (result.timeMs / 1000.0) : 0.0;
+
+		return result;
+	}
+
+	std::vector<Ray> RTX_Benchmark::generateRays(const AABB& _bounds, uint32_t _count, uint32_t _seed)
+	{
+		std::mt19937 generator(_seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		Float3 extent = _bounds.max - _bounds.min;
+		Float3 centre = (_bounds.min + _bounds.max) * 0.5f;
+		float radius = sqrtf(dot(extent, extent)); // Start outside the bounds
+
+		std::vector<Ray> rays(_count);
+		for (Ray& ray : rays)
+		{
+			// Random point on a sphere around the bounds, aimed at a random point inside them
+			float z = 2.0f * unit(generator) - 1.0f;
+			float phi = 6.2831853f * unit(generator);
+			float r = sqrtf(1.0f - z * z);
+			ray.origin = centre + Float3{ r * cosf(phi), r * sinf(phi), z } * radius;
+			Float3 target = { _bounds.min.x + extent.x * unit(generator), _bounds.min.y + extent.y * unit(generator), _bounds.min.z + extent.z * unit(generator) };
+			ray.direction = target - ray.origin;
+			ray.tMin = 0.0f;
+			ray.tMax = FLT_MAX;
+		}
+		return rays;
+	}
+
+	std::vector<BenchmarkResult> RTX_Benchmark::compareTraversal(const RTX_CPUBVH& _binary, const RTX_BVH8& _wide, uint32_t _rayCount, const RTX_BVH8Compressed* _compressed)
+	{
+		std::vector<Ray> rays = generateRays(_binary.getBounds(), _rayCount);
+		uint32_t triangleCount = _binary.getStats().triangleCount;
+
+		std::vector<BenchmarkResult> results;
+		results.push_back(traceAll("Binary BVH", _binary, rays, _binary.getMemorySize(), triangleCount));
+		results.push_back(traceAll("BVH8", _wide, rays, _wide.getMemorySize(), triangleCount));
+		if (_compressed)
+		{
+			results.push_back(traceAll("Compressed BVH8", *_compressed, rays, _compressed->getMemorySize(), triangleCount));
+		}
+
+		for (size_t i = 1; i < results.size(); i++) // Every layout holds the same triangles
+		{
+			if (results[i].hits != results[0].hits)
+			{
+				RTX_Exception::handleError((results[i].name + " and Binary BVH traversal disagree on hit count."), false);
+			}
+		}
+
+		return results;
+	}
+
+	std::vector<BenchmarkResult> RTX_Benchmark::compareSpatialSplits(const void* _vertexData, uint32_t _vertexCount, uint32_t _stride, uint32_t _rayCount, float _budget)
+	{
+		RTX_CPUBVH sah, sbvh;
+		sah.addVertexBuffer(_vertexData, 0, _vertexCount, _stride, true);
+		sbvh.addVertexBuffer(_vertexData, 0, _vertexCount, _stride, true);
+		sbvh.setSpatialSplitBudget(_budget);
+		sah.build(nullptr, BVH_BUILD_SAH);
+		sbvh.build(nullptr, BVH_BUILD_SBVH);
+
+		std::vector<Ray> rays = generateRays(sah.getBounds(), _rayCount);
+		uint32_t triangleCount = sah.getStats().triangleCount;
+
+		std::vector<BenchmarkResult> results;
+		results.push_back(traceAll("SAH", sah, rays, sah.getMemorySize(), triangleCount));
+		results.back().buildTimeMs = sah.getStats().buildTimeMs;
+		results.push_back(traceAll("SBVH", sbvh, rays, sbvh.getMemorySize(), triangleCount));
+		results.back().buildTimeMs = sbvh.getStats().buildTimeMs;
+
+		if (results[0].hits != results[1].hits) // Same triangles, splitting only changes the tree
+		{
+			RTX_Exception::handleError("SAH and SBVH traversal disagree on hit count.", false);
+		}
+		std::cout << "SAH cost " << sah.getStats().sahCost << " -> " << sbvh.getStats().sahCost << ", references "
+			<< sah.getStats().referenceCount << " -> " << sbvh.getStats().referenceCount << std::endl;
+
+		return results;
+	}
+
+	std::vector<BenchmarkResult> RTX_Benchmark::comparePackets(const RTX_CPUBVH& _binary, const float _viewInverse[16], const float _projectionInverse[16], uint32_t _width, uint32_t _height, const Float3& _lightPosition)
+	{
+		std::vector<RayPacket> cameraPackets;
+		RTX_PacketTraversal::generateCameraPackets(_viewInverse, _projectionInverse, _width, _height, cameraPackets);
+		uint32_t rayCount = _width * _height;
+
+		std::vector<BenchmarkResult> results(4);
+		results[0].name = "Camera rays, single";
+		results[1].name = "Camera rays, packets";
+		results[2].name = "Shadow rays, single";
+		results[3].name = "Shadow rays, packets";
+
+		// Camera rays one at a time
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (const RayPacket& packet : cameraPackets)
+		{
+			for (uint32_t lane = 0; lane < packetWidth; lane++)
+			{
+				RayHit hit;
+				if ((packet.activeMask & (1u << lane)) && _binary.intersect(RTX_PacketTraversal::getRay(packet, lane), hit))
+				{
+					results[0].hits++;
+				}
+			}
+		}
+		results[0].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// The same rays as packets
+		std::vector<RayPacketHit> cameraHits(cameraPackets.size());
+		start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < cameraPackets.size(); i++)
+		{
+			cameraHits[i].reset();
+			RTX_PacketTraversal::intersect(_binary, cameraPackets[i], cameraHits[i]);
+		}
+		results[1].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		// Shadow rays from every camera hit towards the light, packed like the pixels they came from
+		std::vector<RayPacket> shadowPackets(cameraPackets.size());
+		uint32_t shadowCount = 0;
+		for (size_t i = 0; i < cameraPackets.size(); i++)
+		{
+			Ray rays[packetWidth];
+			uint32_t mask = 0;
+			for (uint32_t lane = 0; lane < packetWidth; lane++)
+			{
+				Ray camera = RTX_PacketTraversal::getRay(cameraPackets[i], lane);
+				bool hit = (cameraPackets[i].activeMask & (1u << lane)) && cameraHits[i].primitiveIndex[lane] != UINT32_MAX;
+				results[1].hits += hit ? 1 : 0;
+				Float3 position = camera.origin + camera.direction * (hit ? cameraHits[i].t[lane] : 0.0f);
+				rays[lane] = { position, 1e-3f, _lightPosition - position, 1.0f }; // tMax 1 ends the ray at the light
+				mask |= (hit ? 1u : 0u) << lane;
+				shadowCount += hit ? 1 : 0;
+			}
+			shadowPackets[i] = RTX_PacketTraversal::makePacket(rays, packetWidth);
+			shadowPackets[i].activeMask = mask;
+		}
+
+		start = std::chrono::high_resolution_clock::now();
+		for (const RayPacket& packet : shadowPackets)
+		{
+			for (uint32_t lane = 0; lane < packetWidth; lane++)
+			{
+				RayHit hit;
+				if ((packet.activeMask & (1u << lane)) && _binary.intersect(RTX_PacketTraversal::getRay(packet, lane), hit))
+				{
+					results[2].hits++;
+				}
+			}
+		}
+		results[2].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		for (const RayPacket& packet : shadowPackets)
+		{
+			uint32_t blocked = RTX_PacketTraversal::occluded(_binary, packet);
+			for (uint32_t lane = 0; lane < packetWidth; lane++)
+			{
+				results[3].hits += (blocked >> lane) & 1;
+			}
+		}
+		results[3].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			uint32_t count = i < 2 ? rayCount : shadowCount;
+			results[i].raysPerSecond = results[i].timeMs > 0.0 ? count / (results[i].timeMs / 1000.0) : 0.0;
+			results[i].memoryBytes = _binary.getMemorySize();
+			results[i].bytesPerTriangle = _binary.getStats().triangleCount > 0 ? static_cast<double>(results[i].memoryBytes) / _binary.getStats().triangleCount : 0.0;
+		}
+		if (results[0].hits != results[1].hits || results[2].hits != results[3].hits) // Packets have to find the same hits
+		{
+			RTX_Exception::handleError("Single ray and packet traversal disagree on hit count.", false);
+		}
+
+		return results;
+	}
+
+	std::vector<BenchmarkResult> RTX_Benchmark::compareInstanceUpload(uint32_t _instanceCount, uint32_t _runs)
+	{
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+
+		// The same instances as 4x4 matrices and in the TLAS store, without BLAS so no device is needed
+		RTX_TLAS tlas;
+		std::vector<DirectX::XMFLOAT4X4> matrices(_instanceCount);
+		for (uint32_t i = 0; i < _instanceCount; i++)
+		{
+			DirectX::XMMATRIX matrix = DirectX::XMMatrixRotationY(position(generator)) * DirectX::XMMatrixTranslation(position(generator), position(generator), position(generator));
+			DirectX::XMStoreFloat4x4(&matrices[i], matrix);
+			tlas.addInstance(nullptr, matrix, i, i % 4, INSTANCE_MASK_ALL, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+		}
+
+		std::vector<D3D12_RAYTRACING_INSTANCE_DESC> transposed(_instanceCount), streamed(_instanceCount), packed(_instanceCount);
+		std::vector<DescriptorRun> runs;
+		std::vector<BenchmarkResult> results(3);
+		results[0].name = "Descriptor upload, 4x4 transpose";
+		results[1].name = "Descriptor upload, SoA stream copy";
+		results[2].name = "Descriptor upload, 1% dirty";
+
+		// Every descriptor built field by field from its matrix, the way generate used to
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (uint32_t run = 0; run < _runs; run++)
+		{
+			const std::vector<Instance>& instances = tlas.getInstances();
+			for (uint32_t i = 0; i < _instanceCount; i++)
+			{
+				transposed[i].InstanceID = instances[i].instanceID;
+				transposed[i].InstanceContributionToHitGroupIndex = instances[i].hitGroupIndex;
+				transposed[i].Flags = instances[i].flags;
+				DirectX::XMMATRIX matrix = DirectX::XMMatrixTranspose(DirectX::XMLoadFloat4x4(&matrices[i]));
+				memcpy(transposed[i].Transform, &matrix, sizeof(transposed[i].Transform));
+				transposed[i].AccelerationStructure = 0;
+				transposed[i].InstanceMask = instances[i].instanceMask & 0xFF;
+			}
+		}
+		results[0].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / _runs;
+
+		// The descriptors copied out of the store
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t run = 0; run < _runs; run++)
+		{
+			tlas.collectDirtyRuns(runs, true);
+			tlas.writeDescriptors(streamed.data(), runs);
+		}
+		results[1].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / _runs;
+		results[1].instances = _instanceCount;
+
+		// A frame where few instances moved, only their runs are written, packed like in the upload ring
+		uint32_t moved = (std::max)(_instanceCount / 100, 1u);
+		double dirtyMs = 0.0;
+		bool packedMatches = true;
+		for (uint32_t run = 0; run < _runs; run++)
+		{
+			for (uint32_t i = 0; i < moved; i++)
+			{
+				tlas.markDirty((i * 97 + run) % _instanceCount);
+			}
+			start = std::chrono::high_resolution_clock::now();
+			tlas.collectDirtyRuns(runs, false);
+			tlas.writeDescriptors(packed.data(), runs);
+			dirtyMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			uint32_t written = 0;
+			for (size_t r = 0; r < runs.size(); r++) // Each packed descriptor has to match its place in the full upload
+			{
+				packedMatches = packedMatches && memcmp(&packed[written], &streamed[runs[r].first], runs[r].count * sizeof(D3D12_RAYTRACING_INSTANCE_DESC)) == 0;
+				written += runs[r].count;
+			}
+		}
+		results[2].timeMs = dirtyMs / _runs;
+		results[2].instances = moved;
+
+		results[0].instances = _instanceCount;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			results[i].memoryBytes = results[i].instances * sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+		}
+		if (memcmp(transposed.data(), streamed.data(), _instanceCount * sizeof(D3D12_RAYTRACING_INSTANCE_DESC)) != 0
+			|| !packedMatches) // Every path has to write the same bytes
+		{
+			RTX_Exception::handleError("Instance descriptor upload paths disagree.", false);
+		}
+
+		return results;
+	}
+
+	std::vector<BenchmarkResult> RTX_Benchmark::compareTLASUpdate(const RTX_CPUBVH& _binary, uint32_t _instanceCount, uint32_t _runs)
+	{
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> jitter(-0.1f, 0.1f);
+
+		RTX_CPUTLAS tlas;
+		std::vector<float> transforms(_instanceCount * 12);
+		for (uint32_t i = 0; i < _instanceCount; i++)
+		{
+			float* transform = &transforms[i * 12];
+			const float identity[12] = { 1.0f, 0.0f, 0.0f, position(generator), 0.0f, 1.0f, 0.0f, position(generator), 0.0f, 0.0f, 1.0f, position(generator) };
+			memcpy(transform, identity, sizeof(identity));
+			tlas.addInstance(&_binary, nullptr, nullptr, transform, i, 0);
+		}
+		tlas.update();
+
+		std::vector<BenchmarkResult> results(3);
+		results[0].name = "CPU TLAS update, 1 instance moved";
+		results[1].name = "CPU TLAS update, 1% jittered";
+		results[2].name = "CPU TLAS update, every instance scattered";
+
+		// One instance nudged per update, the refit only walks its path to the root
+		double elapsedMs = 0.0;
+		for (uint32_t run = 0; run < _runs; run++)
+		{
+			float* transform = &transforms[((run * 7919) % _instanceCount) * 12];
+			transform[3] += jitter(generator);
+			tlas.setTransform((run * 7919) % _instanceCount, transform);
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			tlas.update();
+			elapsedMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		results[0].timeMs = elapsedMs / _runs;
+		results[0].instances = 1;
+
+		// A few instances jitter in place every update
+		uint32_t moved = (std::max)(_instanceCount / 100, 1u);
+		elapsedMs = 0.0;
+		for (uint32_t run = 0; run < _runs; run++)
+		{
+			for (uint32_t i = 0; i < moved; i++)
+			{
+				uint32_t instance = (i * 97 + run) % _instanceCount;
+				float* transform = &transforms[instance * 12];
+				transform[3] += jitter(generator);
+				transform[7] += jitter(generator);
+				transform[11] += jitter(generator);
+				tlas.setTransform(instance, transform);
+			}
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			tlas.update();
+			elapsedMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		results[1].timeMs = elapsedMs / _runs;
+		results[1].instances = moved;
+		uint32_t forcedRebuilds = tlas.getUpdateStats().forcedRebuildCount;
+		if (forcedRebuilds != 0) // Small motions barely change the cost
+		{
+			RTX_Exception::handleError("CPU TLAS was rebuilt for small motions.", false);
+		}
+
+		// Every instance moved across the scene, the refitted tree overlaps everywhere and has to be rebuilt
+		for (uint32_t i = 0; i < _instanceCount; i++)
+		{
+			float* transform = &transforms[i * 12];
+			transform[3] = position(generator);
+			transform[7] = position(generator);
+			transform[11] = position(generator);
+			tlas.setTransform(i, transform);
+		}
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		tlas.update();
+		results[2].timeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		results[2].instances = _instanceCount;
+		if (tlas.getUpdateStats().forcedRebuildCount != forcedRebuilds + 1) // The degradation check has to catch it
+		{
+			RTX_Exception::handleError("CPU TLAS was refitted after every instance was scattered instead of rebuilt.", false);
+		}
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			results[i].memoryBytes = results[i].instances * sizeof(CPUInstance);
+		}
+		return results;
+	}
+
+	void RTX_Benchmark::print(const std::vector<BenchmarkResult>& _results)
+	{
+		for (const BenchmarkResult& result : _results)
+		{
+			if (result.instances > 0) // Upload benchmark
+			{
+				std::cout << result.name << ": " << result.instances << " instances in " << result.timeMs << " ms, "
+					<< (result.timeMs > 0.0 ? result.memoryBytes / (result.timeMs * 1000.0) : 0.0) << " MB/s" << std::endl;
+				continue;
+			}
+			std::cout << result.name << ": " << result.raysPerSecond / 1000000.0 << " Mrays/s, "
+				<< result.timeMs << " ms, " << result.hits << " hits, " << result.memoryBytes / 1024 << " KB, " << result.bytesPerTriangle << " bytes/triangle";
+			if (result.buildTimeMs > 0.0)
+			{
+				std::cout << ", built in " << result.buildTimeMs << " ms";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef RTX_BENCHMARK_H
+#define RTX_BENCHMARK_H
+
+#include <vector> // std::vector
+#include <string> // std::string
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Ray, AABB
+#include "RTX_CPUBVH.h" // Binary layout
+#include "RTX_BVH8.h" // 8 wide layout
+#include "RTX_BVH8Compressed.h" // Quantized 8 wide layout
+#include "RTX_PacketTraversal.h" // Ray packets
+#include "RTX_TLAS.h" // Instance descriptor upload
+#include "RTX_CPUTLAS.h" // CPU TLAS refits
+
+namespace RTXSimplified
+{
+	struct BenchmarkResult
+	{
+		std::string name;			///< What was measured.
+		double timeMs = 0.0;		///< Wall clock time of the run.
+		double raysPerSecond = 0.0;	///< Throughput.
+		uint32_t hits = 0;			///< Rays that hit something, used to check layouts agree.
+		size_t memoryBytes = 0;		///< Memory used by the structure.
+		double bytesPerTriangle = 0.0;	///< Memory used per triangle.
+		double buildTimeMs = 0.0;	///< Time spent building the structure, 0 when not measured.
+		uint32_t instances = 0;		///< Instance descriptors written per run, upload benchmarks only.
+	}; ///< One benchmark measurement.
+
+	/**
+	*	\brief The class responsible for measuring the CPU ray tracing code.
+	*
+	*	Results are printed the same way as the rest of the library and returned so callers can log them.
+	*/
+	class RTX_Benchmark
+	{
+	public:
+		static std::vector<Ray> generateRays(const AABB& _bounds, uint32_t _count, uint32_t _seed = 1); ///< Random rays aimed through the bounds.
+		static std::vector<BenchmarkResult> compareTraversal(
+			const RTX_CPUBVH& _binary,	///< Built binary tree.
+			const RTX_BVH8& _wide,		///< The same tree collapsed to 8 wide.
+			uint32_t _rayCount,			///< Number of random rays to trace.
+			const RTX_BVH8Compressed* _compressed = nullptr ///< Optional quantized copy of the same tree.
+		); ///< Rays per second and memory of the binary layout against the 8 wide layouts.
+		static std::vector<BenchmarkResult> compareSpatialSplits(
+			const void* _vertexData,	///< Triangle soup, positions first.
+			uint32_t _vertexCount,		///< Number of vertices.
+			uint32_t _stride,			///< Size of a vertex.
+			uint32_t _rayCount,			///< Number of random rays to trace.
+			float _budget = 0.3f		///< Duplication budget of the SBVH build.
+		); ///< Build time and rays per second of a SAH build against an SBVH build of the same geometry.
+		static std::vector<BenchmarkResult> comparePackets(
+			const RTX_CPUBVH& _binary,			///< Built binary tree.
+			const float _viewInverse[16],		///< Inverse view matrix of the camera.
+			const float _projectionInverse[16],	///< Inverse projection matrix of the camera.
+			uint32_t _width,					///< Image width in pixels.
+			uint32_t _height,					///< Image height in pixels.
+			const Float3& _lightPosition		///< Point light the shadow rays are aimed at.
+		); ///< Rays per second of single rays against packets, for camera rays and for shadow rays from their hits.
+		static std::vector<BenchmarkResult> compareInstanceUpload(
+			uint32_t _instanceCount = 100000,	///< Number of instances in the TLAS.
+			uint32_t _runs = 10					///< Uploads timed, the result is their average.
+		); ///< Time to fill the instance descriptors from 4x4 matrices, transposed per upload, against the SoA store of RTX_TLAS.
+		static std::vector<BenchmarkResult> compareTLASUpdate(
+			const RTX_CPUBVH& _binary,			///< Built binary tree every instance points to.
+			uint32_t _instanceCount = 10000,	///< Number of instances in the CPU TLAS.
+			uint32_t _runs = 100				///< Updates timed, the result is their average.
+		); ///< Update time of the CPU TLAS when one instance moves, when 1% jitter, and when every instance is scattered, which has to force a rebuild.
+		static void print(const std::vector<BenchmarkResult>& _results); ///< Prints the results to the console.
+	};
+}
+#endif // !RTX_BENCHMARK_H
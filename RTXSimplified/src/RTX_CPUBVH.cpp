@@ -0,0 +1,1265 @@
+#include "RTX_CPUBVH.h"
+#include <algorithm> // std::partition, std::upper_bound
+#include <chrono> // build timing
+#include <cstring> // memcpy
+#include <memory> // std::unique_ptr
+#include <mutex> // merging per thread bins
+#include "RTX_Serialize.h" // Disk cache
+#if defined(_MSC_VER)
+#include <intrin.h> // _BitScanReverse64
+#endif
+
+namespace RTXSimplified
+{
+	static const float traversalCost = 1.0f; ///< SAH cost of visiting an inner node.
+	static const float intersectionCost = 1.0f; ///< SAH cost of testing one triangle.
+
+	struct SAHBin
+	{
+		AABB bounds;		///< Bounds of the triangles in the bin.
+		uint32_t count = 0;	///< Number of triangles in the bin.
+	}; ///< One SAH bin.
+
+	int RTX_CPUBVH::addVertexBuffer(const void* _vertexData, uint64_t _vertexOffsetInBytes, uint32_t _vertexCount, uint32_t _vertexSizeInBytes, bool _isOpaque)
+	{
+		/*ERROR CHECKS*/
+		if (_vertexData == nullptr)
+		{
+			RTX_Exception::handleError("Trying to add a CPU vertex buffer with no data.", true);
+		}
+		if (_vertexSizeInBytes < sizeof(Float3)) // Vertices start with R32G32B32_FLOAT, same as the GPU path
+		{
+			RTX_Exception::handleError("Vertex stride is smaller than a position.", true);
+		}
+
+		const uint8_t* base = static_cast<const uint8_t*>(_vertexData) + _vertexOffsetInBytes; // Start of the first vertex
+		geometryOffsets.push_back(static_cast<uint32_t>(triangles.size())); // Remember where this geometry starts
+		geometryOpaque.push_back(_isOpaque ? 1 : 0);
+
+		uint32_t triangleCount = _vertexCount / 3; // Triangle soup, 3 vertices per triangle
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			BVHTriangle triangle;
+			memcpy(&triangle.v0, base + (3 * i + 0) * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			memcpy(&triangle.v1, base + (3 * i + 1) * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			memcpy(&triangle.v2, base + (3 * i + 2) * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			triangles.push_back(triangle);
+		}
+
+		return 0;
+	}
+
+	int RTX_CPUBVH::addIndexedVertexBuffer(const void* _vertexData, uint64_t _vertexOffsetInBytes, uint32_t _vertexCount, uint32_t _vertexSizeInBytes, const uint32_t* _indexData, uint32_t _indexCount, bool _isOpaque)
+	{
+		/*ERROR CHECKS*/
+		if (_vertexData == nullptr || _indexData == nullptr)
+		{
+			RTX_Exception::handleError("Trying to add an indexed CPU vertex buffer with no data.", true);
+		}
+		if (_vertexSizeInBytes < sizeof(Float3)) // Vertices start with R32G32B32_FLOAT, same as the GPU path
+		{
+			RTX_Exception::handleError("Vertex stride is smaller than a position.", true);
+		}
+
+		const uint8_t* base = static_cast<const uint8_t*>(_vertexData) + _vertexOffsetInBytes; // Start of the first vertex
+		geometryOffsets.push_back(static_cast<uint32_t>(triangles.size())); // Remember where this geometry starts
+		geometryOpaque.push_back(_isOpaque ? 1 : 0);
+
+		uint32_t triangleCount = _indexCount / 3;
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			uint32_t i0 = _indexData[3 * i + 0], i1 = _indexData[3 * i + 1], i2 = _indexData[3 * i + 2];
+			if (i0 >= _vertexCount || i1 >= _vertexCount || i2 >= _vertexCount) // Error check
+			{
+				RTX_Exception::handleError("Index outside of the vertex buffer.", true);
+			}
+			BVHTriangle triangle;
+			memcpy(&triangle.v0, base + i0 * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			memcpy(&triangle.v1, base + i1 * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			memcpy(&triangle.v2, base + i2 * static_cast<uint64_t>(_vertexSizeInBytes), sizeof(Float3));
+			triangles.push_back(triangle);
+		}
+
+		return 0;
+	}
+
+	int RTX_CPUBVH::build(RTX_ThreadPool* _pool, BVHBuildMode _mode)
+	{
+		if (triangles.empty()) // Error check
+		{
+			RTX_Exception::handleError("Trying to build a CPU BLAS with no geometry.", true);
+		}
+
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now(); // Start timing
+
+		std::unique_ptr<RTX_ThreadPool> localPool; // Only used when the caller has no pool
+		if (_pool == nullptr)
+		{
+			localPool.reset(new RTX_ThreadPool());
+			_pool = localPool.get();
+		}
+
+		if (_mode == BVH_BUILD_LBVH)
+		{
+			buildLBVH(_pool);
+		}
+		else if (_mode == BVH_BUILD_SBVH)
+		{
+			buildSBVH();
+		}
+		else
+		{
+			buildSAH(_pool);
+		}
+
+		computeStats();
+		stats.buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		return 0;
+	}
+
+	void RTX_CPUBVH::buildSAH(RTX_ThreadPool* _pool)
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+		references.resize(triangleCount);
+
+		// Precompute the bounds of every triangle
+		_pool->parallelFor(triangleCount, 1024, [this](uint32_t _begin, uint32_t _end)
+			{
+				for (uint32_t i = _begin; i < _end; i++)
+				{
+					AABB box;
+					box.grow(triangles[i].v0);
+					box.grow(triangles[i].v1);
+					box.grow(triangles[i].v2);
+					references[i].aabbMin = box.min;
+					references[i].aabbMax = box.max;
+					references[i].triangle = i;
+				}
+			});
+
+		nodes.resize(2 * static_cast<size_t>(triangleCount)); // A binary tree never has more than 2N - 1 nodes
+		nodes[0].leftFirst = 0;				// Root starts with every triangle
+		nodes[0].triCount = triangleCount;	//
+
+		std::atomic<uint32_t> nodesUsed(1); // Root is already taken
+		std::atomic<uint32_t> counter(0);
+		buildNode(0, 0, _pool, &counter, &nodesUsed); // Split recursively, big subtrees go to other threads
+		_pool->wait(&counter); // Wait for every subtree
+
+		nodes.resize(nodesUsed.load());
+		nodes.shrink_to_fit();
+		triIndices.resize(references.size()); // Leaves index the final reference order
+		for (size_t i = 0; i < references.size(); i++)
+		{
+			triIndices[i] = references[i].triangle;
+		}
+		std::vector<BVHReference>().swap(references); // The build data is not needed anymore
+	}
+
+	AABB RTX_CPUBVH::computeBounds(uint32_t _first, uint32_t _count, AABB* _centroidBounds, RTX_ThreadPool* _pool)
+	{
+		AABB bounds;
+		AABB centroidBounds;
+		std::mutex mergeMutex;
+
+		auto reduce = [&](uint32_t _begin, uint32_t _end, AABB& _bounds, AABB& _centroids)
+		{
+			for (uint32_t i = _first + _begin; i < _first + _end; i++)
+			{
+				_bounds.grow(references[i].aabbMin);
+				_bounds.grow(references[i].aabbMax);
+				_centroids.grow((references[i].aabbMin + references[i].aabbMax) * 0.5f);
+			}
+		};
+
+		if (_count <= parallelThreshold) // Small range, reduce inline
+		{
+			reduce(0, _count, bounds, centroidBounds);
+		}
+		else // Big range, reduce in parallel
+		{
+			_pool->parallelFor(_count, parallelThreshold, [&](uint32_t _begin, uint32_t _end)
+				{
+					AABB localBounds;
+					AABB localCentroids;
+					reduce(_begin, _end, localBounds, localCentroids);
+					std::lock_guard<std::mutex> lock(mergeMutex);
+					bounds.grow(localBounds);
+					centroidBounds.grow(localCentroids);
+				});
+		}
+
+		*_centroidBounds = centroidBounds;
+		return bounds;
+	}
+
+	float RTX_CPUBVH::findBestSplit(const BVHNode& _node, const AABB& _centroidBounds, int& _axis, uint32_t& _splitBin, RTX_ThreadPool* _pool)
+	{
+		SAHBin bins[3][binCount];
+		std::mutex mergeMutex;
+		Float3 extent = _centroidBounds.max - _centroidBounds.min;
+		Float3 scale = {
+			extent.x > 0.0f ? binCount / extent.x : 0.0f,
+			extent.y > 0.0f ? binCount / extent.y : 0.0f,
+			extent.z > 0.0f ? binCount / extent.z : 0.0f };
+
+		// Fill the bins of all three axes in one pass over the triangles
+		auto fillBins = [&](uint32_t _begin, uint32_t _end, SAHBin (&_bins)[3][binCount])
+		{
+			for (uint32_t i = _node.leftFirst + _begin; i < _node.leftFirst + _end; i++)
+			{
+				const BVHReference& reference = references[i];
+				Float3 centroid = (reference.aabbMin + reference.aabbMax) * 0.5f;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					uint32_t bin = static_cast<uint32_t>((centroid[axis] - _centroidBounds.min[axis]) * scale[axis]);
+					bin = (std::min)(bin, binCount - 1);
+					_bins[axis][bin].count++;
+					_bins[axis][bin].bounds.grow(reference.aabbMin);
+					_bins[axis][bin].bounds.grow(reference.aabbMax);
+				}
+			}
+		};
+
+		if (_node.triCount <= parallelThreshold) // Small node, bin directly
+		{
+			fillBins(0, _node.triCount, bins);
+		}
+		else // Big node, every thread bins a chunk and merges it in
+		{
+			_pool->parallelFor(_node.triCount, parallelThreshold, [&](uint32_t _begin, uint32_t _end)
+				{
+					SAHBin localBins[3][binCount];
+					fillBins(_begin, _end, localBins);
+					std::lock_guard<std::mutex> lock(mergeMutex);
+					for (int axis = 0; axis < 3; axis++)
+					{
+						for (uint32_t bin = 0; bin < binCount; bin++)
+						{
+							bins[axis][bin].count += localBins[axis][bin].count;
+							bins[axis][bin].bounds.grow(localBins[axis][bin].bounds);
+						}
+					}
+				});
+		}
+
+		AABB parentBounds;
+		parentBounds.grow(_node.aabbMin);
+		parentBounds.grow(_node.aabbMax);
+		float invParentArea = parentBounds.area() > 0.0f ? 1.0f / parentBounds.area() : 0.0f;
+
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f) // All centroids on one plane, nothing to split
+			{
+				continue;
+			}
+
+			// Sweep from the left and from the right to get the area and count on each side of every plane
+			float leftArea[binCount - 1], rightArea[binCount - 1];
+			uint32_t leftCount[binCount - 1], rightCount[binCount - 1];
+			AABB leftBox, rightBox;
+			uint32_t leftSum = 0, rightSum = 0;
+			for (uint32_t i = 0; i < binCount - 1; i++)
+			{
+				leftSum += bins[axis][i].count;
+				leftCount[i] = leftSum;
+				leftBox.grow(bins[axis][i].bounds);
+				leftArea[i] = leftBox.area();
+				rightSum += bins[axis][binCount - 1 - i].count;
+				rightCount[binCount - 2 - i] = rightSum;
+				rightBox.grow(bins[axis][binCount - 1 - i].bounds);
+				rightArea[binCount - 2 - i] = rightBox.area();
+			}
+
+			for (uint32_t i = 0; i < binCount - 1; i++)
+			{
+				if (leftCount[i] == 0 || rightCount[i] == 0) // Not a real split
+				{
+					continue;
+				}
+				float cost = traversalCost + intersectionCost * (leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i]) * invParentArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					_axis = axis;
+					_splitBin = i + 1; // Bins below this go left
+				}
+			}
+		}
+
+		return bestCost;
+	}
+
+	void RTX_CPUBVH::buildNode(uint32_t _nodeIndex, uint32_t _depth, RTX_ThreadPool* _pool, std::atomic<uint32_t>* _counter, std::atomic<uint32_t>* _nodesUsed)
+	{
+		BVHNode& node = nodes[_nodeIndex]; // Safe to hold, the node array never reallocates during the build
+
+		AABB centroidBounds;
+		AABB bounds = computeBounds(node.leftFirst, node.triCount, &centroidBounds, _pool);
+		node.aabbMin = bounds.min;
+		node.aabbMax = bounds.max;
+
+		if (node.triCount <= 1) // Single triangle, always a leaf
+		{
+			return;
+		}
+
+		uint32_t first = node.leftFirst;
+		uint32_t count = node.triCount;
+		uint32_t leftCount = count / 2; // Median split unless SAH finds something better
+
+		if (_depth < maxBuildDepth)
+		{
+			int axis = 0;
+			uint32_t splitBin = 0;
+			float splitCost = findBestSplit(node, centroidBounds, axis, splitBin, _pool);
+			float leafCost = intersectionCost * count;
+
+			if (count <= maxLeafSize && (splitCost == FLT_MAX || splitCost >= leafCost)) // Cheaper as a leaf
+			{
+				return;
+			}
+			if (splitCost != FLT_MAX) // Partition the triangles around the plane
+			{
+				float scale = binCount / (centroidBounds.max[axis] - centroidBounds.min[axis]);
+				float minimum = centroidBounds.min[axis];
+				auto middle = std::partition(references.begin() + first, references.begin() + first + count,
+					[&](const BVHReference& _reference)
+					{
+						float centroid = (_reference.aabbMin[axis] + _reference.aabbMax[axis]) * 0.5f;
+						uint32_t bin = static_cast<uint32_t>((centroid - minimum) * scale);
+						return (std::min)(bin, binCount - 1) < splitBin;
+					});
+				leftCount = static_cast<uint32_t>(middle - (references.begin() + first));
+			}
+		}
+		else if (count <= maxLeafSize) // Depth limit reached and small enough
+		{
+			return;
+		}
+
+		if (leftCount == 0 || leftCount == count) // Degenerate partition, fall back to the median
+		{
+			leftCount = count / 2;
+		}
+
+		// Allocate both children next to each other
+		uint32_t leftIndex = _nodesUsed->fetch_add(2);
+		nodes[leftIndex].leftFirst = first;
+		nodes[leftIndex].triCount = leftCount;
+		nodes[leftIndex + 1].leftFirst = first + leftCount;
+		nodes[leftIndex + 1].triCount = count - leftCount;
+		node.leftFirst = leftIndex; // Turn this node into an inner node
+		node.triCount = 0;
+
+		if (leftCount > parallelThreshold) // Big enough to be worth another thread
+		{
+			_pool->submit([this, leftIndex, _depth, _pool, _counter, _nodesUsed]()
+				{
+					buildNode(leftIndex, _depth + 1, _pool, _counter, _nodesUsed);
+				}, _counter);
+		}
+		else
+		{
+			buildNode(leftIndex, _depth + 1, _pool, _counter, _nodesUsed);
+		}
+		buildNode(leftIndex + 1, _depth + 1, _pool, _counter, _nodesUsed);
+	}
+
+	/**
+	*	Bounds of the part of a triangle that lies between two planes on one axis.
+	*/
+	AABB RTX_CPUBVH::clipTriangle(const BVHTriangle& _triangle, int _axis, float _low, float _high)
+	{
+		AABB box;
+		const Float3* corners[3] = { &_triangle.v0, &_triangle.v1, &_triangle.v2 };
+		for (int i = 0; i < 3; i++)
+		{
+			const Float3& a = *corners[i];
+			const Float3& b = *corners[(i + 1) % 3];
+			if (a[_axis] >= _low && a[_axis] <= _high) // Corner inside the slab
+			{
+				box.grow(a);
+			}
+			// Edge crossing either plane adds the crossing point
+			float planes[2] = { _low, _high };
+			for (int p = 0; p < 2; p++)
+			{
+				if ((a[_axis] < planes[p] && b[_axis] > planes[p]) || (a[_axis] > planes[p] && b[_axis] < planes[p]))
+				{
+					float t = (planes[p] - a[_axis]) / (b[_axis] - a[_axis]);
+					Float3 point = a + (b - a) * t;
+					point[_axis] = planes[p]; // Exactly on the plane despite rounding
+					box.grow(point);
+				}
+			}
+		}
+		return box;
+	}
+
+	/**
+	*	Overlap of two boxes, inverted (empty) when they do not touch.
+	*/
+	static inline AABB intersectBoxes(const AABB& _a, const AABB& _b)
+	{
+		AABB box;
+		box.min = maxFloat3(_a.min, _b.min);
+		box.max = minFloat3(_a.max, _b.max);
+		return box;
+	}
+
+	static inline bool isValidBox(const AABB& _box)
+	{
+		return _box.min.x <= _box.max.x && _box.min.y <= _box.max.y && _box.min.z <= _box.max.z;
+	}
+
+	void RTX_CPUBVH::buildSBVH()
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+		std::vector<BVHReference> rootReferences(triangleCount);
+		AABB rootBounds;
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			AABB box;
+			box.grow(triangles[i].v0);
+			box.grow(triangles[i].v1);
+			box.grow(triangles[i].v2);
+			rootReferences[i].aabbMin = box.min;
+			rootReferences[i].aabbMax = box.max;
+			rootReferences[i].triangle = i;
+			rootBounds.grow(box);
+		}
+
+		nodes.clear();
+		nodes.reserve(2 * static_cast<size_t>(triangleCount));
+		nodes.emplace_back();
+		triIndices.clear();
+		triIndices.reserve(triangleCount);
+
+		uint32_t budget = static_cast<uint32_t>(triangleCount * spatialSplitBudget); // Duplicates still allowed
+		buildSpatialNode(0, rootReferences, 0, rootBounds.area(), budget);
+		nodes.shrink_to_fit();
+	}
+
+	float RTX_CPUBVH::findObjectSplit(const std::vector<BVHReference>& _references, const AABB& _bounds, const AABB& _centroidBounds, int& _axis, uint32_t& _splitBin, AABB& _leftBox, AABB& _rightBox)
+	{
+		SAHBin bins[3][binCount];
+		Float3 extent = _centroidBounds.max - _centroidBounds.min;
+		for (const BVHReference& reference : _references)
+		{
+			Float3 centroid = (reference.aabbMin + reference.aabbMax) * 0.5f;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				uint32_t bin = extent[axis] > 0.0f ? static_cast<uint32_t>((centroid[axis] - _centroidBounds.min[axis]) * (binCount / extent[axis])) : 0;
+				bin = (std::min)(bin, binCount - 1);
+				bins[axis][bin].count++;
+				bins[axis][bin].bounds.grow(reference.aabbMin);
+				bins[axis][bin].bounds.grow(reference.aabbMax);
+			}
+		}
+
+		float invArea = _bounds.area() > 0.0f ? 1.0f / _bounds.area() : 0.0f;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (extent[axis] <= 0.0f) // All centroids on one plane, nothing to split
+			{
+				continue;
+			}
+			for (uint32_t split = 1; split < binCount; split++)
+			{
+				AABB leftBox, rightBox;
+				uint32_t leftCount = 0, rightCount = 0;
+				for (uint32_t i = 0; i < split; i++)
+				{
+					leftBox.grow(bins[axis][i].bounds);
+					leftCount += bins[axis][i].count;
+				}
+				for (uint32_t i = split; i < binCount; i++)
+				{
+					rightBox.grow(bins[axis][i].bounds);
+					rightCount += bins[axis][i].count;
+				}
+				if (leftCount == 0 || rightCount == 0) // Not a real split
+				{
+					continue;
+				}
+				float cost = traversalCost + intersectionCost * (leftCount * leftBox.area() + rightCount * rightBox.area()) * invArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					_axis = axis;
+					_splitBin = split;
+					_leftBox = leftBox;
+					_rightBox = rightBox;
+				}
+			}
+		}
+		return bestCost;
+	}
+
+	float RTX_CPUBVH::findSpatialSplit(const std::vector<BVHReference>& _references, const AABB& _bounds, int& _axis, float& _position, uint32_t& _duplicates)
+	{
+		float invArea = _bounds.area() > 0.0f ? 1.0f / _bounds.area() : 0.0f;
+		float bestCost = FLT_MAX;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = _bounds.max[axis] - _bounds.min[axis];
+			if (extent <= 0.0f)
+			{
+				continue;
+			}
+			float binWidth = extent / spatialBinCount;
+			float invBinWidth = 1.0f / binWidth;
+
+			AABB binBounds[spatialBinCount];
+			uint32_t entries[spatialBinCount] = {};
+			uint32_t exits[spatialBinCount] = {};
+
+			// Every reference is chopped into the bins it spans, each bin only grows by its own piece
+			for (const BVHReference& reference : _references)
+			{
+				AABB referenceBox;
+				referenceBox.min = reference.aabbMin;
+				referenceBox.max = reference.aabbMax;
+				uint32_t firstBin = static_cast<uint32_t>((std::max)(0.0f, (reference.aabbMin[axis] - _bounds.min[axis]) * invBinWidth));
+				uint32_t lastBin = static_cast<uint32_t>((std::max)(0.0f, (reference.aabbMax[axis] - _bounds.min[axis]) * invBinWidth));
+				firstBin = (std::min)(firstBin, spatialBinCount - 1);
+				lastBin = (std::min)((std::max)(lastBin, firstBin), spatialBinCount - 1);
+
+				for (uint32_t bin = firstBin; bin <= lastBin; bin++)
+				{
+					if (firstBin == lastBin) // Fits in one bin, no clipping needed
+					{
+						binBounds[bin].grow(referenceBox);
+						break;
+					}
+					float low = _bounds.min[axis] + bin * binWidth;
+					float high = bin == spatialBinCount - 1 ? _bounds.max[axis] : low + binWidth;
+					AABB piece = intersectBoxes(clipTriangle(triangles[reference.triangle], axis, low, high), referenceBox);
+					if (isValidBox(piece))
+					{
+						binBounds[bin].grow(piece);
+					}
+				}
+				entries[firstBin]++;
+				exits[lastBin]++;
+			}
+
+			// Sweep the planes between bins
+			AABB rightBoxes[spatialBinCount];
+			AABB rightBox;
+			for (uint32_t i = spatialBinCount - 1; i > 0; i--)
+			{
+				rightBox.grow(binBounds[i]);
+				rightBoxes[i] = rightBox;
+			}
+			AABB leftBox;
+			uint32_t leftCount = 0;
+			uint32_t rightCount = static_cast<uint32_t>(_references.size());
+			for (uint32_t split = 1; split < spatialBinCount; split++)
+			{
+				leftBox.grow(binBounds[split - 1]);
+				leftCount += entries[split - 1];
+				rightCount -= exits[split - 1];
+				if (leftCount == 0 || rightCount == 0)
+				{
+					continue;
+				}
+				float cost = traversalCost + intersectionCost * (leftCount * leftBox.area() + rightCount * rightBoxes[split].area()) * invArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					_axis = axis;
+					_position = _bounds.min[axis] + split * binWidth;
+					_duplicates = leftCount + rightCount - static_cast<uint32_t>(_references.size());
+				}
+			}
+		}
+		return bestCost;
+	}
+
+	void RTX_CPUBVH::buildSpatialNode(uint32_t _nodeIndex, std::vector<BVHReference>& _references, uint32_t _depth, float _rootArea, uint32_t& _budget)
+	{
+		AABB bounds, centroidBounds;
+		for (const BVHReference& reference : _references)
+		{
+			bounds.grow(reference.aabbMin);
+			bounds.grow(reference.aabbMax);
+			centroidBounds.grow((reference.aabbMin + reference.aabbMax) * 0.5f);
+		}
+		nodes[_nodeIndex].aabbMin = bounds.min;
+		nodes[_nodeIndex].aabbMax = bounds.max;
+		uint32_t count = static_cast<uint32_t>(_references.size());
+
+		auto makeLeaf = [&]()
+		{
+			nodes[_nodeIndex].leftFirst = static_cast<uint32_t>(triIndices.size());
+			nodes[_nodeIndex].triCount = count;
+			for (const BVHReference& reference : _references)
+			{
+				triIndices.push_back(reference.triangle);
+			}
+		};
+
+		if (count <= 1) // Single triangle, always a leaf
+		{
+			makeLeaf();
+			return;
+		}
+
+		std::vector<BVHReference> left, right;
+		if (_depth < maxBuildDepth)
+		{
+			int objectAxis = 0;
+			uint32_t objectBin = 0;
+			AABB leftBox, rightBox;
+			float objectCost = findObjectSplit(_references, bounds, centroidBounds, objectAxis, objectBin, leftBox, rightBox);
+
+			// Only try spatial splits where the object split children overlap noticeably
+			float spatialCost = FLT_MAX;
+			int spatialAxis = 0;
+			float spatialPosition = 0.0f;
+			uint32_t duplicates = 0;
+			AABB overlap = intersectBoxes(leftBox, rightBox);
+			if (_budget > 0 && objectCost != FLT_MAX && isValidBox(overlap) && overlap.area() > spatialSplitAlpha * _rootArea)
+			{
+				spatialCost = findSpatialSplit(_references, bounds, spatialAxis, spatialPosition, duplicates);
+			}
+
+			float bestCost = (std::min)(objectCost, spatialCost);
+			if (count <= maxLeafSize && bestCost >= intersectionCost * count) // Cheaper as a leaf
+			{
+				makeLeaf();
+				return;
+			}
+
+			if (spatialCost < objectCost && duplicates <= _budget) // Split the straddling references in two
+			{
+				for (const BVHReference& reference : _references)
+				{
+					if (reference.aabbMax[spatialAxis] <= spatialPosition)
+					{
+						left.push_back(reference);
+					}
+					else if (reference.aabbMin[spatialAxis] >= spatialPosition)
+					{
+						right.push_back(reference);
+					}
+					else
+					{
+						AABB referenceBox;
+						referenceBox.min = reference.aabbMin;
+						referenceBox.max = reference.aabbMax;
+						const BVHTriangle& triangle = triangles[reference.triangle];
+						AABB leftPiece = intersectBoxes(clipTriangle(triangle, spatialAxis, -FLT_MAX, spatialPosition), referenceBox);
+						AABB rightPiece = intersectBoxes(clipTriangle(triangle, spatialAxis, spatialPosition, FLT_MAX), referenceBox);
+						BVHReference piece = reference;
+						if (isValidBox(leftPiece))
+						{
+							piece.aabbMin = leftPiece.min;
+							piece.aabbMax = leftPiece.max;
+							left.push_back(piece);
+						}
+						if (isValidBox(rightPiece) || !isValidBox(leftPiece)) // Never drop a triangle
+						{
+							piece.aabbMin = isValidBox(rightPiece) ? rightPiece.min : reference.aabbMin;
+							piece.aabbMax = isValidBox(rightPiece) ? rightPiece.max : reference.aabbMax;
+							right.push_back(piece);
+						}
+					}
+				}
+				uint32_t created = static_cast<uint32_t>(left.size() + right.size()) - count;
+				_budget -= (std::min)(_budget, created);
+			}
+			else if (objectCost != FLT_MAX) // Plain object split
+			{
+				float scale = binCount / (centroidBounds.max[objectAxis] - centroidBounds.min[objectAxis]);
+				for (const BVHReference& reference : _references)
+				{
+					float centroid = (reference.aabbMin[objectAxis] + reference.aabbMax[objectAxis]) * 0.5f;
+					uint32_t bin = (std::min)(static_cast<uint32_t>((centroid - centroidBounds.min[objectAxis]) * scale), binCount - 1);
+					(bin < objectBin ? left : right).push_back(reference);
+				}
+			}
+		}
+		else if (count <= maxLeafSize) // Depth limit reached and small enough
+		{
+			makeLeaf();
+			return;
+		}
+
+		if (left.empty() || right.empty()) // Degenerate or depth limited, fall back to the median
+		{
+			left.clear();
+			right.clear();
+			Float3 extent = centroidBounds.max - centroidBounds.min;
+			int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			std::nth_element(_references.begin(), _references.begin() + count / 2, _references.end(),
+				[axis](const BVHReference& _a, const BVHReference& _b)
+				{
+					return _a.aabbMin[axis] + _a.aabbMax[axis] < _b.aabbMin[axis] + _b.aabbMax[axis];
+				});
+			left.assign(_references.begin(), _references.begin() + count / 2);
+			right.assign(_references.begin() + count / 2, _references.end());
+		}
+		std::vector<BVHReference>().swap(_references); // Free this level before going deeper
+
+		// Allocate both children next to each other, the node array can grow so index it again after
+		uint32_t leftIndex = static_cast<uint32_t>(nodes.size());
+		nodes.emplace_back();
+		nodes.emplace_back();
+		nodes[_nodeIndex].leftFirst = leftIndex;
+		nodes[_nodeIndex].triCount = 0;
+
+		buildSpatialNode(leftIndex, left, _depth + 1, _rootArea, _budget);
+		buildSpatialNode(leftIndex + 1, right, _depth + 1, _rootArea, _budget);
+	}
+
+	/**
+	*	Spreads the low 10 bits of a value so there are two zero bits between each of them.
+	*/
+	static inline uint32_t expandBits(uint32_t _value)
+	{
+		_value = (_value | (_value << 16)) & 0x030000FF;
+		_value = (_value | (_value << 8)) & 0x0300F00F;
+		_value = (_value | (_value << 4)) & 0x030C30C3;
+		_value = (_value | (_value << 2)) & 0x09249249;
+		return _value;
+	}
+
+	/**
+	*	Number of leading zero bits, _value must not be 0.
+	*/
+	static inline int countLeadingZeros(uint64_t _value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse64(&index, _value);
+		return 63 - static_cast<int>(index);
+#else
+		return __builtin_clzll(_value);
+#endif
+	}
+
+	void RTX_CPUBVH::computeMortonCodes(std::vector<uint32_t>& _codes, RTX_ThreadPool* _pool)
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+		std::vector<float> centroidX(triangleCount), centroidY(triangleCount), centroidZ(triangleCount); // SoA so the codes can be computed 4 at a time
+		AABB centroidBounds;
+		std::mutex mergeMutex;
+
+		// Centroids and their bounds
+		_pool->parallelFor(triangleCount, 16384, [&](uint32_t _begin, uint32_t _end)
+			{
+				AABB localBounds;
+				for (uint32_t i = _begin; i < _end; i++)
+				{
+					const BVHTriangle& tri = triangles[i];
+					Float3 centroid = (minFloat3(minFloat3(tri.v0, tri.v1), tri.v2) + maxFloat3(maxFloat3(tri.v0, tri.v1), tri.v2)) * 0.5f;
+					centroidX[i] = centroid.x;
+					centroidY[i] = centroid.y;
+					centroidZ[i] = centroid.z;
+					localBounds.grow(centroid);
+				}
+				std::lock_guard<std::mutex> lock(mergeMutex);
+				centroidBounds.grow(localBounds);
+			});
+
+		// Map the centroid bounds onto a 1024^3 grid
+		Float3 extent = centroidBounds.max - centroidBounds.min;
+		Float3 scale = {
+			extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+			extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+			extent.z > 0.0f ? 1023.0f / extent.z : 0.0f };
+		_codes.resize(triangleCount);
+
+		_pool->parallelFor(triangleCount, 16384, [&](uint32_t _begin, uint32_t _end)
+			{
+				uint32_t i = _begin;
+#if defined(RTX_SIMD_SSE2)
+				const __m128 minX = _mm_set1_ps(centroidBounds.min.x), minY = _mm_set1_ps(centroidBounds.min.y), minZ = _mm_set1_ps(centroidBounds.min.z);
+				const __m128 scaleX = _mm_set1_ps(scale.x), scaleY = _mm_set1_ps(scale.y), scaleZ = _mm_set1_ps(scale.z);
+				const __m128i mask16 = _mm_set1_epi32(0x030000FF), mask8 = _mm_set1_epi32(0x0300F00F);
+				const __m128i mask4 = _mm_set1_epi32(0x030C30C3), mask2 = _mm_set1_epi32(0x09249249);
+
+				// Quantize and interleave 4 centroids per iteration
+				auto expand = [&](__m128i _value)
+				{
+					_value = _mm_and_si128(_mm_or_si128(_value, _mm_slli_epi32(_value, 16)), mask16);
+					_value = _mm_and_si128(_mm_or_si128(_value, _mm_slli_epi32(_value, 8)), mask8);
+					_value = _mm_and_si128(_mm_or_si128(_value, _mm_slli_epi32(_value, 4)), mask4);
+					_value = _mm_and_si128(_mm_or_si128(_value, _mm_slli_epi32(_value, 2)), mask2);
+					return _value;
+				};
+				for (; i + 4 <= _end; i += 4)
+				{
+					__m128i x = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&centroidX[i]), minX), scaleX));
+					__m128i y = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&centroidY[i]), minY), scaleY));
+					__m128i z = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&centroidZ[i]), minZ), scaleZ));
+					__m128i code = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(expand(x), 2), _mm_slli_epi32(expand(y), 1)), expand(z));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(&_codes[i]), code);
+				}
+#endif
+				for (; i < _end; i++) // Remainder, or everything without SSE2
+				{
+					uint32_t x = static_cast<uint32_t>((centroidX[i] - centroidBounds.min.x) * scale.x);
+					uint32_t y = static_cast<uint32_t>((centroidY[i] - centroidBounds.min.y) * scale.y);
+					uint32_t z = static_cast<uint32_t>((centroidZ[i] - centroidBounds.min.z) * scale.z);
+					_codes[i] = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+				}
+			});
+	}
+
+	void RTX_CPUBVH::radixSort(std::vector<uint32_t>& _keys, std::vector<uint32_t>& _values, RTX_ThreadPool* _pool)
+	{
+		uint32_t count = static_cast<uint32_t>(_keys.size());
+		std::vector<uint32_t> tempKeys(count), tempValues(count);
+
+		// Fixed chunks so every chunk scatters into its own slice of each digit bucket
+		uint32_t chunkCount = (std::max)(1u, (std::min)(_pool->getThreadCount() * 4, count / 16384));
+		uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		std::vector<uint32_t> histograms(chunkCount * 256);
+
+		for (uint32_t shift = 0; shift < 32; shift += 8) // 4 passes of 8 bits cover the 30 bit codes
+		{
+			// Count the digits of every chunk
+			_pool->parallelFor(chunkCount, 1, [&](uint32_t _begin, uint32_t _end)
+				{
+					for (uint32_t chunk = _begin; chunk < _end; chunk++)
+					{
+						uint32_t* histogram = &histograms[chunk * 256];
+						memset(histogram, 0, 256 * sizeof(uint32_t));
+						uint32_t last = (std::min)(count, (chunk + 1) * chunkSize);
+						for (uint32_t i = chunk * chunkSize; i < last; i++)
+						{
+							histogram[(_keys[i] >> shift) & 0xFF]++;
+						}
+					}
+				});
+
+			// Turn the counts into write offsets, digit major so the sort stays stable
+			uint32_t sum = 0;
+			for (uint32_t digit = 0; digit < 256; digit++)
+			{
+				for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+				{
+					uint32_t digitCount = histograms[chunk * 256 + digit];
+					histograms[chunk * 256 + digit] = sum;
+					sum += digitCount;
+				}
+			}
+
+			// Scatter every chunk into place
+			_pool->parallelFor(chunkCount, 1, [&](uint32_t _begin, uint32_t _end)
+				{
+					for (uint32_t chunk = _begin; chunk < _end; chunk++)
+					{
+						uint32_t* offsets = &histograms[chunk * 256];
+						uint32_t last = (std::min)(count, (chunk + 1) * chunkSize);
+						for (uint32_t i = chunk * chunkSize; i < last; i++)
+						{
+							uint32_t position = offsets[(_keys[i] >> shift) & 0xFF]++;
+							tempKeys[position] = _keys[i];
+							tempValues[position] = _values[i];
+						}
+					}
+				});
+
+			_keys.swap(tempKeys);
+			_values.swap(tempValues);
+		}
+	}
+
+	void RTX_CPUBVH::buildLBVH(RTX_ThreadPool* _pool)
+	{
+		uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+
+		// Sort the triangles along the Morton curve
+		std::vector<uint32_t> codes;
+		computeMortonCodes(codes, _pool);
+		triIndices.resize(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; i++)
+		{
+			triIndices[i] = i;
+		}
+		radixSort(codes, triIndices, _pool);
+
+		nodes.resize(2 * static_cast<size_t>(triangleCount) - 1);
+		if (triangleCount == 1) // Only a root leaf
+		{
+			nodes[0].leftFirst = 0;
+			nodes[0].triCount = 1;
+			AABB box;
+			box.grow(triangles[0].v0);
+			box.grow(triangles[0].v1);
+			box.grow(triangles[0].v2);
+			nodes[0].aabbMin = box.min;
+			nodes[0].aabbMax = box.max;
+			return;
+		}
+
+		// Karras 2012 gives N - 1 inner nodes and N leaves. Inner node i puts its two children
+		// in slots 1 + 2i and 2 + 2i, which keeps siblings next to each other like the SAH build.
+		std::vector<uint32_t> innerSlot(triangleCount - 1); // Where each inner node ended up
+		std::vector<uint32_t> parents(nodes.size()); // Parent slot of every slot
+		innerSlot[0] = 0; // Root
+		parents[0] = UINT32_MAX;
+
+		// Common prefix length of two sorted keys, the position breaks ties between equal codes
+		auto delta = [&](int64_t _i, int64_t _j) -> int
+		{
+			if (_j < 0 || _j >= static_cast<int64_t>(triangleCount))
+			{
+				return -1;
+			}
+			uint64_t a = (static_cast<uint64_t>(codes[_i]) << 32) | static_cast<uint64_t>(_i);
+			uint64_t b = (static_cast<uint64_t>(codes[_j]) << 32) | static_cast<uint64_t>(_j);
+			return countLeadingZeros(a ^ b);
+		};
+
+		_pool->parallelFor(triangleCount - 1, 4096, [&](uint32_t _begin, uint32_t _end)
+			{
+				for (uint32_t node = _begin; node < _end; node++)
+				{
+					int64_t i = node;
+					int direction = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1; // Which way the range grows
+
+					// Find the other end of the range with an exponential then binary search
+					int deltaMin = delta(i, i - direction);
+					int64_t lengthMax = 2;
+					while (delta(i, i + lengthMax * direction) > deltaMin)
+					{
+						lengthMax *= 2;
+					}
+					int64_t length = 0;
+					for (int64_t step = lengthMax / 2; step >= 1; step /= 2)
+					{
+						if (delta(i, i + (length + step) * direction) > deltaMin)
+						{
+							length += step;
+						}
+					}
+					int64_t j = i + length * direction;
+
+					// Find where the prefix changes inside the range
+					int deltaNode = delta(i, j);
+					int64_t split = 0;
+					int64_t step = length;
+					do
+					{
+						step = (step + 1) / 2;
+						if (delta(i, i + (split + step) * direction) > deltaNode)
+						{
+							split += step;
+						}
+					} while (step > 1);
+					int64_t gamma = i + split * direction + (direction < 0 ? -1 : 0);
+
+					// Place both children
+					uint32_t first = (std::min)(static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+					uint32_t last = (std::max)(static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+					uint32_t childSlots[2] = { 1 + 2 * node, 2 + 2 * node };
+					uint32_t children[2] = { static_cast<uint32_t>(gamma), static_cast<uint32_t>(gamma + 1) };
+					bool childIsLeaf[2] = { first == children[0], last == children[1] };
+					for (int c = 0; c < 2; c++)
+					{
+						if (childIsLeaf[c])
+						{
+							nodes[childSlots[c]].leftFirst = children[c];
+							nodes[childSlots[c]].triCount = 1;
+						}
+						else
+						{
+							innerSlot[children[c]] = childSlots[c];
+						}
+					}
+				}
+			});
+
+		// Inner nodes only know their slot now, so write them and their children's parents in a second pass
+		_pool->parallelFor(triangleCount - 1, 4096, [&](uint32_t _begin, uint32_t _end)
+			{
+				for (uint32_t node = _begin; node < _end; node++)
+				{
+					uint32_t slot = innerSlot[node];
+					nodes[slot].leftFirst = 1 + 2 * node;
+					nodes[slot].triCount = 0;
+					parents[1 + 2 * node] = slot;
+					parents[2 + 2 * node] = slot;
+				}
+			});
+
+		// Fit the bounds bottom up. The second child to arrive at a parent carries on upwards.
+		std::unique_ptr<std::atomic<uint32_t>[]> arrivals(new std::atomic<uint32_t>[nodes.size()]);
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			arrivals[i].store(0, std::memory_order_relaxed);
+		}
+		_pool->parallelFor(static_cast<uint32_t>(nodes.size()), 4096, [&](uint32_t _begin, uint32_t _end)
+			{
+				for (uint32_t slot = _begin; slot < _end; slot++)
+				{
+					if (nodes[slot].triCount == 0) // Only start from leaves
+					{
+						continue;
+					}
+					const BVHTriangle& tri = triangles[triIndices[nodes[slot].leftFirst]];
+					nodes[slot].aabbMin = minFloat3(minFloat3(tri.v0, tri.v1), tri.v2);
+					nodes[slot].aabbMax = maxFloat3(maxFloat3(tri.v0, tri.v1), tri.v2);
+
+					uint32_t parent = parents[slot];
+					while (parent != UINT32_MAX && arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 1)
+					{
+						const BVHNode& left = nodes[nodes[parent].leftFirst];
+						const BVHNode& right = nodes[nodes[parent].leftFirst + 1];
+						nodes[parent].aabbMin = minFloat3(left.aabbMin, right.aabbMin);
+						nodes[parent].aabbMax = maxFloat3(left.aabbMax, right.aabbMax);
+						parent = parents[parent];
+					}
+				}
+			});
+	}
+
+	void RTX_CPUBVH::computeStats()
+	{
+		stats = BVHBuildStats();
+		stats.triangleCount = static_cast<uint32_t>(triangles.size());
+		stats.referenceCount = static_cast<uint32_t>(triIndices.size());
+		stats.nodeCount = static_cast<uint32_t>(nodes.size());
+
+		AABB rootBounds = getBounds();
+		float invRootArea = rootBounds.area() > 0.0f ? 1.0f / rootBounds.area() : 0.0f;
+
+		std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } }; // Node index, depth
+		while (!stack.empty())
+		{
+			std::pair<uint32_t, uint32_t> entry = stack.back();
+			stack.pop_back();
+			const BVHNode& node = nodes[entry.first];
+
+			AABB box;
+			box.grow(node.aabbMin);
+			box.grow(node.aabbMax);
+			float relativeArea = box.area() * invRootArea;
+
+			if (node.triCount > 0) // Leaf
+			{
+				stats.sahCost += intersectionCost * node.triCount * relativeArea;
+				stats.leafCount++;
+				stats.maxDepth = (std::max)(stats.maxDepth, entry.second);
+			}
+			else
+			{
+				stats.sahCost += traversalCost * relativeArea;
+				stack.push_back({ node.leftFirst, entry.second + 1 });
+				stack.push_back({ node.leftFirst + 1, entry.second + 1 });
+			}
+		}
+	}
+
+	/**
+	*	Slab test, returns the entry distance or FLT_MAX when the box is missed.
+	*/
+	static inline float intersectNode(const Ray& _ray, const Float3& _invDirection, const BVHNode& _node, float _closest)
+	{
+		float tx1 = (_node.aabbMin.x - _ray.origin.x) * _invDirection.x, tx2 = (_node.aabbMax.x - _ray.origin.x) * _invDirection.x;
+		float tmin = minFloat(tx1, tx2), tmax = maxFloat(tx1, tx2);
+		float ty1 = (_node.aabbMin.y - _ray.origin.y) * _invDirection.y, ty2 = (_node.aabbMax.y - _ray.origin.y) * _invDirection.y;
+		tmin = maxFloat(tmin, minFloat(ty1, ty2)), tmax = minFloat(tmax, maxFloat(ty1, ty2));
+		float tz1 = (_node.aabbMin.z - _ray.origin.z) * _invDirection.z, tz2 = (_node.aabbMax.z - _ray.origin.z) * _invDirection.z;
+		tmin = maxFloat(tmin, minFloat(tz1, tz2)), tmax = minFloat(tmax, maxFloat(tz1, tz2));
+		tmin = maxFloat(tmin, _ray.tMin);
+		if (tmax >= tmin && tmin < _closest)
+		{
+			return tmin;
+		}
+		return FLT_MAX;
+	}
+
+	template <bool anyHit>
+	bool RTX_CPUBVH::traverse(const Ray& _ray, RayHit* _hit) const
+	{
+		if (nodes.empty())
+		{
+			return false;
+		}
+
+		Float3 invDirection = { 1.0f / _ray.direction.x, 1.0f / _ray.direction.y, 1.0f / _ray.direction.z };
+		float closest = _ray.tMax;
+		uint32_t hitTriangle = UINT32_MAX;
+		float hitU = 0.0f, hitV = 0.0f;
+
+		if (intersectNode(_ray, invDirection, nodes[0], closest) == FLT_MAX) // Missed the whole BLAS
+		{
+			return false;
+		}
+
+		uint32_t stack[128]; // Build depth is capped, so this can not overflow
+		uint32_t stackSize = 0;
+		uint32_t current = 0;
+		while (true)
+		{
+			const BVHNode& node = nodes[current];
+			if (node.triCount > 0) // Leaf, test every triangle
+			{
+				for (uint32_t i = 0; i < node.triCount; i++)
+				{
+					uint32_t triangle = triIndices[node.leftFirst + i];
+					const BVHTriangle& tri = triangles[triangle];
+					if (intersectTriangle(_ray, tri.v0, tri.v1, tri.v2, closest, hitU, hitV))
+					{
+						if (anyHit) // Shadow rays only need to know something is in the way
+						{
+							return true;
+						}
+						hitTriangle = triangle;
+					}
+				}
+			}
+			else // Inner node, visit the nearest child first, or the left one for shadow rays
+			{
+				uint32_t nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+				float nearDistance = intersectNode(_ray, invDirection, nodes[nearChild], closest);
+				float farDistance = intersectNode(_ray, invDirection, nodes[farChild], closest);
+				if ((!anyHit && farDistance < nearDistance) || nearDistance == FLT_MAX)
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearDistance, farDistance);
+				}
+				if (nearDistance != FLT_MAX)
+				{
+					if (farDistance != FLT_MAX)
+					{
+						stack[stackSize++] = farChild;
+					}
+					current = nearChild;
+					continue;
+				}
+			}
+
+			// Pop the next node that is still closer than the closest hit
+			bool found = false;
+			while (stackSize > 0 && !found)
+			{
+				current = stack[--stackSize];
+				found = intersectNode(_ray, invDirection, nodes[current], closest) != FLT_MAX;
+			}
+			if (!found)
+			{
+				break;
+			}
+		}
+
+		if (anyHit || hitTriangle == UINT32_MAX)
+		{
+			return false;
+		}
+
+		_hit->t = closest;
+		_hit->u = hitU;
+		_hit->v = hitV;
+		_hit->geometryIndex = getGeometryIndex(hitTriangle);
+		_hit->primitiveIndex = hitTriangle - geometryOffsets[_hit->geometryIndex];
+		return true;
+	}
+
+	bool RTX_CPUBVH::intersect(const Ray& _ray, RayHit& _hit) const
+	{
+		return traverse<false>(_ray, &_hit);
+	}
+
+	bool RTX_CPUBVH::occluded(const Ray& _ray) const
+	{
+		return traverse<true>(_ray, nullptr);
+	}
+
+	int RTX_CPUBVH::serialize(std::vector<char>& _out) const
+	{
+		writeValue(_out, stats);
+		writeArray(_out, triangles);
+		writeArray(_out, triIndices);
+		writeArray(_out, nodes);
+		writeArray(_out, geometryOffsets);
+		writeArray(_out, geometryOpaque);
+		return 0;
+	}
+
+	bool RTX_CPUBVH::deserialize(const char* _data, size_t _size, size_t& _offset)
+	{
+		references.clear();
+		bool valid = readValue(_data, _size, _offset, stats)
+			&& readArray(_data, _size, _offset, triangles)
+			&& readArray(_data, _size, _offset, triIndices)
+			&& readArray(_data, _size, _offset, nodes)
+			&& readArray(_data, _size, _offset, geometryOffsets)
+			&& readArray(_data, _size, _offset, geometryOpaque);
+		if (!valid || nodes.empty() || triIndices.size() < triangles.size()) // Truncated or corrupt
+		{
+			nodes.clear();
+			return false;
+		}
+		return true;
+	}
+
+	void RTX_CPUBVH::setSpatialSplitBudget(float _value)
+	{
+		spatialSplitBudget = (std::max)(0.0f, _value);
+	}
+
+	BVHBuildStats RTX_CPUBVH::getStats() const
+	{
+		return stats;
+	}
+
+	const std::vector<BVHNode>& RTX_CPUBVH::getNodes() const
+	{
+		return nodes;
+	}
+
+	const std::vector<BVHTriangle>& RTX_CPUBVH::getTriangles() const
+	{
+		return triangles;
+	}
+
+	const std::vector<uint32_t>& RTX_CPUBVH::getTriIndices() const
+	{
+		return triIndices;
+	}
+
+	const std::vector<uint32_t>& RTX_CPUBVH::getGeometryOffsets() const
+	{
+		return geometryOffsets;
+	}
+
+	AABB RTX_CPUBVH::getBounds() const
+	{
+		AABB bounds;
+		if (!nodes.empty())
+		{
+			bounds.grow(nodes[0].aabbMin);
+			bounds.grow(nodes[0].aabbMax);
+		}
+		return bounds;
+	}
+
+	size_t RTX_CPUBVH::getMemorySize() const
+	{
+		return nodes.size() * sizeof(BVHNode) + triangles.size() * sizeof(BVHTriangle) + triIndices.size() * sizeof(uint32_t);
+	}
+
+	uint32_t RTX_CPUBVH::getGeometryIndex(uint32_t _triangle) const
+	{
+		// Last geometry that starts at or before the triangle
+		return static_cast<uint32_t>(std::upper_bound(geometryOffsets.begin(), geometryOffsets.end(), _triangle) - geometryOffsets.begin()) - 1;
+	}
+
+	bool RTX_CPUBVH::getGeometryOpaque(uint32_t _geometryIndex) const
+	{
+		return geometryOpaque[_geometryIndex] != 0;
+	}
+}
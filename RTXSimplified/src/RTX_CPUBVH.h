@@ -0,0 +1,147 @@
+#ifndef RTX_CPUBVH_H
+#define RTX_CPUBVH_H
+
+#include <vector> // std::vector
+#include <atomic> // node allocation
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Float3, AABB, Ray
+#include "RTX_ThreadPool.h" // Parallel build
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	struct BVHNode
+	{
+		Float3 aabbMin;		///< Lower corner of the node bounds.
+		uint32_t leftFirst;	///< Inner node: index of the left child (right = left + 1). Leaf: first entry in the triangle index list.
+		Float3 aabbMax;		///< Upper corner of the node bounds.
+		uint32_t triCount;	///< Number of triangles in the leaf, 0 for inner nodes.
+	}; ///< 32 byte binary BVH node, two nodes per cache line.
+
+	struct BVHTriangle
+	{
+		Float3 v0, v1, v2; ///< Triangle corners.
+	}; ///< Triangle copied out of the vertex buffer.
+
+	enum BVHBuildMode
+	{
+		BVH_BUILD_SAH = 0,	///< Binned SAH, slower to build, faster to trace.
+		BVH_BUILD_LBVH = 1,	///< Morton code linear BVH, for geometry rebuilt every frame.
+		BVH_BUILD_SBVH = 2	///< Binned SAH with spatial splits, for meshes with long thin triangles.
+	}; ///< Builder used by RTX_CPUBVH::build.
+
+	struct BVHReference
+	{
+		Float3 aabbMin;		///< Lower corner of the triangle bounds.
+		uint32_t triangle;	///< Triangle the reference points to.
+		Float3 aabbMax;		///< Upper corner of the triangle bounds.
+		uint32_t padding;	///< Keeps references 32 bytes.
+	}; ///< Build time triangle reference. Partitioned in place so the builder walks memory linearly.
+
+	struct BVHBuildStats
+	{
+		double buildTimeMs = 0.0;	///< Wall clock time spent in the builder.
+		float sahCost = 0.0f;		///< SAH cost of the final tree, relative to the root area.
+		uint32_t triangleCount = 0;	///< Number of triangles in the BLAS.
+		uint32_t referenceCount = 0;///< Triangle references in the leaves, above triangleCount when spatial splits duplicated some.
+		uint32_t nodeCount = 0;		///< Number of nodes emitted.
+		uint32_t leafCount = 0;		///< Number of leaves emitted.
+		uint32_t maxDepth = 0;		///< Deepest leaf.
+	}; ///< Build statistics, used to compare CPU builds against the driver.
+
+	/**
+	*	\brief The class responsible for building and tracing a bottom level acceleration structure on the CPU.
+	*
+	*	Takes the same vertex buffer inputs as RTX_BLAS and builds a binned SAH BVH in parallel,
+	*	so acceleration structures can be built on machines without a raytracing GPU.
+	*/
+	class RTX_CPUBVH
+	{
+	private:
+		std::vector<BVHTriangle> triangles; ///< Triangles of every geometry, back to back.
+		std::vector<uint32_t> triIndices; ///< Triangle indices, reordered so every leaf is a contiguous range.
+		std::vector<BVHNode> nodes; ///< Nodes of the tree, root first.
+		std::vector<uint32_t> geometryOffsets; ///< First triangle of each geometry.
+		std::vector<uint8_t> geometryOpaque; ///< Opaque flag of each geometry.
+		std::vector<BVHReference> references; ///< Triangle references, only alive during the build.
+		BVHBuildStats stats; ///< Statistics of the last build.
+
+		static const uint32_t binCount = 16; ///< Number of SAH bins per axis.
+		static const uint32_t maxLeafSize = 4; ///< Leaves can not hold more triangles than this.
+		static const uint32_t parallelThreshold = 4096; ///< Nodes with more triangles are split on other threads.
+		static const uint32_t maxBuildDepth = 64; ///< Below this depth nodes are split at the median, keeps traversal stacks bounded.
+		static const uint32_t spatialBinCount = 32; ///< Number of spatial split bins per axis.
+		static constexpr float spatialSplitAlpha = 1e-5f; ///< Spatial splits are only tried when the children overlap more than this fraction of the root area.
+		float spatialSplitBudget = 0.3f; ///< Extra references SBVH may create, as a fraction of the triangle count.
+
+		void buildNode(
+			uint32_t _nodeIndex,				///< Node to split.
+			uint32_t _depth,					///< Depth of the node.
+			RTX_ThreadPool* _pool,				///< Pool the subtrees are spawned on.
+			std::atomic<uint32_t>* _counter,	///< Counts the subtrees still being built.
+			std::atomic<uint32_t>* _nodesUsed	///< Node allocator shared by all the threads.
+		); ///< Splits a node and its children.
+		AABB computeBounds(uint32_t _first, uint32_t _count, AABB* _centroidBounds, RTX_ThreadPool* _pool); ///< Bounds of a range of triangles and of their centroids.
+		float findBestSplit(const BVHNode& _node, const AABB& _centroidBounds, int& _axis, uint32_t& _splitBin, RTX_ThreadPool* _pool); ///< Finds the cheapest binned split.
+		void buildSAH(RTX_ThreadPool* _pool); ///< Top down binned SAH build.
+		void buildLBVH(RTX_ThreadPool* _pool); ///< Morton code sort followed by a Karras style hierarchy emission.
+		void computeMortonCodes(std::vector<uint32_t>& _codes, RTX_ThreadPool* _pool); ///< 30 bit Morton code of every triangle centroid.
+		void radixSort(std::vector<uint32_t>& _keys, std::vector<uint32_t>& _values, RTX_ThreadPool* _pool); ///< Parallel LSD radix sort of 30 bit keys.
+		void buildSBVH(); ///< Serial top down build choosing between object and spatial splits.
+		void buildSpatialNode(
+			uint32_t _nodeIndex,						///< Node to fill.
+			std::vector<BVHReference>& _references,		///< References in the node, consumed.
+			uint32_t _depth,							///< Depth of the node.
+			float _rootArea,							///< Surface area of the root, for the overlap test.
+			uint32_t& _budget							///< Duplicates that can still be made.
+		); ///< Splits a node and its children, duplicating references across spatial splits.
+		float findObjectSplit(const std::vector<BVHReference>& _references, const AABB& _bounds, const AABB& _centroidBounds,
+			int& _axis, uint32_t& _splitBin, AABB& _leftBox, AABB& _rightBox); ///< Cheapest binned object split and the boxes of its children.
+		float findSpatialSplit(const std::vector<BVHReference>& _references, const AABB& _bounds,
+			int& _axis, float& _position, uint32_t& _duplicates); ///< Cheapest spatial split plane and how many references it duplicates.
+		static AABB clipTriangle(const BVHTriangle& _triangle, int _axis, float _low, float _high); ///< Bounds of the part of a triangle between two planes.
+		void computeStats(); ///< Fills the SAH cost, leaf count and depth.
+		template <bool anyHit>
+		bool traverse(const Ray& _ray, RayHit* _hit) const; ///< Shared by intersect and occluded, any hit stops at the first triangle and skips ordering the children.
+
+	public:
+		int addVertexBuffer(
+			const void* _vertexData,			///< Contains vertex coords.
+			uint64_t _vertexOffsetInBytes,		///< Offset of the first vertex.
+			uint32_t _vertexCount,				///< Number of vertices in the buffer.
+			uint32_t _vertexSizeInBytes,		///< Size of a vertex.
+			bool _isOpaque						///< Used to optimize search for closes hit.
+		); ///< Copies the triangles out of a CPU vertex buffer, same layout as RTX_BLAS::addVertexBuffer.
+		int addIndexedVertexBuffer(
+			const void* _vertexData,			///< Contains vertex coords.
+			uint64_t _vertexOffsetInBytes,		///< Offset of the first vertex.
+			uint32_t _vertexCount,				///< Number of vertices in the buffer.
+			uint32_t _vertexSizeInBytes,		///< Size of a vertex.
+			const uint32_t* _indexData,			///< 32 bit vertex indices, 3 per triangle.
+			uint32_t _indexCount,				///< Number of indices.
+			bool _isOpaque						///< Used to optimize search for closes hit.
+		); ///< Copies the triangles out of an indexed mesh, same layout as RTX_BLAS::addIndexedVertexBuffer.
+		int build(
+			RTX_ThreadPool* _pool = nullptr,			///< Pool to build on, a temporary one is made when none is given.
+			BVHBuildMode _mode = BVH_BUILD_SAH			///< Builder to use.
+		); ///< Builds the BVH.
+		bool intersect(const Ray& _ray, RayHit& _hit) const; ///< Finds the closest hit, returns false on miss.
+		bool occluded(const Ray& _ray) const; ///< True if any triangle lies between tMin and tMax, stops at the first one found.
+		int serialize(std::vector<char>& _out) const; ///< Appends the built tree to a pointer free blob.
+		bool deserialize(const char* _data, size_t _size, size_t& _offset); ///< Loads a tree written by serialize, returns false if the blob is invalid.
+
+		/*GETTERS*/
+		BVHBuildStats getStats() const;
+		const std::vector<BVHNode>& getNodes() const;
+		const std::vector<BVHTriangle>& getTriangles() const;
+		const std::vector<uint32_t>& getTriIndices() const;
+		const std::vector<uint32_t>& getGeometryOffsets() const;
+		AABB getBounds() const;
+		size_t getMemorySize() const; ///< Bytes used by nodes, triangles and indices.
+		uint32_t getGeometryIndex(uint32_t _triangle) const; ///< Geometry a triangle came from.
+		bool getGeometryOpaque(uint32_t _geometryIndex) const;
+		/*SETTERS*/
+		void setSpatialSplitBudget(float _value); ///< Extra references allowed by BVH_BUILD_SBVH, 0.3 = up to 30% more.
+	};
+}
+#endif // !RTX_CPUBVH_H
@@ -0,0 +1,107 @@
+#ifndef RTX_CPUMATH_H
+#define RTX_CPUMATH_H
+
+#include <stdint.h> // uint32_t
+#include <cfloat> // FLT_MAX
+#include <cmath> // fabsf
+
+// SSE2 is part of every x64 target, AVX2 needs /arch:AVX2 (MSVC) or -mavx2 (GCC, Clang).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RTX_SIMD_SSE2
+#include <emmintrin.h> // SSE2 intrinsics
+#endif
+#if defined(__AVX2__)
+#define RTX_SIMD_AVX2
+#include <immintrin.h> // AVX2 intrinsics
+#endif
+
+namespace RTXSimplified
+{
+	struct Float3
+	{
+		float x, y, z;
+
+		float operator[](int _axis) const { return (&x)[_axis]; }
+		float& operator[](int _axis) { return (&x)[_axis]; }
+	}; ///< Plain 3 float vector used by the CPU ray tracing code.
+
+	inline Float3 operator+(const Float3& _a, const Float3& _b) { return { _a.x + _b.x, _a.y + _b.y, _a.z + _b.z }; }
+	inline Float3 operator-(const Float3& _a, const Float3& _b) { return { _a.x - _b.x, _a.y - _b.y, _a.z - _b.z }; }
+	inline Float3 operator*(const Float3& _a, float _s) { return { _a.x * _s, _a.y * _s, _a.z * _s }; }
+	inline float minFloat(float _a, float _b) { return _a < _b ? _a : _b; } // Compiles to a single minss, unlike fminf
+	inline float maxFloat(float _a, float _b) { return _a > _b ? _a : _b; } // Compiles to a single maxss, unlike fmaxf
+	inline Float3 minFloat3(const Float3& _a, const Float3& _b) { return { minFloat(_a.x, _b.x), minFloat(_a.y, _b.y), minFloat(_a.z, _b.z) }; }
+	inline Float3 maxFloat3(const Float3& _a, const Float3& _b) { return { maxFloat(_a.x, _b.x), maxFloat(_a.y, _b.y), maxFloat(_a.z, _b.z) }; }
+	inline float dot(const Float3& _a, const Float3& _b) { return _a.x * _b.x + _a.y * _b.y + _a.z * _b.z; }
+	inline Float3 cross(const Float3& _a, const Float3& _b) { return { _a.y * _b.z - _a.z * _b.y, _a.z * _b.x - _a.x * _b.z, _a.x * _b.y - _a.y * _b.x }; }
+
+	struct AABB
+	{
+		Float3 min = { FLT_MAX, FLT_MAX, FLT_MAX };		///< Lower corner, starts inverted so any grow sets it.
+		Float3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };	///< Upper corner.
+
+		void grow(const Float3& _point) { min = minFloat3(min, _point); max = maxFloat3(max, _point); }
+		void grow(const AABB& _box) { min = minFloat3(min, _box.min); max = maxFloat3(max, _box.max); }
+		float area() const
+		{
+			Float3 e = max - min;
+			if (e.x < 0.0f) return 0.0f; // Empty box
+			return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	}; ///< Axis aligned bounding box.
+
+	struct Ray
+	{
+		Float3 origin;		///< Where the ray starts.
+		float tMin;			///< Closest accepted distance.
+		Float3 direction;	///< Direction, does not need to be normalized.
+		float tMax;			///< Furthest accepted distance.
+	}; ///< Ray in the same form as the HLSL RayDesc.
+
+	struct RayHit
+	{
+		float t = FLT_MAX;						///< Distance along the ray.
+		float u = 0.0f;							///< Barycentric of the second vertex.
+		float v = 0.0f;							///< Barycentric of the third vertex.
+		uint32_t primitiveIndex = UINT32_MAX;	///< Triangle index inside its geometry, UINT32_MAX = miss.
+		uint32_t geometryIndex = 0;				///< Index of the geometry inside the BLAS.
+	}; ///< Closest hit information, matches what the hit shaders get.
+
+	/**
+	*	Moller-Trumbore ray / triangle test. Writes the distance and barycentrics on hit.
+	*/
+	inline bool intersectTriangle(const Ray& _ray, const Float3& _v0, const Float3& _v1, const Float3& _v2, float& _t, float& _u, float& _v)
+	{
+		const Float3 edge1 = _v1 - _v0;
+		const Float3 edge2 = _v2 - _v0;
+		const Float3 p = cross(_ray.direction, edge2);
+		const float det = dot(edge1, p);
+		if (fabsf(det) < 1e-12f) // Ray parallel to the triangle
+		{
+			return false;
+		}
+		const float invDet = 1.0f / det;
+		const Float3 s = _ray.origin - _v0;
+		const float u = dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+		{
+			return false;
+		}
+		const Float3 q = cross(s, edge1);
+		const float v = dot(_ray.direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+		{
+			return false;
+		}
+		const float t = dot(edge2, q) * invDet;
+		if (t < _ray.tMin || t >= _t)
+		{
+			return false;
+		}
+		_t = t;
+		_u = u;
+		_v = v;
+		return true;
+	}
+}
+#endif // !RTX_CPUMATH_H
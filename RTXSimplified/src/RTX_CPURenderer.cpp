@@ -0,0 +1,651 @@
+#include "RTX_CPURenderer.h"
+#include <string.h> // memcpy, memcmp
+#include <algorithm> // std::min
+#include <chrono> // shading timings
+#include <iostream> // shading report
+
+namespace RTXSimplified
+{
+	static inline void accumulateSample(AccumulatedPixel& _pixel, const Float3& _color, float _n)
+	{
+		// Welford update, stable over thousands of samples in float32
+		float luminance = 0.2126f * _color.x + 0.7152f * _color.y + 0.0722f * _color.z;
+		float oldLuminance = 0.2126f * _pixel.mean[0] + 0.7152f * _pixel.mean[1] + 0.0722f * _pixel.mean[2];
+		_pixel.mean[0] += (_color.x - _pixel.mean[0]) / _n;
+		_pixel.mean[1] += (_color.y - _pixel.mean[1]) / _n;
+		_pixel.mean[2] += (_color.z - _pixel.mean[2]) / _n;
+		float newLuminance = 0.2126f * _pixel.mean[0] + 0.7152f * _pixel.mean[1] + 0.0722f * _pixel.mean[2];
+		if (_n == 1.0f) // First sample after a reset, drop what the buffer held
+		{
+			_pixel.m2 = 0.0f;
+		}
+		_pixel.m2 += (luminance - oldLuminance) * (luminance - newLuminance);
+	} // Adds the _n th sample to a pixel
+
+	Ray RTX_CPURenderer::rayGeneration(float _x, float _y) const
+	{
+		// Point in normalized device coordinates, through the inverse projection then into world space
+		float ndcX = _x / width * 2.0f - 1.0f;
+		float ndcY = -(_y / height * 2.0f - 1.0f);
+		Float3 target = {
+			ndcX * projectionInverse[0] + ndcY * projectionInverse[4] + projectionInverse[8] + projectionInverse[12],
+			ndcX * projectionInverse[1] + ndcY * projectionInverse[5] + projectionInverse[9] + projectionInverse[13],
+			ndcX * projectionInverse[2] + ndcY * projectionInverse[6] + projectionInverse[10] + projectionInverse[14] };
+		Float3 direction = {
+			target.x * viewInverse[0] + target.y * viewInverse[4] + target.z * viewInverse[8],
+			target.x * viewInverse[1] + target.y * viewInverse[5] + target.z * viewInverse[9],
+			target.x * viewInverse[2] + target.y * viewInverse[6] + target.z * viewInverse[10] };
+		direction = direction * (1.0f / sqrtf(dot(direction, direction)));
+
+		Float3 origin = { viewInverse[12], viewInverse[13], viewInverse[14] }; // Camera position is the translation row
+		return { origin, 0.0f, direction, 100000.0f };
+	}
+
+	Float3 RTX_CPURenderer::miss(uint32_t _y) const
+	{
+		float ramp = static_cast<float>(_y) / height;
+		return { 0.0f, 0.2f, 0.7f - 0.3f * ramp };
+	}
+
+	Float3 RTX_CPURenderer::closestHit(const RTX_CPUTLAS& _tlas, const Ray& _ray, const TLASHit& _hit) const
+	{
+		if (_hit.hitGroupIndex >= hitGroups.size()) // Error check, the GPU would read past the table
+		{
+			RTX_Exception::handleError("Hit group index past the end of the CPU hit groups.", false);
+			return { 0.0f, 0.0f, 0.0f };
+		}
+
+		const CPUHitGroupRecord& record = hitGroups[_hit.hitGroupIndex];
+		switch (record.program)
+		{
+		case CPU_HIT_PROGRAM_CLOSEST_HIT:
+		{
+			float w = 1.0f - _hit.u - _hit.v; // Barycentrics of the three vertices
+			return record.colors[0] * w + record.colors[1] * _hit.u + record.colors[2] * _hit.v;
+		}
+		case CPU_HIT_PROGRAM_PLANE:
+		{
+			if (!shadowsEnabled)
+			{
+				return planeColor;
+			}
+			Ray shadowRay;
+			shadowRay.origin = _ray.origin + _ray.direction * _hit.t; // World hit position, instance transforms keep t
+			Float3 toLight = lightPosition - shadowRay.origin;
+			float lightDistance = sqrtf(dot(toLight, toLight));
+			shadowRay.direction = toLight * (1.0f / lightDistance);
+			shadowRay.tMin = 0.01f; // Keeps the ray off the surface it starts on
+			shadowRay.tMax = lightDistance;
+			bool blocked = _tlas.occluded(shadowRay, shadowInclusionMask); // ShadowHitGroup only reports the hit, so the first one will do
+			return planeColor * (blocked ? shadowFactor : 1.0f);
+		}
+		default: // Shadow records are never reached by primary rays
+			return { 0.0f, 0.0f, 0.0f };
+		}
+	}
+
+	int RTX_CPURenderer::generate(uint32_t _tile, WavefrontQueues& _queues) const
+	{
+		const AccumulatedTile& tile = tiles[_tile];
+		uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		uint32_t startX = (_tile % tilesX) * tileSize, startY = (_tile / tilesX) * tileSize;
+		uint32_t endX = (std::min)(startX + tileSize, width), endY = (std::min)(startY + tileSize, height);
+
+		_queues.primary.clear();
+		for (uint32_t pass = 0; pass < tile.passes; pass++)
+		{
+			for (uint32_t y = startY; y < endY; y++)
+			{
+				for (uint32_t x = startX; x < endX; x++)
+				{
+					// Same jitter as the megakernel, so both modes trace the same rays
+					uint32_t index = tile.sampleCount + pass;
+					float jitterX = sampler.sample(x, y, index, 0), jitterY = sampler.sample(x, y, index, 1);
+					_queues.primary.push(rayGeneration(x + jitterX, y + jitterY), _queues.primary.size); // Slots follow the queue order
+				}
+			}
+		}
+		_queues.radiance.resize(_queues.primary.size);
+		return 0;
+	}
+
+	int RTX_CPURenderer::extend(const RTX_CPUTLAS& _tlas, uint32_t _tile, WavefrontQueues& _queues) const
+	{
+		const RayQueue& rays = _queues.primary;
+		_queues.closestHits.clear();
+		_queues.planeHits.clear();
+		_queues.misses.clear();
+
+		for (uint32_t first = 0; first < rays.size; first += packetWidth)
+		{
+			RayPacket packet = rays.getPacket(first);
+			RayPacketHit hit;
+			hit.reset();
+			_tlas.intersect(packet, hit);
+
+			for (uint32_t lane = 0; lane < packetWidth && first + lane < rays.size; lane++)
+			{
+				uint32_t slot = rays.sample[first + lane];
+				if (hit.primitiveIndex[lane] == UINT32_MAX) // Left the scene
+				{
+					_queues.misses.push_back(slot);
+					continue;
+				}
+
+				uint32_t hitGroupIndex = _tlas.getHitGroupIndex(hit.instanceIndex[lane], hit.geometryIndex[lane], 0, 0); // Ray contribution and geometry multiplier 0, like the primary TraceRay
+				if (hitGroupIndex >= hitGroups.size()) // Error check, the GPU would read past the table
+				{
+					RTX_Exception::handleError("Hit group index past the end of the CPU hit groups.", false);
+					_queues.radiance[slot] = { 0.0f, 0.0f, 0.0f };
+					continue;
+				}
+
+				Float3 position = {
+					rays.originX[first + lane] + rays.directionX[first + lane] * hit.t[lane],
+					rays.originY[first + lane] + rays.directionY[first + lane] * hit.t[lane],
+					rays.originZ[first + lane] + rays.directionZ[first + lane] * hit.t[lane] };
+				switch (hitGroups[hitGroupIndex].program)
+				{
+				case CPU_HIT_PROGRAM_CLOSEST_HIT:
+					_queues.closestHits.push(position, hit.u[lane], hit.v[lane], hitGroupIndex, slot);
+					break;
+				case CPU_HIT_PROGRAM_PLANE:
+					_queues.planeHits.push(position, hit.u[lane], hit.v[lane], hitGroupIndex, slot);
+					break;
+				default: // Shadow records are never reached by primary rays
+					_queues.radiance[slot] = { 0.0f, 0.0f, 0.0f };
+					break;
+				}
+			}
+		}
+
+		// Misses only need the row of their pixel for the gradient
+		uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		uint32_t startX = (_tile % tilesX) * tileSize, startY = (_tile / tilesX) * tileSize;
+		uint32_t tileWidth = (std::min)(startX + tileSize, width) - startX;
+		uint32_t tilePixels = getTilePixelCount(_tile);
+		for (size_t m = 0; m < _queues.misses.size(); m++)
+		{
+			uint32_t slot = _queues.misses[m];
+			_queues.radiance[slot] = miss(startY + (slot % tilePixels) / tileWidth);
+		}
+		return 0;
+	}
+
+	int RTX_CPURenderer::sortHits(HitQueue& _hits, WavefrontQueues& _queues) const
+	{
+		bool inOrder = true;
+		for (uint32_t i = 1; i < _hits.size && inOrder; i++) // A single record, like the plane hits, needs no sort
+		{
+			inOrder = _hits.hitGroupIndex[i - 1] <= _hits.hitGroupIndex[i];
+		}
+		if (inOrder)
+		{
+			return 0;
+		}
+
+		std::vector<uint32_t>& offsets = _queues.binOffsets;
+		offsets.assign(hitGroups.size() + 1, 0);
+		for (uint32_t i = 0; i < _hits.size; i++) // Count the hits of every record
+		{
+			offsets[_hits.hitGroupIndex[i] + 1]++;
+		}
+		for (size_t g = 1; g < offsets.size(); g++) // Then where each record starts
+		{
+			offsets[g] += offsets[g - 1];
+		}
+
+		HitQueue& sorted = _queues.sortedHits;
+		sorted.resize(_hits.size);
+		for (uint32_t i = 0; i < _hits.size; i++) // Scatter, hits of a record keep their order
+		{
+			uint32_t destination = offsets[_hits.hitGroupIndex[i]]++;
+			sorted.positionX[destination] = _hits.positionX[i];
+			sorted.positionY[destination] = _hits.positionY[i];
+			sorted.positionZ[destination] = _hits.positionZ[i];
+			sorted.u[destination] = _hits.u[i];
+			sorted.v[destination] = _hits.v[i];
+			sorted.hitGroupIndex[destination] = _hits.hitGroupIndex[i];
+			sorted.sample[destination] = _hits.sample[i];
+		}
+		std::swap(_hits, sorted); // Arrays swapped, nothing copied back
+		return 0;
+	}
+
+	int RTX_CPURenderer::shadeClosestHits(WavefrontQueues& _queues) const
+	{
+		const HitQueue& hits = _queues.closestHits;
+		uint32_t i = 0;
+		while (i < hits.size)
+		{
+			// Runs of hits on the same record share its colours, a whole bin once the hits are sorted
+			uint32_t hitGroupIndex = hits.hitGroupIndex[i];
+			const CPUHitGroupRecord& record = hitGroups[hitGroupIndex];
+			Float3 colorA = record.colors[0], colorB = record.colors[1], colorC = record.colors[2];
+			for (; i < hits.size && hits.hitGroupIndex[i] == hitGroupIndex; i++)
+			{
+				float w = 1.0f - hits.u[i] - hits.v[i]; // Barycentrics of the three vertices
+				_queues.radiance[hits.sample[i]] = colorA * w + colorB * hits.u[i] + colorC * hits.v[i];
+			}
+		}
+		return 0;
+	}
+
+	int RTX_CPURenderer::shadePlaneHits(WavefrontQueues& _queues) const
+	{
+		const HitQueue& hits = _queues.planeHits;
+		_queues.shadow.clear();
+		for (uint32_t i = 0; i < hits.size; i++)
+		{
+			_queues.radiance[hits.sample[i]] = planeColor; // Darkened by connect if the light is blocked
+			if (!shadowsEnabled)
+			{
+				continue;
+			}
+			Ray shadowRay;
+			shadowRay.origin = { hits.positionX[i], hits.positionY[i], hits.positionZ[i] };
+			Float3 toLight = lightPosition - shadowRay.origin;
+			float lightDistance = sqrtf(dot(toLight, toLight));
+			shadowRay.direction = toLight * (1.0f / lightDistance);
+			shadowRay.tMin = 0.01f; // Keeps the ray off the surface it starts on
+			shadowRay.tMax = lightDistance;
+			_queues.shadow.push(shadowRay, hits.sample[i]);
+		}
+		return 0;
+	}
+
+	int RTX_CPURenderer::connect(const RTX_CPUTLAS& _tlas, WavefrontQueues& _queues) const
+	{
+		const RayQueue& rays = _queues.shadow;
+		for (uint32_t first = 0; first < rays.size; first += packetWidth)
+		{
+			uint32_t blocked = _tlas.occluded(rays.getPacket(first), 0, shadowInclusionMask); // ShadowHitGroup only reports the hit, so the first one will do
+			while (blocked != 0)
+			{
+				uint32_t lane = 0;
+				while (!(blocked & (1u << lane)))
+				{
+					lane++;
+				}
+				blocked &= blocked - 1;
+				_queues.radiance[rays.sample[first + lane]] = planeColor * shadowFactor;
+			}
+		}
+		return 0;
+	}
+
+	int RTX_CPURenderer::renderTile(const RTX_CPUTLAS& _tlas, uint32_t _tile, WavefrontQueues& _queues)
+	{
+		AccumulatedTile& tile = tiles[_tile];
+		if (tile.passes == 0) // Converged or no share of the budget this time
+		{
+			return 0;
+		}
+
+		uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		uint32_t startX = (_tile % tilesX) * tileSize, startY = (_tile / tilesX) * tileSize;
+		uint32_t endX = (std::min)(startX + tileSize, width), endY = (std::min)(startY + tileSize, height);
+
+		if (renderMode == CPU_RENDER_MODE_WAVEFRONT)
+		{
+			generate(_tile, _queues);
+			extend(_tlas, _tile, _queues);
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			if (hitSorting)
+			{
+				sortHits(_queues.closestHits, _queues);
+				sortHits(_queues.planeHits, _queues);
+			}
+			std::chrono::high_resolution_clock::time_point sorted = std::chrono::high_resolution_clock::now();
+			shadeClosestHits(_queues);
+			shadePlaneHits(_queues);
+			_queues.stats.sortTimeMs += std::chrono::duration<double, std::milli>(sorted - start).count();
+			_queues.stats.shadeTimeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sorted).count();
+			_queues.stats.shadedHits += _queues.closestHits.size + _queues.planeHits.size;
+
+			connect(_tlas, _queues);
+
+			const Float3* color = _queues.radiance.data(); // Slots are pass by pass then pixel by pixel, the order the megakernel adds them in
+			for (uint32_t pass = 0; pass < tile.passes; pass++)
+			{
+				float n = static_cast<float>(tile.sampleCount + 1);
+				for (uint32_t y = startY; y < endY; y++)
+				{
+					AccumulatedPixel* pixel = &accumulation[static_cast<size_t>(y) * width + startX];
+					for (uint32_t x = startX; x < endX; x++)
+					{
+						accumulateSample(*pixel++, *color++, n);
+					}
+				}
+				tile.sampleCount++;
+			}
+			return resolveTile(_tile);
+		}
+
+		for (uint32_t pass = 0; pass < tile.passes; pass++)
+		{
+			float n = static_cast<float>(tile.sampleCount + 1); // Count including the sample being added
+			for (uint32_t y = startY; y < endY; y++)
+			{
+				AccumulatedPixel* pixel = &accumulation[static_cast<size_t>(y) * width + startX];
+				for (uint32_t x = startX; x < endX; x++)
+				{
+					// Point in the pixel from the sampler, the average converges to the box filtered image
+					float jitterX = sampler.sample(x, y, tile.sampleCount, 0), jitterY = sampler.sample(x, y, tile.sampleCount, 1);
+					Ray ray = rayGeneration(x + jitterX, y + jitterY);
+					TLASHit hit;
+					Float3 color = _tlas.intersect(ray, hit, 0, 0) ? closestHit(_tlas, ray, hit) : miss(y); // Ray contribution and geometry multiplier 0, like the primary TraceRay
+					accumulateSample(*pixel++, color, n);
+				}
+			}
+			tile.sampleCount++;
+		}
+		return resolveTile(_tile);
+	}
+
+	int RTX_CPURenderer::resolveTile(uint32_t _tile)
+	{
+		const AccumulatedTile& tile = tiles[_tile];
+		uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		uint32_t startX = (_tile % tilesX) * tileSize, startY = (_tile / tilesX) * tileSize;
+		uint32_t endX = (std::min)(startX + tileSize, width), endY = (std::min)(startY + tileSize, height);
+
+		float n = static_cast<float>(tile.sampleCount);
+		double squaredErrors = 0.0;
+		for (uint32_t y = startY; y < endY; y++)
+		{
+			size_t first = static_cast<size_t>(y) * width + startX;
+			uint8_t* row = &output[first * 4];
+			const AccumulatedPixel* pixel = &accumulation[first];
+			for (uint32_t x = startX; x < endX; x++)
+			{
+				if (n > 1.0f)
+				{
+					squaredErrors += pixel->m2 / ((n - 1.0f) * n); // Variance of the mean
+				}
+
+				// Stored like the R8G8B8A8_UNORM output, alpha is always 1
+				row[0] = static_cast<uint8_t>(minFloat(maxFloat(pixel->mean[0], 0.0f), 1.0f) * 255.0f + 0.5f);
+				row[1] = static_cast<uint8_t>(minFloat(maxFloat(pixel->mean[1], 0.0f), 1.0f) * 255.0f + 0.5f);
+				row[2] = static_cast<uint8_t>(minFloat(maxFloat(pixel->mean[2], 0.0f), 1.0f) * 255.0f + 0.5f);
+				row[3] = 255;
+				row += 4;
+				pixel++;
+			}
+		}
+		tiles[_tile].squaredErrors = squaredErrors;
+		return 0;
+	}
+
+	int RTX_CPURenderer::allocateSamples()
+	{
+		uint64_t budget = sampleBudget != 0 ? sampleBudget : static_cast<uint64_t>(width) * height;
+		uint64_t spent = 0;
+		double totalErrors = 0.0;
+		uint32_t sharingTiles = 0;
+
+		// Tiles short of the minimum come first, their error is not known yet
+		for (uint32_t t = 0; t < tiles.size(); t++)
+		{
+			tiles[t].passes = 0;
+			if (isTileConverged(t))
+			{
+				continue;
+			}
+			if (tiles[t].sampleCount < minSamples)
+			{
+				tiles[t].passes = 1;
+				spent += getTilePixelCount(t);
+			}
+			else
+			{
+				totalErrors += tiles[t].squaredErrors;
+				sharingTiles++;
+			}
+		}
+
+		// The rest goes to the noisy tiles by their share of the image error
+		double remaining = budget > spent ? static_cast<double>(budget - spent) : 0.0;
+		for (uint32_t t = 0; t < tiles.size(); t++)
+		{
+			AccumulatedTile& tile = tiles[t];
+			if (tile.sampleCount < minSamples || isTileConverged(t))
+			{
+				continue;
+			}
+			double share = totalErrors > 0.0 ? tile.squaredErrors / totalErrors : 1.0 / sharingTiles;
+			tile.credit += remaining * share / getTilePixelCount(t);
+			tile.passes = (std::min)(static_cast<uint32_t>(tile.credit), maxSamples - tile.sampleCount);
+			tile.credit -= tile.passes;
+		}
+		return 0;
+	}
+
+	uint32_t RTX_CPURenderer::getTilePixelCount(uint32_t _tile) const
+	{
+		uint32_t tilesX = (width + tileSize - 1) / tileSize;
+		uint32_t startX = (_tile % tilesX) * tileSize, startY = (_tile / tilesX) * tileSize;
+		return ((std::min)(startX + tileSize, width) - startX) * ((std::min)(startY + tileSize, height) - startY);
+	}
+
+	bool RTX_CPURenderer::isTileConverged(uint32_t _tile) const
+	{
+		const AccumulatedTile& tile = tiles[_tile];
+		if (tile.sampleCount >= maxSamples)
+		{
+			return true;
+		}
+		return tile.sampleCount >= minSamples && tile.squaredErrors < static_cast<double>(errorThreshold) * errorThreshold * getTilePixelCount(_tile); // RMS over the tile under the threshold
+	}
+
+	int RTX_CPURenderer::render(const RTX_CPUTLAS& _tlas, RTX_ThreadPool& _pool)
+	{
+		if (width == 0 || height == 0) // Error check
+		{
+			RTX_Exception::handleError("CPU render without an output size.", false);
+			return 0;
+		}
+
+		size_t pixelCount = static_cast<size_t>(width) * height;
+		uint32_t tileCount = static_cast<uint32_t>(tiles.size()); // Sized by setOutputSize
+
+		if (isConverged()) // Nothing left to gain until something changes
+		{
+			return 0;
+		}
+
+		allocateSamples();
+		threadQueues.resize(_pool.getThreadCount());
+		_pool.parallelFor(tileCount, 1, [&](uint32_t _begin, uint32_t _end)
+		{
+			WavefrontQueues& queues = threadQueues[_pool.getCurrentThreadIndex()]; // One tile at a time per thread
+			for (uint32_t tile = _begin; tile < _end; tile++)
+			{
+				renderTile(_tlas, tile, queues);
+			}
+		});
+
+		double squaredErrors = 0.0;
+		bool errorKnown = true;
+		convergedTileCount = 0;
+		for (uint32_t t = 0; t < tileCount; t++) // Summed in tile order, so the error does not depend on the thread timing
+		{
+			sampleCount += static_cast<uint64_t>(tiles[t].passes) * getTilePixelCount(t);
+			squaredErrors += tiles[t].squaredErrors;
+			errorKnown = errorKnown && tiles[t].sampleCount >= minSamples;
+			convergedTileCount += isTileConverged(t) ? 1 : 0;
+		}
+		error = errorKnown ? static_cast<float>(sqrt(squaredErrors / pixelCount)) : FLT_MAX;
+
+		return 0;
+	}
+
+	uint64_t RTX_CPURenderer::renderUntilConverged(const RTX_CPUTLAS& _tlas, RTX_ThreadPool& _pool)
+	{
+		uint64_t startCount = sampleCount;
+		do
+		{
+			render(_tlas, _pool);
+		} while (!isConverged());
+		return sampleCount - startCount;
+	}
+
+	int RTX_CPURenderer::resetAccumulation()
+	{
+		for (size_t t = 0; t < tiles.size(); t++)
+		{
+			tiles[t] = AccumulatedTile();
+		}
+		convergedTileCount = 0;
+		sampleCount = 0;
+		error = FLT_MAX;
+		return 0;
+	}
+
+	bool RTX_CPURenderer::isConverged() const
+	{
+		return !tiles.empty() && convergedTileCount == tiles.size();
+	}
+
+	int RTX_CPURenderer::printShadingStats()
+	{
+		ShadingStats stats = getShadingStats();
+		double totalMs = stats.sortTimeMs + stats.shadeTimeMs;
+		std::cout << "CPU shading " << (hitSorting ? "with" : "without") << " hit sorting: " << stats.shadedHits << " hits, "
+			<< stats.sortTimeMs << " ms sorting + " << stats.shadeTimeMs << " ms shading, "
+			<< (totalMs > 0.0 ? stats.shadedHits / totalMs / 1000.0 : 0.0) << " Mhits/s" << std::endl;
+		return 0;
+	}
+
+	int RTX_CPURenderer::resetShadingStats()
+	{
+		for (size_t t = 0; t < threadQueues.size(); t++)
+		{
+			threadQueues[t].stats = ShadingStats();
+		}
+		return 0;
+	}
+
+	const std::vector<uint8_t>& RTX_CPURenderer::getOutput() const
+	{
+		return output;
+	}
+	uint32_t RTX_CPURenderer::getWidth() const
+	{
+		return width;
+	}
+	uint32_t RTX_CPURenderer::getHeight() const
+	{
+		return height;
+	}
+	const std::vector<AccumulatedPixel>& RTX_CPURenderer::getAccumulation() const
+	{
+		return accumulation;
+	}
+	uint64_t RTX_CPURenderer::getSampleCount() const
+	{
+		return sampleCount;
+	}
+	uint32_t RTX_CPURenderer::getConvergedTileCount() const
+	{
+		return convergedTileCount;
+	}
+	uint32_t RTX_CPURenderer::getTileCount() const
+	{
+		return static_cast<uint32_t>(tiles.size());
+	}
+	ShadingStats RTX_CPURenderer::getShadingStats() const
+	{
+		ShadingStats stats;
+		for (size_t t = 0; t < threadQueues.size(); t++)
+		{
+			stats.shadedHits += threadQueues[t].stats.shadedHits;
+			stats.sortTimeMs += threadQueues[t].stats.sortTimeMs;
+			stats.shadeTimeMs += threadQueues[t].stats.shadeTimeMs;
+		}
+		return stats;
+	}
+	float RTX_CPURenderer::getError() const
+	{
+		return error;
+	}
+	void RTX_CPURenderer::setOutputSize(uint32_t _width, uint32_t _height)
+	{
+		if (_width == width && _height == height)
+		{
+			return;
+		}
+		width = _width;
+		height = _height;
+
+		// Buffers follow the new size, the tile count can change even when the pixel count does not
+		size_t pixelCount = static_cast<size_t>(width) * height;
+		output.assign(pixelCount * 4, 0);
+		accumulation.assign(pixelCount, AccumulatedPixel());
+		tiles.assign(((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize), AccumulatedTile());
+		resetAccumulation();
+	}
+	void RTX_CPURenderer::setCamera(const float _viewInverse[16], const float _projectionInverse[16])
+	{
+		if (memcmp(viewInverse, _viewInverse, sizeof(viewInverse)) != 0 || memcmp(projectionInverse, _projectionInverse, sizeof(projectionInverse)) != 0) // The camera moved, old samples show another view
+		{
+			resetAccumulation();
+		}
+		memcpy(viewInverse, _viewInverse, sizeof(viewInverse));
+		memcpy(projectionInverse, _projectionInverse, sizeof(projectionInverse));
+	}
+	void RTX_CPURenderer::setHitGroups(const std::vector<CPUHitGroupRecord>& _hitGroups)
+	{
+		hitGroups = _hitGroups;
+	}
+	void RTX_CPURenderer::setShadowsEnabled(bool _value)
+	{
+		if (_value != shadowsEnabled)
+		{
+			resetAccumulation();
+		}
+		shadowsEnabled = _value;
+	}
+	void RTX_CPURenderer::setLightPosition(const Float3& _position)
+	{
+		resetAccumulation();
+		lightPosition = _position;
+	}
+	void RTX_CPURenderer::setErrorThreshold(float _value)
+	{
+		errorThreshold = _value;
+		convergedTileCount = 0; // Counted again by the next render
+	}
+	void RTX_CPURenderer::setSampleLimits(uint32_t _minSamples, uint32_t _maxSamples)
+	{
+		if (_minSamples < 2 || _maxSamples < _minSamples) // Error check
+		{
+			RTX_Exception::handleError("CPU renderer needs at least 2 samples for a variance, and no more than the maximum.", false);
+			return;
+		}
+		minSamples = _minSamples;
+		maxSamples = _maxSamples;
+		convergedTileCount = 0;
+	}
+	void RTX_CPURenderer::setSampleBudget(uint64_t _rays)
+	{
+		sampleBudget = _rays;
+	}
+	void RTX_CPURenderer::setHitSorting(bool _value)
+	{
+		hitSorting = _value;
+	}
+	void RTX_CPURenderer::setSamplerType(SamplerType _type)
+	{
+		if (_type != sampler.getType())
+		{
+			resetAccumulation();
+		}
+		sampler.setType(_type);
+	}
+	void RTX_CPURenderer::setRenderMode(CPURenderMode _mode)
+	{
+		renderMode = _mode;
+	}
+}
@@ -0,0 +1,168 @@
+#ifndef RTX_CPURENDERER_H
+#define RTX_CPURENDERER_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Float3, Ray
+#include "RTX_CPUTLAS.h" // Scene traversal
+#include "RTX_ThreadPool.h" // Tiles
+#include "RTX_RayQueue.h" // Wavefront stages
+#include "RTX_Sampler.h" // Pixel jitter
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	enum CPUHitProgram
+	{
+		CPU_HIT_PROGRAM_CLOSEST_HIT = 0,	///< HitGroup: blends the three colours of its record by the barycentrics.
+		CPU_HIT_PROGRAM_PLANE = 1,			///< PlaneHitGroup: flat colour, darkened when a shadow ray to the light is blocked.
+		CPU_HIT_PROGRAM_SHADOW = 2			///< ShadowHitGroup: only marks the shadow ray as blocked.
+	}; ///< Closest hit shader a hit group record runs.
+
+	enum CPURenderMode
+	{
+		CPU_RENDER_MODE_MEGAKERNEL = 0,	///< Each pixel runs ray generation, traversal and shading in one loop.
+		CPU_RENDER_MODE_WAVEFRONT = 1	///< Each stage runs over a whole tile at once, passing structure of arrays queues to the next.
+	}; ///< How a tile is traced.
+
+	struct CPUHitGroupRecord
+	{
+		CPUHitProgram program = CPU_HIT_PROGRAM_CLOSEST_HIT;	///< Shader of the record.
+		Float3 colors[3] = {};									///< Root data of HitGroup records, the A, B and C colours of the instance constant buffer.
+	}; ///< CPU copy of one hit group record of the shader binding table.
+
+	struct AccumulatedPixel
+	{
+		float mean[3];	///< Running mean of the RGB samples, not clamped.
+		float m2;		///< Sum of squared luminance differences from the mean, Welford's M2.
+	}; ///< Float32 accumulation of one pixel, 16 bytes.
+
+	struct AccumulatedTile
+	{
+		uint32_t sampleCount = 0;	///< Samples accumulated in every pixel of the tile.
+		uint32_t passes = 0;		///< Samples per pixel the tile gets in the current render.
+		double credit = 0.0;		///< Share of the budget not spent yet, in samples per pixel, so small shares add up over frames.
+		double squaredErrors = 0.0;	///< Sum of the squared standard errors of the tile's pixel means.
+	}; ///< Sampling state of one tile.
+
+	struct ShadingStats
+	{
+		uint64_t shadedHits = 0;	///< Hits run through the shading stages.
+		double sortTimeMs = 0.0;	///< Time spent binning hits by hit group, summed over the threads.
+		double shadeTimeMs = 0.0;	///< Time spent in the shading stages, summed over the threads.
+	}; ///< Cost of the wavefront shading stages.
+
+	struct WavefrontQueues
+	{
+		RayQueue primary;				///< Camera rays, filled by generate, one per sample slot.
+		RayQueue shadow;				///< Rays to the light, filled by the PlaneHitGroup stage.
+		HitQueue closestHits;			///< Hits for HitGroup records.
+		HitQueue planeHits;				///< Hits for PlaneHitGroup records.
+		std::vector<uint32_t> misses;	///< Sample slots of the primary rays that left the scene.
+		std::vector<Float3> radiance;	///< Colour of every sample slot, pass by pass then pixel by pixel.
+		HitQueue sortedHits;			///< Destination of the hit sort, swapped with the queue it sorted.
+		std::vector<uint32_t> binOffsets; ///< First entry of every hit group in the sorted queue.
+		ShadingStats stats;				///< Shading cost of this thread.
+	}; ///< Queues of one thread for the wavefront stages, reused from tile to tile.
+
+	/**
+	*	\brief The class responsible for rendering a frame on the CPU, for machines without a raytracing GPU.
+	*
+	*	Runs the ray generation, miss and hit programs of the DXR pipeline as C++ over an RTX_CPUTLAS.
+	*	Hit groups are looked up by the same record index the shader binding table uses, so instances
+	*	shade the same way on both backends. The image is split in square tiles handed out to the thread
+	*	pool, every tile writes its own pixels of an RGBA8 buffer laid out like the DXR output resource.
+	*
+	*	Every render adds jittered samples to a float32 accumulation buffer holding the running mean and
+	*	variance of each pixel, and the RGBA8 output shows the mean. Samples are handed out per tile within
+	*	a fixed ray budget per render: tiles whose RMS standard error is under the error threshold get no
+	*	more samples, the others share the budget by their error, so flat sky and floor tiles stop early and
+	*	edges and shadow borders get the rays. Once every tile converged render stops tracing until the
+	*	camera, the scene or the settings change.
+	*
+	*	In wavefront mode a tile goes through separate stages instead: generate fills a queue with every
+	*	camera ray of the tile, extend traces it 8 rays at a time and sorts the hits by the program of
+	*	their record, each shading stage then loops over the hits of one program only, and connect traces
+	*	the shadow rays the PlaneHitGroup stage queued. Every queue is structure of arrays, so each stage
+	*	is a short loop over contiguous data rather than one loop branching on every ray. With hit sorting
+	*	on, the hits of each program are binned by hit group index before shading, so every record is
+	*	read once per run of hits and its shader works through them back to back.
+	*/
+	class RTX_CPURenderer
+	{
+	private:
+		std::vector<CPUHitGroupRecord> hitGroups; ///< Records in shader binding table order.
+		std::vector<uint8_t> output; ///< RGBA8 pixels, rows top to bottom.
+		std::vector<AccumulatedPixel> accumulation; ///< Mean and variance of every pixel over the samples so far.
+		std::vector<AccumulatedTile> tiles; ///< Sample count and error of every tile, rows of tiles top to bottom.
+		uint32_t convergedTileCount = 0; ///< Tiles that get no more samples.
+		uint64_t sampleCount = 0; ///< Primary samples traced since the last reset, over every pixel.
+		float error = FLT_MAX; ///< RMS standard error of the pixel luminances after the last render.
+		float errorThreshold = 0.002f; ///< Error under which a tile is converged, half an 8 bit step by default.
+		uint32_t minSamples = 4; ///< Samples every pixel gets before its error is trusted, the variance of a few samples is too noisy.
+		uint32_t maxSamples = 1024; ///< Samples after which a tile counts as converged whatever its error.
+		uint64_t sampleBudget = 0; ///< Primary rays per render, 0 = one per pixel.
+		CPURenderMode renderMode = CPU_RENDER_MODE_MEGAKERNEL; ///< How tiles are traced.
+		RTX_Sampler sampler; ///< Position of every sample in its pixel.
+		bool hitSorting = false; ///< Wavefront hits are binned by hit group before shading. Off by default, the sample shaders are too cheap for the sort to pay.
+		std::vector<WavefrontQueues> threadQueues; ///< Wavefront queues of each pool thread, indexed by getCurrentThreadIndex.
+		float viewInverse[16] = {}; ///< Inverse view matrix, row major as stored by updateCameraBuffer.
+		float projectionInverse[16] = {}; ///< Inverse projection matrix.
+		uint32_t width = 0; ///< Image width in pixels.
+		uint32_t height = 0; ///< Image height in pixels.
+		bool shadowsEnabled = false; ///< PlaneHitGroup traces shadow rays, like the pipeline with the shadow shader.
+		Float3 lightPosition = { 2.0f, 2.0f, -2.0f }; ///< Point light the shadow rays go to.
+		Float3 planeColor = { 0.7f, 0.7f, 0.3f }; ///< Colour of PlaneHitGroup surfaces.
+		float shadowFactor = 0.3f; ///< Light left in shadow.
+
+		static const uint32_t tileSize = 16; ///< Tiles are 16x16 pixels, small enough to balance and big enough to keep rays coherent.
+		static const uint32_t shadowInclusionMask = 0x02; ///< INSTANCE_MASK_SHADOW, decorative instances cast no shadow.
+
+		Ray rayGeneration(float _x, float _y) const; ///< Primary ray through a point of the image, in pixels, same maths as the RayGen shader.
+		Float3 miss(uint32_t _y) const; ///< Background gradient of the Miss shader.
+		Float3 closestHit(const RTX_CPUTLAS& _tlas, const Ray& _ray, const TLASHit& _hit) const; ///< Runs the closest hit program of the hit group record the hit selected.
+		int renderTile(const RTX_CPUTLAS& _tlas, uint32_t _tile, WavefrontQueues& _queues); ///< Adds the passes of one tile to its pixels.
+		int resolveTile(uint32_t _tile); ///< Writes the means of a tile to the output and sums its error.
+		int generate(uint32_t _tile, WavefrontQueues& _queues) const; ///< Wavefront stage: a camera ray for every pass and pixel of the tile.
+		int extend(const RTX_CPUTLAS& _tlas, uint32_t _tile, WavefrontQueues& _queues) const; ///< Wavefront stage: traces the camera rays and queues the hits by hit program.
+		int sortHits(HitQueue& _hits, WavefrontQueues& _queues) const; ///< Counting sort of a hit queue by hit group index, stable.
+		int shadeClosestHits(WavefrontQueues& _queues) const; ///< Wavefront stage: HitGroup records.
+		int shadePlaneHits(WavefrontQueues& _queues) const; ///< Wavefront stage: PlaneHitGroup records, queues their shadow rays.
+		int connect(const RTX_CPUTLAS& _tlas, WavefrontQueues& _queues) const; ///< Wavefront stage: traces the shadow rays and darkens the blocked samples.
+		int allocateSamples(); ///< Hands the budget of one render out to the tiles that are not converged.
+		uint32_t getTilePixelCount(uint32_t _tile) const; ///< Tiles on the right and bottom edges can be cut short.
+		bool isTileConverged(uint32_t _tile) const;
+
+	public:
+		int render(const RTX_CPUTLAS& _tlas, RTX_ThreadPool& _pool); ///< Spends one sample budget on the tiles that are not converged, tiles spread over the pool. Does nothing once converged.
+		uint64_t renderUntilConverged(const RTX_CPUTLAS& _tlas, RTX_ThreadPool& _pool); ///< Renders until every tile converges or hits the sample cap, for stills. Returns the samples taken.
+		int resetAccumulation(); ///< Drops every sample, the next render starts over.
+		bool isConverged() const; ///< True when render would not trace anything.
+		int printShadingStats(); ///< Writes the wavefront shading throughput to the console.
+		int resetShadingStats();
+
+		/*GETTERS*/
+		const std::vector<uint8_t>& getOutput() const; ///< RGBA8 image of the last render, width * height * 4 bytes.
+		uint32_t getWidth() const;
+		uint32_t getHeight() const;
+		const std::vector<AccumulatedPixel>& getAccumulation() const; ///< HDR mean of every pixel, before the 8 bit conversion.
+		uint64_t getSampleCount() const; ///< Primary samples traced since the last reset, over every pixel.
+		uint32_t getConvergedTileCount() const;
+		uint32_t getTileCount() const;
+		ShadingStats getShadingStats() const; ///< Summed over the threads since the last resetShadingStats.
+		float getError() const; ///< RMS standard error of the pixel luminances, FLT_MAX before enough samples.
+		/*SETTERS*/
+		void setOutputSize(uint32_t _width, uint32_t _height); ///< Reallocates the output, accumulation and tiles, a new size restarts the accumulation.
+		void setCamera(const float _viewInverse[16], const float _projectionInverse[16]); ///< Inverse matrices of the camera buffer, a different camera restarts the accumulation.
+		void setHitGroups(const std::vector<CPUHitGroupRecord>& _hitGroups); ///< Records in the order of the shader binding table, call resetAccumulation after changing them.
+		void setShadowsEnabled(bool _value);
+		void setLightPosition(const Float3& _position);
+		void setErrorThreshold(float _value); ///< RMS standard error to converge to, in luminance where 1 is white.
+		void setSampleLimits(uint32_t _minSamples, uint32_t _maxSamples); ///< Samples per pixel before convergence is checked and after which a tile stops anyway.
+		void setSampleBudget(uint64_t _rays); ///< Primary rays per render, 0 = one per pixel.
+		void setHitSorting(bool _value); ///< Only changes the speed of the wavefront mode, the image stays the same. Pays once shaders cost more than the sort.
+		void setSamplerType(SamplerType _type); ///< Restarts the accumulation.
+		void setRenderMode(CPURenderMode _mode); ///< Both modes trace the same rays, wavefront pays off with AVX2 packets. Packet tests can round hits on triangle edges differently.
+	};
+}
+#endif // !RTX_CPURENDERER_H
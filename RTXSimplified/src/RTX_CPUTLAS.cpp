@@ -0,0 +1,655 @@
+#include "RTX_CPUTLAS.h"
+#include <algorithm> // std::nth_element
+#include <string.h> // memcpy, memcmp
+#include <chrono> // update timings
+#include <math.h> // nextafterf
+
+namespace RTXSimplified
+{
+	int RTX_CPUTLAS::addInstance(const RTX_CPUBVH* _binary, const RTX_BVH8* _wide, const RTX_BVH8Compressed* _compressed, const float _transform[12], uint32_t _instanceID, uint32_t _hitGroupIndex, uint32_t _mask, uint32_t _flags)
+	{
+		if (_binary == nullptr) // Error check
+		{
+			RTX_Exception::handleError("Trying to add a CPU instance without a BLAS.", true);
+		}
+		if (_mask > 0xFF) // Error check
+		{
+			RTX_Exception::handleError("Instance mask only has 8 bits, the upper ones are dropped.", false);
+		}
+
+		CPUInstance instance;
+		instance.binary = _binary;
+		instance.wide = _wide;
+		instance.compressed = _compressed;
+		memcpy(instance.transform, _transform, sizeof(instance.transform));
+		instance.instanceID = _instanceID;
+		instance.hitGroupIndex = _hitGroupIndex;
+		instance.mask = _mask & 0xFF;
+		instance.flags = _flags;
+		instances.push_back(instance);
+		dirtyFlags.push_back(0);
+
+		uint32_t index = static_cast<uint32_t>(instances.size() - 1);
+		dirtyFlags[index] = 1;
+		dirtyInstances.push_back(index);
+		rebuildNeeded = true;
+		return 0;
+	}
+
+	int RTX_CPUTLAS::setTransform(uint32_t _instance, const float _transform[12])
+	{
+		if (_instance >= instances.size()) // Error check
+		{
+			RTX_Exception::handleError("Trying to move a CPU instance that does not exist.", false);
+			return 1;
+		}
+		memcpy(instances[_instance].transform, _transform, sizeof(instances[_instance].transform));
+		if (!dirtyFlags[_instance]) // Only queue it once per update
+		{
+			dirtyFlags[_instance] = 1;
+			dirtyInstances.push_back(_instance);
+		}
+		return 0;
+	}
+
+	int RTX_CPUTLAS::setMask(uint32_t _instance, uint32_t _mask)
+	{
+		if (_instance >= instances.size()) // Error check
+		{
+			RTX_Exception::handleError("Trying to change the mask of a CPU instance that does not exist.", false);
+			return 1;
+		}
+		instances[_instance].mask = _mask & 0xFF;
+		if (!dirtyFlags[_instance]) // Node masks above it follow on the next refit
+		{
+			dirtyFlags[_instance] = 1;
+			dirtyInstances.push_back(_instance);
+		}
+		return 0;
+	}
+
+	int RTX_CPUTLAS::setFlags(uint32_t _instance, uint32_t _flags)
+	{
+		if (_instance >= instances.size()) // Error check
+		{
+			RTX_Exception::handleError("Trying to change the flags of a CPU instance that does not exist.", false);
+			return 1;
+		}
+		instances[_instance].flags = _flags; // Read at hit time, the tree does not change
+		return 0;
+	}
+
+	void RTX_CPUTLAS::updateInstance(uint32_t _instance)
+	{
+		CPUInstance& instance = instances[_instance];
+		const float* m = instance.transform;
+
+		// Inverse of the 3x3 part through its cofactors, the translation follows from it
+		float c00 = m[5] * m[10] - m[6] * m[9], c01 = m[6] * m[8] - m[4] * m[10], c02 = m[4] * m[9] - m[5] * m[8];
+		float determinant = m[0] * c00 + m[1] * c01 + m[2] * c02;
+		if (fabsf(determinant) < 1e-20f) // Error check
+		{
+			RTX_Exception::handleError("CPU instance transform can not be inverted.", false);
+			determinant = 1e-20f;
+		}
+		float inverseDeterminant = 1.0f / determinant;
+		float inverse[3][3] = {
+			{ c00 * inverseDeterminant, (m[2] * m[9] - m[1] * m[10]) * inverseDeterminant, (m[1] * m[6] - m[2] * m[5]) * inverseDeterminant },
+			{ c01 * inverseDeterminant, (m[0] * m[10] - m[2] * m[8]) * inverseDeterminant, (m[2] * m[4] - m[0] * m[6]) * inverseDeterminant },
+			{ c02 * inverseDeterminant, (m[1] * m[8] - m[0] * m[9]) * inverseDeterminant, (m[0] * m[5] - m[1] * m[4]) * inverseDeterminant } };
+		for (int column = 0; column < 3; column++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				instance.inverseColumns[column][row] = inverse[row][column];
+			}
+			instance.inverseColumns[column][3] = 0.0f;
+		}
+		for (int row = 0; row < 3; row++)
+		{
+			instance.inverseColumns[3][row] = -(inverse[row][0] * m[3] + inverse[row][1] * m[7] + inverse[row][2] * m[11]);
+		}
+		instance.inverseColumns[3][3] = 1.0f;
+		for (int row = 0; row < 3; row++)
+		{
+			for (int column = 0; column < 4; column++)
+			{
+				instance.inverse[row * 4 + column] = instance.inverseColumns[column][row];
+			}
+		}
+
+		// World bounds from the 8 corners of the BLAS bounds
+		AABB local = instance.binary->getBounds();
+		instance.worldBounds = AABB();
+		for (int corner = 0; corner < 8; corner++)
+		{
+			Float3 p = { (corner & 1) ? local.max.x : local.min.x, (corner & 2) ? local.max.y : local.min.y, (corner & 4) ? local.max.z : local.min.z };
+			instance.worldBounds.grow(Float3{
+				m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3],
+				m[4] * p.x + m[5] * p.y + m[6] * p.z + m[7],
+				m[8] * p.x + m[9] * p.y + m[10] * p.z + m[11] });
+		}
+	}
+
+	void RTX_CPUTLAS::buildNode(uint32_t _nodeIndex, uint32_t _parent, uint32_t _first, uint32_t _count)
+	{
+		AABB bounds, centroidBounds;
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < _count; i++)
+		{
+			const AABB& box = instances[instanceOrder[_first + i]].worldBounds;
+			bounds.grow(box);
+			centroidBounds.grow((box.min + box.max) * 0.5f);
+			mask |= instances[instanceOrder[_first + i]].mask;
+		}
+		nodes[_nodeIndex].aabbMin = bounds.min;
+		nodes[_nodeIndex].aabbMax = bounds.max;
+		nodeMasks[_nodeIndex] = static_cast<uint8_t>(mask);
+		nodeParents[_nodeIndex] = _parent;
+
+		if (_count <= maxLeafSize)
+		{
+			nodes[_nodeIndex].leftFirst = _first;
+			nodes[_nodeIndex].triCount = _count;
+			for (uint32_t i = 0; i < _count; i++)
+			{
+				instanceLeaves[instanceOrder[_first + i]] = _nodeIndex;
+			}
+			weightedArea += bounds.area() * static_cast<float>(_count); // Instances cost as much as a node visit
+			return;
+		}
+		weightedArea += bounds.area();
+
+		Float3 extent = centroidBounds.max - centroidBounds.min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		uint32_t half = _count / 2;
+		std::nth_element(instanceOrder.begin() + _first, instanceOrder.begin() + _first + half, instanceOrder.begin() + _first + _count,
+			[this, axis](uint32_t _a, uint32_t _b)
+		{
+			return instances[_a].worldBounds.min[axis] + instances[_a].worldBounds.max[axis] < instances[_b].worldBounds.min[axis] + instances[_b].worldBounds.max[axis];
+		});
+
+		uint32_t left = static_cast<uint32_t>(nodes.size());
+		nodes.resize(nodes.size() + 2);
+		nodeMasks.resize(nodes.size());
+		nodeParents.resize(nodes.size());
+		nodes[_nodeIndex].leftFirst = left;
+		nodes[_nodeIndex].triCount = 0;
+		buildNode(left, _nodeIndex, _first, half);
+		buildNode(left + 1, _nodeIndex, _first + half, _count - half);
+	}
+
+	bool RTX_CPUTLAS::refitNode(uint32_t _nodeIndex)
+	{
+		BVHNode& node = nodes[_nodeIndex];
+		AABB bounds;
+		uint32_t mask = 0;
+		if (node.triCount > 0)
+		{
+			for (uint32_t i = 0; i < node.triCount; i++)
+			{
+				bounds.grow(instances[instanceOrder[node.leftFirst + i]].worldBounds);
+				mask |= instances[instanceOrder[node.leftFirst + i]].mask;
+			}
+		}
+		else
+		{
+			bounds.grow(nodes[node.leftFirst].aabbMin);
+			bounds.grow(nodes[node.leftFirst].aabbMax);
+			bounds.grow(nodes[node.leftFirst + 1].aabbMin);
+			bounds.grow(nodes[node.leftFirst + 1].aabbMax);
+			mask = nodeMasks[node.leftFirst] | nodeMasks[node.leftFirst + 1];
+		}
+		if (memcmp(&bounds.min, &node.aabbMin, sizeof(Float3)) == 0 && memcmp(&bounds.max, &node.aabbMax, sizeof(Float3)) == 0 && mask == nodeMasks[_nodeIndex]) // Nothing above can change either
+		{
+			return false;
+		}
+
+		AABB previous;
+		previous.grow(node.aabbMin);
+		previous.grow(node.aabbMax);
+		weightedArea += (static_cast<double>(bounds.area()) - previous.area()) * (node.triCount > 0 ? node.triCount : 1);
+		node.aabbMin = bounds.min;
+		node.aabbMax = bounds.max;
+		nodeMasks[_nodeIndex] = static_cast<uint8_t>(mask);
+		return true;
+	}
+
+	void RTX_CPUTLAS::refit()
+	{
+		for (size_t d = 0; d < dirtyInstances.size(); d++)
+		{
+			uint32_t nodeIndex = instanceLeaves[dirtyInstances[d]];
+			while (nodeIndex != UINT32_MAX && refitNode(nodeIndex)) // Stops at the first node the move did not reach, instances moved earlier already went through it
+			{
+				nodeIndex = nodeParents[nodeIndex];
+			}
+		}
+	}
+
+	void RTX_CPUTLAS::rebuild()
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		instanceOrder.resize(instances.size());
+		for (uint32_t i = 0; i < instances.size(); i++)
+		{
+			instanceOrder[i] = i;
+		}
+		nodes.clear();
+		nodeMasks.clear();
+		nodeParents.clear();
+		instanceLeaves.resize(instances.size());
+		weightedArea = 0.0;
+		if (!instances.empty())
+		{
+			nodes.reserve(2 * instances.size());
+			nodes.resize(1);
+			nodeMasks.resize(1);
+			nodeParents.resize(1);
+			buildNode(0, UINT32_MAX, 0, static_cast<uint32_t>(instances.size()));
+		}
+		stats.builtCost = computeCost();
+		stats.currentCost = stats.builtCost;
+		stats.rebuildCount++;
+		stats.rebuildTimeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	float RTX_CPUTLAS::computeCost() const
+	{
+		if (nodes.empty())
+		{
+			return 0.0f;
+		}
+		AABB root;
+		root.grow(nodes[0].aabbMin);
+		root.grow(nodes[0].aabbMax);
+		return root.area() > 0.0f ? static_cast<float>(weightedArea / root.area()) : 0.0f;
+	}
+
+	int RTX_CPUTLAS::update()
+	{
+		if (dirtyInstances.empty() && !rebuildNeeded) // Nothing changed since the last update
+		{
+			return 0;
+		}
+
+		for (size_t d = 0; d < dirtyInstances.size(); d++)
+		{
+			updateInstance(dirtyInstances[d]);
+		}
+
+		if (rebuildNeeded) // Instance count changed
+		{
+			rebuild();
+			rebuildNeeded = false;
+		}
+		else // Same instances, only their bounds or masks changed
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			refit();
+			stats.currentCost = computeCost();
+			stats.refitCount++;
+			stats.refitTimeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			if (getDegradation() > rebuildThreshold) // Instances drifted too far from where the tree was built
+			{
+				rebuild();
+				stats.forcedRebuildCount++;
+			}
+		}
+		for (size_t d = 0; d < dirtyInstances.size(); d++)
+		{
+			dirtyFlags[dirtyInstances[d]] = 0;
+		}
+		dirtyInstances.clear();
+
+		return 0;
+	}
+
+	int RTX_CPUTLAS::clear()
+	{
+		instances.clear();
+		nodes.clear();
+		nodeMasks.clear();
+		nodeParents.clear();
+		instanceLeaves.clear();
+		instanceOrder.clear();
+		dirtyFlags.clear();
+		dirtyInstances.clear();
+		weightedArea = 0.0;
+		rebuildNeeded = true;
+		return 0;
+	}
+
+	void RTX_CPUTLAS::transformRay(const CPUInstance& _instance, const Ray& _ray, Ray& _local)
+	{
+		_local.tMin = _ray.tMin;
+		_local.tMax = _ray.tMax;
+#if defined(RTX_SIMD_SSE2)
+		const __m128 column0 = _mm_load_ps(_instance.inverseColumns[0]), column1 = _mm_load_ps(_instance.inverseColumns[1]);
+		const __m128 column2 = _mm_load_ps(_instance.inverseColumns[2]), column3 = _mm_load_ps(_instance.inverseColumns[3]);
+		__m128 direction = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(_ray.direction.x)), _mm_mul_ps(column1, _mm_set1_ps(_ray.direction.y))), _mm_mul_ps(column2, _mm_set1_ps(_ray.direction.z)));
+		__m128 origin = _mm_add_ps(_mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(_ray.origin.x)), _mm_mul_ps(column1, _mm_set1_ps(_ray.origin.y))), _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(_ray.origin.z)), column3));
+		alignas(16) float values[8];
+		_mm_store_ps(values, origin);
+		_mm_store_ps(values + 4, direction);
+		_local.origin = { values[0], values[1], values[2] };
+		_local.direction = { values[4], values[5], values[6] };
+#else
+		const float (*c)[4] = _instance.inverseColumns;
+		const Float3& o = _ray.origin;
+		const Float3& d = _ray.direction;
+		_local.origin = { c[0][0] * o.x + c[1][0] * o.y + c[2][0] * o.z + c[3][0], c[0][1] * o.x + c[1][1] * o.y + c[2][1] * o.z + c[3][1], c[0][2] * o.x + c[1][2] * o.y + c[2][2] * o.z + c[3][2] };
+		_local.direction = { c[0][0] * d.x + c[1][0] * d.y + c[2][0] * d.z, c[0][1] * d.x + c[1][1] * d.y + c[2][1] * d.z, c[0][2] * d.x + c[1][2] * d.y + c[2][2] * d.z };
+#endif
+	}
+
+	static inline float intersectBox(const Ray& _ray, const Float3& _invDirection, const Float3& _min, const Float3& _max, float _closest)
+	{
+		float tx1 = (_min.x - _ray.origin.x) * _invDirection.x, tx2 = (_max.x - _ray.origin.x) * _invDirection.x;
+		float tmin = minFloat(tx1, tx2), tmax = maxFloat(tx1, tx2);
+		float ty1 = (_min.y - _ray.origin.y) * _invDirection.y, ty2 = (_max.y - _ray.origin.y) * _invDirection.y;
+		tmin = maxFloat(tmin, minFloat(ty1, ty2)), tmax = minFloat(tmax, maxFloat(ty1, ty2));
+		float tz1 = (_min.z - _ray.origin.z) * _invDirection.z, tz2 = (_max.z - _ray.origin.z) * _invDirection.z;
+		tmin = maxFloat(tmin, minFloat(tz1, tz2)), tmax = minFloat(tmax, maxFloat(tz1, tz2));
+		tmin = maxFloat(tmin, _ray.tMin);
+		if (tmax >= tmin && tmin < _closest)
+		{
+			return tmin;
+		}
+		return FLT_MAX;
+	} // Slab test, FLT_MAX on miss
+
+	bool RTX_CPUTLAS::intersect(const Ray& _ray, TLASHit& _hit, uint32_t _rayContribution, uint32_t _geometryMultiplier, uint32_t _instanceInclusionMask) const
+	{
+		if (nodes.empty() || rebuildNeeded) // Error check
+		{
+			return false;
+		}
+
+		Float3 invDirection = { 1.0f / _ray.direction.x, 1.0f / _ray.direction.y, 1.0f / _ray.direction.z };
+		float closest = _ray.tMax;
+		bool found = false;
+
+		uint32_t stack[64]; // Median splits keep the depth at log2 of the instance count
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			uint32_t nodeIndex = stack[--stackSize];
+			const BVHNode& node = nodes[nodeIndex];
+			if ((nodeMasks[nodeIndex] & _instanceInclusionMask) == 0 // Every instance below is masked out, skip it before the box test
+				|| intersectBox(_ray, invDirection, node.aabbMin, node.aabbMax, closest) == FLT_MAX)
+			{
+				continue;
+			}
+			if (node.triCount == 0) // Inner node
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.triCount; i++) // Leaf, trace every instance in it
+			{
+				uint32_t index = instanceOrder[node.leftFirst + i];
+				const CPUInstance& instance = instances[index];
+				if ((instance.mask & _instanceInclusionMask) == 0) // Not visible to this ray
+				{
+					continue;
+				}
+				Ray local;
+				transformRay(instance, _ray, local);
+				local.tMax = closest; // Affine transforms keep t, so the closest hit so far still culls
+
+				RayHit hit;
+				bool hitFound = instance.compressed ? instance.compressed->intersect(local, hit)
+					: instance.wide ? instance.wide->intersect(local, hit)
+					: instance.binary->intersect(local, hit);
+				if (hitFound && hit.t < closest)
+				{
+					closest = hit.t;
+					static_cast<RayHit&>(_hit) = hit;
+					_hit.instanceIndex = index;
+					found = true;
+				}
+			}
+		}
+
+		if (found)
+		{
+			_hit.instanceID = instances[_hit.instanceIndex].instanceID;
+			_hit.hitGroupIndex = getHitGroupIndex(_hit.instanceIndex, _hit.geometryIndex, _rayContribution, _geometryMultiplier);
+		}
+		return found;
+	}
+
+	static inline bool occludedBLAS(const CPUInstance& _instance, const Ray& _local)
+	{
+		return _instance.compressed ? _instance.compressed->occluded(_local)
+			: _instance.wide ? _instance.wide->occluded(_local)
+			: _instance.binary->occluded(_local);
+	} // Any hit through the fastest layout the instance has
+
+	bool RTX_CPUTLAS::hasNonOpaque(uint32_t _instance) const
+	{
+		uint32_t geometryCount = static_cast<uint32_t>(instances[_instance].binary->getGeometryOffsets().size());
+		for (uint32_t g = 0; g < geometryCount; g++)
+		{
+			if (!isOpaque(_instance, g))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool RTX_CPUTLAS::occludedAnyHit(uint32_t _instance, Ray& _local, const AnyHitFunction& _anyHit) const
+	{
+		const CPUInstance& instance = instances[_instance];
+		RayHit hit;
+		while (instance.compressed ? instance.compressed->intersect(_local, hit)
+			: instance.wide ? instance.wide->intersect(_local, hit)
+			: instance.binary->intersect(_local, hit))
+		{
+			if (isOpaque(_instance, hit.geometryIndex) || _anyHit(_instance, hit)) // Opaque hits are accepted without asking
+			{
+				return true;
+			}
+			_local.tMin = nextafterf(hit.t, FLT_MAX); // Ignored, look behind it
+		}
+		return false;
+	}
+
+	bool RTX_CPUTLAS::occluded(const Ray& _ray, uint32_t _instanceInclusionMask, const AnyHitFunction& _anyHit) const
+	{
+		if (nodes.empty() || rebuildNeeded) // Error check
+		{
+			return false;
+		}
+
+		Float3 invDirection = { 1.0f / _ray.direction.x, 1.0f / _ray.direction.y, 1.0f / _ray.direction.z };
+
+		uint32_t stack[64]; // Median splits keep the depth at log2 of the instance count
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			uint32_t nodeIndex = stack[--stackSize];
+			const BVHNode& node = nodes[nodeIndex];
+			if ((nodeMasks[nodeIndex] & _instanceInclusionMask) == 0 // Every instance below is masked out
+				|| intersectBox(_ray, invDirection, node.aabbMin, node.aabbMax, _ray.tMax) == FLT_MAX)
+			{
+				continue;
+			}
+			if (node.triCount == 0) // Inner node, no point ordering the children when any hit will do
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.triCount; i++) // Leaf, stop at the first instance that blocks the ray
+			{
+				uint32_t index = instanceOrder[node.leftFirst + i];
+				const CPUInstance& instance = instances[index];
+				if ((instance.mask & _instanceInclusionMask) == 0) // Not visible to this ray
+				{
+					continue;
+				}
+				Ray local;
+				transformRay(instance, _ray, local);
+				bool blocked = _anyHit && hasNonOpaque(index) ? occludedAnyHit(index, local, _anyHit) : occludedBLAS(instance, local);
+				if (blocked)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	uint32_t RTX_CPUTLAS::occluded(const Ray* _rays, uint32_t _count, uint8_t* _occluded, uint32_t _instanceInclusionMask, const AnyHitFunction& _anyHit) const
+	{
+		uint32_t blockedCount = 0;
+		for (uint32_t r = 0; r < _count; r++)
+		{
+			_occluded[r] = occluded(_rays[r], _instanceInclusionMask, _anyHit) ? 1 : 0;
+			blockedCount += _occluded[r];
+		}
+		return blockedCount;
+	}
+
+	template <bool anyHit>
+	static uint32_t traverseInstances(const std::vector<BVHNode>& _nodes, const std::vector<uint8_t>& _nodeMasks, const std::vector<uint32_t>& _instanceOrder,
+		const std::vector<CPUInstance>& _instances, const RayPacket& _packet, RayPacketHit* _hit, uint32_t _occludedMask, uint32_t _instanceInclusionMask)
+	{
+		RayPacket packet = _packet;
+		float closest[packetWidth];
+		for (uint32_t lane = 0; lane < packetWidth; lane++)
+		{
+			closest[lane] = _hit ? _hit->t[lane] : FLT_MAX;
+		}
+		packet.activeMask &= ~_occludedMask;
+		uint32_t hitLanes = anyHit ? _occludedMask : 0;
+
+		uint32_t stack[64]; // Median splits keep the depth at log2 of the instance count
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0 && packet.activeMask != 0)
+		{
+			uint32_t nodeIndex = stack[--stackSize];
+			if ((_nodeMasks[nodeIndex] & _instanceInclusionMask) == 0) // Every instance below is masked out
+			{
+				continue;
+			}
+			const BVHNode& node = _nodes[nodeIndex];
+			AABB bounds;
+			bounds.min = node.aabbMin;
+			bounds.max = node.aabbMax;
+			if (RTX_PacketTraversal::intersectBounds(packet, bounds, closest) == 0) // No lane reaches this part of the scene
+			{
+				continue;
+			}
+			if (node.triCount == 0) // Inner node
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
+				continue;
+			}
+
+			for (uint32_t i = 0; i < node.triCount && packet.activeMask != 0; i++) // Leaf, trace the packet through every instance in it
+			{
+				uint32_t index = _instanceOrder[node.leftFirst + i];
+				if ((_instances[index].mask & _instanceInclusionMask) == 0) // Not visible to these rays
+				{
+					continue;
+				}
+				RayPacket local = RTX_PacketTraversal::transform(packet, _instances[index].inverse);
+				if (anyHit)
+				{
+					uint32_t blocked = RTX_PacketTraversal::occluded(*_instances[index].binary, local, hitLanes);
+					hitLanes |= blocked;
+					packet.activeMask &= ~blocked; // Blocked lanes are done
+					continue;
+				}
+				uint32_t closer = RTX_PacketTraversal::intersect(*_instances[index].binary, local, *_hit);
+				for (uint32_t lane = 0; lane < packetWidth; lane++)
+				{
+					if (closer & (1u << lane))
+					{
+						_hit->instanceIndex[lane] = index;
+						closest[lane] = _hit->t[lane];
+					}
+				}
+				hitLanes |= closer;
+			}
+		}
+		return hitLanes;
+	} // Walks the top level tree with a packet, tracing it through every instance it reaches
+
+	uint32_t RTX_CPUTLAS::intersect(const RayPacket& _packet, RayPacketHit& _hit, uint32_t _instanceInclusionMask) const
+	{
+		if (nodes.empty() || rebuildNeeded)
+		{
+			return 0;
+		}
+		return traverseInstances<false>(nodes, nodeMasks, instanceOrder, instances, _packet, &_hit, 0, _instanceInclusionMask);
+	}
+
+	uint32_t RTX_CPUTLAS::occluded(const RayPacket& _packet, uint32_t _occludedMask, uint32_t _instanceInclusionMask) const
+	{
+		if (nodes.empty() || rebuildNeeded)
+		{
+			return _occludedMask;
+		}
+		return traverseInstances<true>(nodes, nodeMasks, instanceOrder, instances, _packet, nullptr, _occludedMask, _instanceInclusionMask);
+	}
+
+	uint32_t RTX_CPUTLAS::getHitGroupIndex(uint32_t _instance, uint32_t _geometryIndex, uint32_t _rayContribution, uint32_t _geometryMultiplier) const
+	{
+		return _rayContribution + _geometryMultiplier * _geometryIndex + instances[_instance].hitGroupIndex;
+	}
+
+	bool RTX_CPUTLAS::isOpaque(uint32_t _instance, uint32_t _geometryIndex) const
+	{
+		const CPUInstance& instance = instances[_instance];
+		if (instance.flags & CPU_INSTANCE_FLAG_FORCE_OPAQUE) // Instance overrides win over the geometry flag, like on the GPU
+		{
+			return true;
+		}
+		if (instance.flags & CPU_INSTANCE_FLAG_FORCE_NON_OPAQUE)
+		{
+			return false;
+		}
+		return instance.binary->getGeometryOpaque(_geometryIndex);
+	}
+
+	uint32_t RTX_CPUTLAS::getInstanceCount() const
+	{
+		return static_cast<uint32_t>(instances.size());
+	}
+	const CPUInstance& RTX_CPUTLAS::getInstance(uint32_t _instance) const
+	{
+		return instances[_instance];
+	}
+	bool RTX_CPUTLAS::isDirty() const
+	{
+		return rebuildNeeded || !dirtyInstances.empty();
+	}
+	const TLASUpdateStats& RTX_CPUTLAS::getUpdateStats() const
+	{
+		return stats;
+	}
+	float RTX_CPUTLAS::getDegradation() const
+	{
+		return stats.builtCost > 0.0f ? stats.currentCost / stats.builtCost : 1.0f;
+	}
+	void RTX_CPUTLAS::setRebuildThreshold(float _threshold)
+	{
+		if (_threshold < 1.0f) // Error check
+		{
+			RTX_Exception::handleError("TLAS rebuild threshold below 1 would rebuild on every update.", false);
+		}
+		rebuildThreshold = _threshold;
+	}
+}
@@ -0,0 +1,156 @@
+#ifndef RTX_CPUTLAS_H
+#define RTX_CPUTLAS_H
+
+#include <vector> // std::vector
+#include <functional> // any hit callbacks
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Ray, RayHit, AABB
+#include "RTX_CPUBVH.h" // Binary BLAS
+#include "RTX_BVH8.h" // 8 wide BLAS
+#include "RTX_BVH8Compressed.h" // Quantized 8 wide BLAS
+#include "RTX_PacketTraversal.h" // Ray packets
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	enum CPUInstanceFlags
+	{
+		CPU_INSTANCE_FLAG_NONE = 0x0,								///< Geometry flags decide.
+		CPU_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE = 0x1,				///< Back faces are never culled.
+		CPU_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE = 0x2,	///< Counter clockwise triangles face the ray.
+		CPU_INSTANCE_FLAG_FORCE_OPAQUE = 0x4,						///< Every geometry is opaque, any hit work is skipped.
+		CPU_INSTANCE_FLAG_FORCE_NON_OPAQUE = 0x8					///< Every geometry runs any hit work.
+	}; ///< Same bits as D3D12_RAYTRACING_INSTANCE_FLAGS, so they can be copied across.
+
+	struct CPUInstance
+	{
+		const RTX_CPUBVH* binary = nullptr;				///< Binary BLAS, used by packets and as the fallback.
+		const RTX_BVH8* wide = nullptr;					///< 8 wide BLAS, preferred for single rays.
+		const RTX_BVH8Compressed* compressed = nullptr;	///< Quantized BLAS, preferred when present.
+		float transform[12];							///< Object to world, 3x4 row major like D3D12_RAYTRACING_INSTANCE_DESC::Transform.
+		alignas(16) float inverseColumns[4][4];			///< World to object, stored by column so a ray is transformed with 3 SIMD multiply adds.
+		float inverse[12];								///< World to object, 3x4 row major, used to move packets.
+		AABB worldBounds;								///< BLAS bounds moved to world space.
+		uint32_t instanceID = 0;						///< InstanceID() seen by the hit shaders.
+		uint32_t hitGroupIndex = 0;						///< InstanceContributionToHitGroupIndex.
+		uint32_t mask = 0xFF;							///< InstanceMask, skipped by rays whose inclusion mask shares no bit with it.
+		uint32_t flags = CPU_INSTANCE_FLAG_NONE;		///< CPUInstanceFlags.
+	}; ///< One instance of the CPU TLAS.
+
+	struct TLASUpdateStats
+	{
+		uint32_t rebuildCount = 0;			///< Full builds, the forced ones included.
+		uint32_t forcedRebuildCount = 0;	///< Rebuilds scheduled because refits had degraded the tree past the threshold.
+		uint32_t refitCount = 0;			///< Updates that kept the tree shape.
+		double rebuildTimeMs = 0.0;			///< Time spent in every rebuild.
+		double refitTimeMs = 0.0;			///< Time spent in every refit.
+		float builtCost = 0.0f;				///< SAH cost right after the last rebuild, relative to the root area.
+		float currentCost = 0.0f;			///< SAH cost after the last update, kept current by the refits without a pass over the tree.
+	}; ///< How a TLAS has been kept up to date. Refits are cheap but the tree gets worse as instances move away from where it was built.
+
+	struct TLASHit : RayHit
+	{
+		uint32_t instanceIndex = UINT32_MAX;	///< Instance that was hit, InstanceIndex() in HLSL.
+		uint32_t instanceID = 0;				///< InstanceID() in HLSL.
+		uint32_t hitGroupIndex = 0;				///< Hit group record the shader binding table would run.
+	}; ///< Closest hit of a ray through the whole scene.
+
+	typedef std::function<bool(uint32_t _instance, const RayHit& _hit)> AnyHitFunction; ///< Runs for hits on non opaque geometry, returns false to ignore the hit like IgnoreHit() in an any hit shader.
+
+	/**
+	*	\brief The class responsible for tracing rays through the instances of a scene on the CPU.
+	*
+	*	Mirrors RTX_TLAS: every instance points to a CPU BLAS with a 3x4 transform, an ID and a hit group
+	*	index. A small BVH over the world bounds of the instances is traversed first, rays are moved into
+	*	the space of each instance they reach and traced through its BLAS. Inverse transforms and world
+	*	bounds are recomputed once per update, for the instances that changed, never per ray.
+	*	Moved instances are refitted from their leaf up to the first node whose bounds hold, and the SAH
+	*	cost of the tree is kept current from the area changes of those nodes, so an update costs as much
+	*	as the instances that moved. Once the cost grows past the rebuild threshold, relative to the cost
+	*	the tree had when it was built, the tree is rebuilt instead.
+	*/
+	class RTX_CPUTLAS
+	{
+	private:
+		std::vector<CPUInstance> instances; ///< Instances, in the same order as the GPU TLAS.
+		std::vector<BVHNode> nodes; ///< Top level tree, leaves index instanceOrder.
+		std::vector<uint32_t> nodeParents; ///< Parent of each node, UINT32_MAX for the root, so refits walk up from the leaves that moved.
+		std::vector<uint32_t> instanceLeaves; ///< Leaf holding each instance.
+		std::vector<uint8_t> nodeMasks; ///< OR of the instance masks under each node, so masked out subtrees are skipped whole.
+		std::vector<uint32_t> instanceOrder; ///< Instances reordered so every leaf is a contiguous range.
+		std::vector<uint8_t> dirtyFlags; ///< 1 for each instance whose inverse, bounds or mask have not reached the tree yet.
+		std::vector<uint32_t> dirtyInstances; ///< Indices of the dirty instances.
+		bool rebuildNeeded = true; ///< Instances were added, the tree has to be rebuilt rather than refitted.
+		double weightedArea = 0.0; ///< Node areas weighted by their SAH cost, summed while building and moved by every refitted node.
+		float rebuildThreshold = 1.5f; ///< Degradation that triggers a rebuild, currentCost / builtCost.
+		TLASUpdateStats stats; ///< Rebuild and refit counts and costs.
+
+		static const uint32_t maxLeafSize = 2; ///< Instances per top level leaf.
+
+		void updateInstance(uint32_t _instance); ///< Recomputes the inverse transform and world bounds.
+		void buildNode(uint32_t _nodeIndex, uint32_t _parent, uint32_t _first, uint32_t _count); ///< Median split on the longest axis of the centroids.
+		void rebuild(); ///< Builds the tree again over the current world bounds.
+		void refit(); ///< Walks up from the leaves of the dirty instances, the tree shape is kept.
+		bool refitNode(uint32_t _nodeIndex); ///< Recomputes the bounds and mask of one node from its children, returns false if neither changed.
+		float computeCost() const; ///< SAH cost of the tree relative to the root area, from the running weighted area.
+		static void transformRay(const CPUInstance& _instance, const Ray& _ray, Ray& _local); ///< Moves a ray into instance space.
+		bool hasNonOpaque(uint32_t _instance) const; ///< True if any geometry of the instance runs any hit work after the overrides.
+		bool occludedAnyHit(uint32_t _instance, Ray& _local, const AnyHitFunction& _anyHit) const; ///< Walks the hits of one instance front to back until one is accepted.
+
+	public:
+		int addInstance(
+			const RTX_CPUBVH* _binary,					///< Binary BLAS, required.
+			const RTX_BVH8* _wide,						///< 8 wide BLAS, can be null.
+			const RTX_BVH8Compressed* _compressed,		///< Quantized BLAS, can be null.
+			const float _transform[12],					///< Object to world 3x4 matrix.
+			uint32_t _instanceID,						///< Instance ID visible in the shader.
+			uint32_t _hitGroupIndex,					///< Hit group index.
+			uint32_t _mask = 0xFF,						///< Visibility mask.
+			uint32_t _flags = CPU_INSTANCE_FLAG_NONE	///< CPUInstanceFlags.
+		); ///< Adds an instance, the tree is rebuilt on the next update.
+		int setTransform(uint32_t _instance, const float _transform[12]); ///< Moves an instance, it is refitted on the next update.
+		int setMask(uint32_t _instance, uint32_t _mask); ///< Changes which rays see an instance, node masks follow on the next update.
+		int setFlags(uint32_t _instance, uint32_t _flags); ///< Changes the culling and opacity overrides of an instance.
+		int update(); ///< Rebuilds or refits the tree and the inverse transforms of the instances that changed.
+		int clear(); ///< Removes every instance.
+
+		bool intersect(
+			const Ray& _ray,						///< World space ray.
+			TLASHit& _hit,							///< Closest hit.
+			uint32_t _rayContribution = 0,			///< RayContributionToHitGroupIndex passed to TraceRay.
+			uint32_t _geometryMultiplier = 1,		///< MultiplierForGeometryContributionToHitGroupIndex passed to TraceRay.
+			uint32_t _instanceInclusionMask = 0xFF	///< InstanceInclusionMask passed to TraceRay.
+		) const; ///< Finds the closest hit over every instance, returns false on miss.
+		uint32_t intersect(const RayPacket& _packet, RayPacketHit& _hit, uint32_t _instanceInclusionMask = 0xFF) const; ///< Closest hits of a packet, returns the lanes that got a closer hit.
+		uint32_t occluded(const RayPacket& _packet, uint32_t _occludedMask = 0, uint32_t _instanceInclusionMask = 0xFF) const; ///< Blocked lanes of a shadow packet.
+		bool occluded(
+			const Ray& _ray,						///< World space shadow ray, tMax is the distance to the light.
+			uint32_t _instanceInclusionMask = 0xFF,	///< InstanceInclusionMask passed to TraceRay.
+			const AnyHitFunction& _anyHit = nullptr	///< Filter for non opaque geometry, without one every hit blocks.
+		) const; ///< True if anything blocks the ray. Stops at the first hit and never orders children or instances, hits on opaque geometry are accepted without calling the filter.
+		uint32_t occluded(
+			const Ray* _rays,						///< World space shadow rays.
+			uint32_t _count,						///< Number of rays.
+			uint8_t* _occluded,						///< Written with 1 for every blocked ray, 0 otherwise.
+			uint32_t _instanceInclusionMask = 0xFF,	///< InstanceInclusionMask passed to TraceRay.
+			const AnyHitFunction& _anyHit = nullptr	///< Filter for non opaque geometry.
+		) const; ///< Batch of incoherent shadow rays, returns how many are blocked.
+		uint32_t getHitGroupIndex(
+			uint32_t _instance,						///< Instance that was hit.
+			uint32_t _geometryIndex,				///< Geometry of the BLAS that was hit.
+			uint32_t _rayContribution = 0,			///< RayContributionToHitGroupIndex passed to TraceRay.
+			uint32_t _geometryMultiplier = 1		///< MultiplierForGeometryContributionToHitGroupIndex passed to TraceRay.
+		) const; ///< Hit group record index, same addressing as the GPU: ray + multiplier * geometry + instance contribution.
+		bool isOpaque(uint32_t _instance, uint32_t _geometryIndex) const; ///< Geometry opacity after the instance overrides, decides whether any hit work runs.
+
+		/*GETTERS*/
+		uint32_t getInstanceCount() const;
+		const CPUInstance& getInstance(uint32_t _instance) const;
+		bool isDirty() const; ///< True if update has work to do.
+		const TLASUpdateStats& getUpdateStats() const;
+		float getDegradation() const; ///< SAH cost now against right after the last rebuild, 1 = as good as new.
+		/*SETTERS*/
+		void setRebuildThreshold(float _threshold); ///< Degradation past which a refit turns into a rebuild, 1.5 by default.
+	};
+}
+#endif // !RTX_CPUTLAS_H
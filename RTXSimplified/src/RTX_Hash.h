@@ -0,0 +1,44 @@
+#ifndef RTX_HASH_H
+#define RTX_HASH_H
+
+#include <stdint.h> // uint64_t
+#include <string.h> // memcpy
+
+namespace RTXSimplified
+{
+	inline uint64_t mixHash(uint64_t _value)
+	{
+		// Final mix from MurmurHash3, spreads every input bit over the whole word
+		_value ^= _value >> 33;
+		_value *= 0xff51afd7ed558ccdULL;
+		_value ^= _value >> 33;
+		_value *= 0xc4ceb9fe1a85ec53ULL;
+		_value ^= _value >> 33;
+		return _value;
+	}
+
+	/**
+	*	Fast 64 bit hash of a block of memory, reads 8 bytes per step. Not cryptographic,
+	*	equal hashes still have to be confirmed by comparing the data.
+	*/
+	inline uint64_t hashBytes(const void* _data, size_t _size, uint64_t _seed = 0)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(_data);
+		uint64_t hash = _seed ^ (_size * 0x9e3779b97f4a7c15ULL);
+
+		size_t i = 0;
+		for (; i + 8 <= _size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, bytes + i, 8); // Unaligned safe load
+			hash = (hash ^ mixHash(word)) * 0x9e3779b97f4a7c15ULL;
+		}
+
+		uint64_t tail = 0;
+		memcpy(&tail, bytes + i, _size - i); // Remaining 0 to 7 bytes
+		hash ^= mixHash(tail);
+
+		return mixHash(hash);
+	}
+}
+#endif // !RTX_HASH_H
@@ -142,6 +142,10 @@ namespace RTXSimplified
 	{
 		return cameraBufferSize;
 	}
+	std::vector<DirectX::XMMATRIX> RTX_Initializer::getCameraMatrices()
+	{
+		return cameraMatrices;
+	}
 
 	ComPtr<IDXGISwapChain3> RTX_Initializer::getSwapChain()
 	{
@@ -157,6 +161,27 @@ namespace RTXSimplified
 	{
 		return perInstanceConstantBuffers;
 	}
+	std::vector<DirectX::XMFLOAT4> RTX_Initializer::getInstanceColors()
+	{
+		return instanceColors;
+	}
+	std::vector<DirectX::XMFLOAT4> RTX_Initializer::getDefaultInstanceColors()
+	{
+		return {
+			{1.0f, 0.0f, 0.0f, 1.0f},
+			{1.0f, 0.4f, 0.0f, 1.0f},
+			{1.f, 0.7f, 0.0f, 1.0f},
+			{0.0f, 1.0f, 0.0f, 1.0f},
+			{0.0f, 1.0f, 0.4f, 1.0f},
+			{0.0f, 1.0f, 0.7f, 1.0f},
+			{0.0f, 0.0f, 1.0f, 1.0f},
+			{0.4f, 0.0f, 1.0f, 1.0f},
+			{0.7f, 0.0f, 1.0f, 1.0f} };
+	}
+	std::shared_ptr<RTX_UploadRing> RTX_Initializer::getUploadRing()
+	{
+		return uploadRing;
+	}
 #pragma endregion
 
 
@@ -180,6 +205,27 @@ namespace RTXSimplified
 		);
 		RTX_Exception::handleError(&hr, "Failed to create device"); // Error handling
 
+		createUploadRing();
+		return 0;
+	}
+
+	int RTX_Initializer::createUploadRing()
+	{
+		uploadRing = std::make_shared<RTX_UploadRing>([this](UINT64 _size)
+		{
+			ComPtr<ID3D12Resource> buffer;
+			CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+			CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(_size);
+			HRESULT hr = rtxDevice->CreateCommittedResource( // Create the ring
+				&heapProperty,							// in an upload heap
+				D3D12_HEAP_FLAG_NONE,					// no flags
+				&bufferResource,						// this big
+				D3D12_RESOURCE_STATE_GENERIC_READ,		// required state for an upload heap
+				nullptr,								// not a render target
+				IID_PPV_ARGS(&buffer));
+			RTX_Exception::handleError(&hr, "Error creating the upload ring.");
+			return buffer;
+		}, uploadRingSize);
 		return 0;
 	}
 
@@ -235,13 +281,13 @@ namespace RTXSimplified
 	int RTX_Initializer::createCamera()
 	{
 		uint32_t nbMatrix = 4; // Four matrices by default: view, perspective, viewInv, perspectiveInv
-		cameraBufferSize = nbMatrix * sizeof(DirectX::XMMATRIX); // Size = matrix number * size of one matrix
-		cameraBuffer = pipeline->createBuffer(		// Create the constant buffer for all matrices
-			rtxDevice.Get(),						// for this device
-			cameraBufferSize,						// this big
-			D3D12_RESOURCE_FLAG_NONE,				// no flags
-			D3D12_RESOURCE_STATE_GENERIC_READ,		// generic state
-			uploadHeapProperties					// default upload properties
+		cameraBufferSize = static_cast<uint32_t>(ROUND_UP(nbMatrix * sizeof(DirectX::XMMATRIX), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT)); // Size = matrix number * size of one matrix, constant buffers are 256 byte aligned
+		cameraBuffer = pipeline->createBuffer(			// Create the constant buffer for all matrices
+			rtxDevice.Get(),							// for this device
+			cameraBufferSize,							// this big
+			D3D12_RESOURCE_FLAG_NONE,					// no flags
+			D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, // read as a constant buffer
+			defaultHeapProperties						// filled from the upload ring
 		);
 		return 0;
 	}
@@ -559,12 +605,14 @@ namespace RTXSimplified
 		DirectX::XMVECTOR det;
 		matrices[2] = XMMatrixInverse(&det, matrices[0]); // Create view Inverted matrix
 		matrices[3] = XMMatrixInverse(&det, matrices[1]); // Create perspective Inverted matrix
-		// Copy the matrix contents 
-		uint8_t* pData;
-		HRESULT hr = cameraBuffer->Map(0, nullptr, (void**)&pData);
-		RTX_Exception::handleError(&hr, "Error updating camera");
-		memcpy(pData, matrices.data(), cameraBufferSize);
-		cameraBuffer->Unmap(0, nullptr);
+		cameraMatrices = matrices; // Kept for the CPU ray tracing
+		if (!uploadRing) // No device, only the CPU renderer reads the camera
+		{
+			return 0;
+		}
+		// Copy the matrix contents, the frames in flight keep reading the previous ones until the copy
+		UploadAllocation upload = uploadRing->upload(matrices.data(), matrices.size() * sizeof(DirectX::XMMATRIX), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		uploadRing->queueCopy(cameraBuffer.Get(), 0, upload, matrices.size() * sizeof(DirectX::XMMATRIX));
 
 		return 0;
 	}
@@ -586,30 +634,19 @@ namespace RTXSimplified
 			rtxDevice.Get(),						   // for this device
 			sizeof(bufferData),						   // this big
 			D3D12_RESOURCE_FLAG_NONE,				   // no flags
-			D3D12_RESOURCE_STATE_GENERIC_READ,		   // generic state
-			uploadHeapProperties					   // default upload properties
+			D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, // read as a constant buffer
+			defaultHeapProperties					   // filled from the upload ring
 		);
 		// Copy CPU memory to GPU
-		uint8_t* pData; 
-		HRESULT hr = globalConstantBuffer->Map(0, nullptr, (void**)&pData);
-		memcpy(pData, bufferData, sizeof(bufferData));
-		globalConstantBuffer->Unmap(0, nullptr);
+		UploadAllocation upload = uploadRing->upload(bufferData, sizeof(bufferData), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		uploadRing->queueCopy(globalConstantBuffer.Get(), 0, upload, sizeof(bufferData));
 		return 0;
 	}
 
 	void RTX_Initializer::createPerInstanceConstantBuffers()
 	{
-		// Initialize with 9 default XMVECTOR 4 values because of HLSL packing
-		DirectX::XMVECTOR bufferData[] = {
-			DirectX::XMVECTOR{1.0f, 0.0f, 0.0f, 1.0f},
-			DirectX::XMVECTOR{1.0f, 0.4f, 0.0f, 1.0f},
-			DirectX::XMVECTOR{1.f, 0.7f, 0.0f, 1.0f},
-			DirectX::XMVECTOR{0.0f, 1.0f, 0.0f, 1.0f},
-			DirectX::XMVECTOR{0.0f, 1.0f, 0.4f, 1.0f},
-			DirectX::XMVECTOR{0.0f, 1.0f, 0.7f, 1.0f},
-			DirectX::XMVECTOR{0.0f, 0.0f, 1.0f, 1.0f},
-			DirectX::XMVECTOR{0.4f, 0.0f, 1.0f, 1.0f},
-			DirectX::XMVECTOR{0.7f, 0.0f, 1.0f, 1.0f}, };
+		// Initialize with 9 default 4 float values because of HLSL packing, kept for the CPU renderer
+		instanceColors = getDefaultInstanceColors();
 
 		perInstanceConstantBuffers.resize(3);
 
@@ -617,20 +654,17 @@ namespace RTXSimplified
 
 		for (auto& cb : perInstanceConstantBuffers) // For each buffer
 		{
-			const uint32_t bufferSize = sizeof(DirectX::XMVECTOR) * 3; // Set the size to three vectors
+			const uint32_t bufferSize = sizeof(DirectX::XMFLOAT4) * 3; // Set the size to three vectors
 			cb = pipeline->createBuffer(			// Create the buffer
 				rtxDevice.Get(),					// for this device
 				bufferSize,							// this big
 				D3D12_RESOURCE_FLAG_NONE,			// no flags
-				D3D12_RESOURCE_STATE_GENERIC_READ,	// generic state
-				uploadHeapProperties
+				D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, // read as a constant buffer
+				defaultHeapProperties				// filled from the upload ring
 			);
 			//Copy the data over to the GPU
-			uint8_t* pData;
-			HRESULT hr = (cb->Map(0, nullptr, (void**)&pData));
-			RTX_Exception::handleError(&hr, "Error creating instance buffer");
-			memcpy(pData, &bufferData[i * 3], bufferSize);
-			cb->Unmap(0, nullptr);
+			UploadAllocation upload = uploadRing->upload(&instanceColors[i * 3], bufferSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+			uploadRing->queueCopy(cb.Get(), 0, upload, bufferSize);
 			++i;
 		}
 	}
@@ -8,6 +8,8 @@
 #include <memory> // Smart pointers
 #include "RTX_Pipeline.h" // Pipeline generation
 #include <d3dcompiler.h> // Shader compilation
+#include <DirectXMath.h> // Camera matrices
+#include "RTX_UploadRing.h" // Per-frame uploads
 
 using Microsoft::WRL::ComPtr; ///< Smart pointer for interfaces
 
@@ -54,8 +56,12 @@ namespace RTXSimplified
 		ComPtr<ID3D12Resource> cameraBuffer; ///< Stores the perspective camera.
 		ComPtr<ID3D12DescriptorHeap> constHeap; ///< Stores the heap for the camera.
 		uint32_t cameraBufferSize = 0;	///< Stores the size of the camera buffer.
+		std::vector<DirectX::XMMATRIX> cameraMatrices; ///< CPU copy of the camera buffer: view, perspective and their inverses.
 		ComPtr<ID3D12Resource> globalConstantBuffer; ///< Stores a buffer for all TLAS instances.
 		std::vector<ComPtr<ID3D12Resource>> perInstanceConstantBuffers; ///< Stores a buffer for each tlas instance.
+		std::vector<DirectX::XMFLOAT4> instanceColors; ///< CPU copy of the instance buffers, three colours each.
+		std::shared_ptr<RTX_UploadRing> uploadRing; ///< Persistently mapped memory every per-frame upload goes through.
+		UINT64 uploadRingSize = 32 * 1024 * 1024; ///< Room for a few frames of 100k instance descriptors.
 
 		int createDevice(); ///< Creates the rtx device interface.
 		int getAdapter(IDXGIFactory2* _factory, IDXGIAdapter1** _adapter); ///< Gets the hardware adapter used to create the interface.
@@ -67,6 +73,7 @@ namespace RTXSimplified
 		int createRTOutput(); ///< Creates the buffer to store the raytracing output.
 		int createPipelineState(); ///< Creates the pipeline state, includes compiling fragment and vector shader.
 		int createFence(); ///< Creates the sync object between CPU and GPU.
+		int createUploadRing(); ///< Creates the upload ring, before anything is uploaded.
 
 	public:
 		int createCamera(); ///< Creates the default camera.
@@ -74,7 +81,7 @@ namespace RTXSimplified
 		int createPipeline(); ///< Creates the neccessary components for using DX12 DXR.
 		int createRaytracingPipeline(); ///< Creates RT pipeline.
 		int prepareAssetLoading(); ///< Creates command list and pipeline for accepting assets.
-		int updateCameraBuffer(); ///< Updates the camera position and view direction.
+		int updateCameraBuffer(); ///< Updates the camera position and view direction, copied in by the next command list.
 		int createGlobalConstantBuffer(); ///< Creates the global constant buffers used in SBTs.
 		void createPerInstanceConstantBuffers(); ///< Creates the instance constant buffers used in SBTs.
 
@@ -101,9 +108,13 @@ namespace RTXSimplified
 		ComPtr<ID3D12StateObject> getRTStateObject();
 		ComPtr<ID3D12Resource> getCameraBuffer();
 		uint32_t getCameraBufferSize();
+		std::vector<DirectX::XMMATRIX> getCameraMatrices(); ///< Matrices last written by updateCameraBuffer, empty before the first update.
 		ComPtr<IDXGISwapChain3> getSwapChain();
 		ComPtr<ID3D12Resource> getGlobalConstantBuffer();
 		std::vector<ComPtr<ID3D12Resource>> getInstanceBuffers();
+		std::vector<DirectX::XMFLOAT4> getInstanceColors(); ///< Colours in the instance buffers, three per buffer, for the CPU renderer.
+		static std::vector<DirectX::XMFLOAT4> getDefaultInstanceColors(); ///< Colours the instance buffers are created with, also used by the CPU renderer when there is no device.
+		std::shared_ptr<RTX_UploadRing> getUploadRing();
 
 		/*SETTERS*/
 		void setViewPortHeight(int _height);
@@ -1,4 +1,6 @@
 #include "RTX_Manager.h"
+#include "RTX_Hash.h" // Model content hash
+#include "RTX_VertexWelder.h" // Indexing triangle soups
 #include <iostream>
 namespace RTXSimplified
 {
@@ -45,16 +47,75 @@ namespace RTXSimplified
 
 		return rtn;
 	}
-	int RTX_Manager::addModel(Vertex _vertices[], UINT _verticesAmount)
+	std::shared_ptr<RTX_Manager> RTX_Manager::initializeCPU(int _width, int _height)
+	{
+		// Initialize class structure, without an initializer nothing touches D3D12
+		std::shared_ptr<RTX_Manager> rtn = std::make_shared<RTX_Manager>();
+		rtn->self = rtn;
+		rtn->bvhManager = std::make_shared<RTX_BVHmanager>();
+		rtn->bvhManager->setRTXManager(rtn);
+		rtn->pathTracer = std::make_shared<RTX_PathTracer>();
+		rtn->pathTracer->setRTXManager(rtn);
+		rtn->pathTracer->setBackend(PATH_TRACER_BACKEND_CPU);
+		rtn->hwnd = nullptr;
+		rtn->height = _height;
+		rtn->width = _width;
+
+		rtn->initialized = true;
+
+		return rtn;
+	}
+	int RTX_Manager::addModel(Vertex _vertices[], UINT _verticesAmount, const BLASBuildOptions& _options)
+	{
+		if (_verticesAmount % 3 != 0) // Error check
+		{
+			RTX_Exception::handleError("Model vertex count is not a multiple of 3.", true);
+		}
+
+		// Share the vertices between triangles before uploading
+		std::vector<char> welded;
+		std::vector<uint32_t> indices;
+		UINT uniqueAmount = RTX_VertexWelder::weld(_vertices, _verticesAmount, sizeof(Vertex), weldEpsilon, welded, indices);
+
+		return addModel(reinterpret_cast<const Vertex*>(welded.data()), uniqueAmount, indices.data(), static_cast<UINT>(indices.size()), _options);
+	}
+	int RTX_Manager::addModel(const Vertex* _vertices, UINT _verticesAmount, const uint32_t* _indices, UINT _indicesAmount, const BLASBuildOptions& _options)
+	{
+		/*ERROR CHECKS*/
+		if (_indicesAmount % 3 != 0)
+		{
+			RTX_Exception::handleError("Model index count is not a multiple of 3.", true);
+		}
+		for (UINT i = 0; i < _indicesAmount; i++)
+		{
+			if (_indices[i] >= _verticesAmount)
+			{
+				RTX_Exception::handleError("Model index outside of its vertices.", true);
+			}
+		}
+
+		ComPtr<ID3D12Resource> buffer, indexBuffer;
+		if (initializer) // Without a device the model only lives in its CPU copy
+		{
+			buffer = createUploadBuffer(_vertices, sizeof(Vertex) * static_cast<UINT64>(_verticesAmount));
+			indexBuffer = createUploadBuffer(_indices, sizeof(uint32_t) * static_cast<UINT64>(_indicesAmount));
+		}
+
+		// Add the model to the list
+		Model model(buffer, _verticesAmount, _vertices, indexBuffer, _indicesAmount, _indices);
+		model.buildOptions = _options;
+		models.push_back(model);
+
+		return 0;
+	}
+	ComPtr<ID3D12Resource> RTX_Manager::createUploadBuffer(const void* _data, UINT64 _size)
 	{
 		HRESULT hr; // Error handling.
 
 		ComPtr<ID3D12Resource> buffer;
 
-		const UINT bufferSize = sizeof(_vertices);
-
 		CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
+		CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(_size);
 
 		// Create the resource.
 		hr = initializer->getRTXDevice()->CreateCommittedResource(
@@ -66,21 +127,15 @@ namespace RTXSimplified
 			IID_PPV_ARGS(&buffer));
 		RTX_Exception::handleError(&hr, "Error allocating space for the model.");
 
-		// Copy the triangle data to the vertex buffer.
-		UINT8* vertexDataBegin;
+		// Copy the data to the buffer.
+		UINT8* dataBegin;
 		CD3DX12_RANGE readRange(0, 0); // No need to read the data again.
-		hr = buffer->Map(0, &readRange, reinterpret_cast<void**>(&vertexDataBegin));
+		hr = buffer->Map(0, &readRange, reinterpret_cast<void**>(&dataBegin));
 		RTX_Exception::handleError(&hr, "Error uploading model data.");
-		memcpy(vertexDataBegin, _vertices, sizeof(_vertices));
+		memcpy(dataBegin, _data, static_cast<size_t>(_size));
 		buffer->Unmap(0, nullptr);
 
-		// Add the model to the list
-		Model model(buffer, _verticesAmount);
-		models.push_back(model);
-
-		
-
-		return 0;
+		return buffer;
 	}
 	int RTX_Manager::waitForPreviousFrame()
 	{
@@ -90,6 +145,7 @@ namespace RTXSimplified
 		hr = initializer->getCommandQueue()->Signal(initializer->getFence().Get(), fence);
 		RTX_Exception::handleError(&hr, "Error signaling fence. ");
 		initializer->setFenceValue(initializer->getFenceValue() + 1);
+		initializer->getUploadRing()->endFrame(fence); // Uploads of this frame are free once it is done
 
 		// Wait until the previous frame is finished.
 		if (initializer->getFence()->GetCompletedValue() < fence)
@@ -99,12 +155,18 @@ namespace RTXSimplified
 
 			WaitForSingleObject(initializer->getFenceEvent(), INFINITE);
 		}
+		initializer->getUploadRing()->releaseCompleted(initializer->getFence()->GetCompletedValue());
 		initializer->setFrameIndex(initializer->getSwapChain()->GetCurrentBackBufferIndex());
 
 		return 0;
 	}
 	void RTX_Manager::onRender()
 	{
+		if (pathTracer->getBackend() == PATH_TRACER_BACKEND_CPU) // Nothing to submit, the image is read back with getCPUOutput
+		{
+			pathTracer->renderCPU();
+			return;
+		}
 		HRESULT hr;
 		pathTracer->populateCommandList();
 		ID3D12CommandList* commandLists[] = { initializer->getCommandList().Get() };
@@ -118,12 +180,14 @@ namespace RTXSimplified
 	}
 	void RTX_Manager::onUpdate()
 	{
+		if (!initializer) // No camera buffer, renderCPU takes the matrices
+		{
+			return;
+		}
 		initializer->updateCameraBuffer();
 	}
 	int RTX_Manager::addSampleModels()
 	{
-		HRESULT hr; // Error handling.
-
 				/*ADD TRIANGLE MODEL*/
 		RTXSimplified::Vertex sample[] =
 		{
@@ -131,72 +195,21 @@ namespace RTXSimplified
 			{{0.25f, -0.25f * 1.f, 0.0f}, {0.0f, 1.0f, 1.0f, 1.0f}},
 			{{-0.25f, -0.25f * 1.f, 0.0f}, {1.0f, 0.0f, 1.0f, 1.0f}}
 		};
-
-		ComPtr<ID3D12Resource> buffer;
-
-		const UINT bufferSize = sizeof(sample);
-
-		CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(bufferSize);
-
-		// Create the resource.
-		hr = initializer->getRTXDevice()->CreateCommittedResource(
-			&heapProperty,
-			D3D12_HEAP_FLAG_NONE,
-			&bufferResource,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			nullptr,
-			IID_PPV_ARGS(&buffer));
-		RTX_Exception::handleError(&hr, "Error allocating space for the model.");
-
-		// Copy the triangle data to the vertex buffer.
-		UINT8* vertexDataBegin;
-		CD3DX12_RANGE readRange(0, 0); // No need to read the data again.
-		hr = buffer->Map(0, &readRange, reinterpret_cast<void**>(&vertexDataBegin));
-		RTX_Exception::handleError(&hr, "Error uploading model data.");
-		memcpy(vertexDataBegin, sample, sizeof(sample));
-		buffer->Unmap(0, nullptr);
-
-		// Add the model to the list
-		Model model(buffer, 3);
-		models.push_back(model);
+		uint32_t sampleIndices[] = { 0, 1, 2 };
+		addModel(sample, 3, sampleIndices, 3);
 
 
 		/*ADD PLANE MODEL*/
-
-		ComPtr<ID3D12Resource> buffer2;
 		Vertex planeVertices[] = {
-		{{-1.5f, -.8f, 01.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, //0 
-		{{-1.5f, -.8f, -1.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 1 
-		{{01.5f, -.8f, 01.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 2 
+		{{-1.5f, -.8f, 01.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 0
+		{{-1.5f, -.8f, -1.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 1
 		{{01.5f, -.8f, 01.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 2
-		{{-1.5f, -.8f, -1.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}, // 1 
-		{{01.5f, -.8f, -1.5f}, {1.0f, 1.0f, 1.0f, 1.0f}} // 4 
+		{{01.5f, -.8f, -1.5f}, {1.0f, 1.0f, 1.0f, 1.0f}}  // 3
 		};
-		const UINT planeBufferSize = sizeof(planeVertices);
-		CD3DX12_HEAP_PROPERTIES heapProperty2 = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-		CD3DX12_RESOURCE_DESC bufferResource2 = CD3DX12_RESOURCE_DESC::Buffer(planeBufferSize);
-		hr = initializer->getRTXDevice()->CreateCommittedResource(
-			&heapProperty2, D3D12_HEAP_FLAG_NONE, &bufferResource2, //
-			D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
-			IID_PPV_ARGS(&buffer2));
-		RTX_Exception::handleError(&hr, "Error allocating space for the model.");
-
-		// Copy the triangle data to the vertex buffer.
-		UINT8* pVertexDataBegin;
-		CD3DX12_RANGE readRange2(0, 0); // We do not intend to read from this resource on the CPU. 
-		hr = buffer2->Map(0, &readRange2, reinterpret_cast<void**>(&pVertexDataBegin));
-		RTX_Exception::handleError(&hr, "Error uploading model data.");
-		memcpy(pVertexDataBegin, planeVertices, sizeof(planeVertices));
-
-		buffer2->Unmap(0, nullptr);
-
-		// Add the model to the list
-		Model model2(buffer2, 6);
-		models.push_back(model2);
+		uint32_t planeIndices[] = { 0, 1, 2, 2, 1, 3 }; // Two triangles sharing the 1-2 edge
+		addModel(planeVertices, 4, planeIndices, 6);
 
 
-		return 0;
 		return 0;
 	}
 	int RTX_Manager::enableShadows(std::string _shader)
@@ -273,8 +286,23 @@ namespace RTXSimplified
 	{
 		self.lock()->hwnd = _hwnd;
 	}
-	Model::Model(ComPtr<ID3D12Resource> _buffer, UINT _verticesAmount)
-		: buffer(_buffer), verticesAmount(_verticesAmount)
+	void RTX_Manager::setWeldEpsilon(float _value)
+	{
+		weldEpsilon = _value;
+	}
+	Model::Model(ComPtr<ID3D12Resource> _buffer, UINT _verticesAmount, const Vertex* _vertices,
+		ComPtr<ID3D12Resource> _indexBuffer, UINT _indicesAmount, const uint32_t* _indices)
+		: buffer(_buffer), verticesAmount(_verticesAmount), indexBuffer(_indexBuffer), indicesAmount(_indicesAmount), contentHash(0)
 	{
+		if (_vertices) // Keep a CPU copy for the CPU acceleration structures
+		{
+			vertices.assign(_vertices, _vertices + _verticesAmount);
+			contentHash = hashBytes(_vertices, sizeof(Vertex) * _verticesAmount); // Used to share the BLAS of identical models
+			if (_indices)
+			{
+				indices.assign(_indices, _indices + _indicesAmount);
+				contentHash = hashBytes(_indices, sizeof(uint32_t) * _indicesAmount, contentHash); // Same vertices wired differently are a different mesh
+			}
+		}
 	}
 }
\ No newline at end of file
@@ -27,10 +27,17 @@ namespace RTXSimplified
 	*/
 	struct Model
 	{
-		Model(ComPtr<ID3D12Resource> _buffer, UINT _verticesAmount); ///< Constructor.
+		Model(ComPtr<ID3D12Resource> _buffer, UINT _verticesAmount, const Vertex* _vertices = nullptr,
+			ComPtr<ID3D12Resource> _indexBuffer = nullptr, UINT _indicesAmount = 0, const uint32_t* _indices = nullptr); ///< Constructor.
 
 		ComPtr<ID3D12Resource> buffer; ///< Vertices describing the geometry.
 		UINT verticesAmount; ///< Number of vertices.
+		std::vector<Vertex> vertices; ///< CPU copy of the vertices, used by the CPU acceleration structures.
+		ComPtr<ID3D12Resource> indexBuffer; ///< 32 bit indices, 3 per triangle, null for a triangle soup.
+		UINT indicesAmount; ///< Number of indices.
+		std::vector<uint32_t> indices; ///< CPU copy of the indices.
+		uint64_t contentHash; ///< Hash of the vertex and index bytes, 0 when there is no CPU copy.
+		BLASBuildOptions buildOptions; ///< How its BLAS is built, identical models with other options get their own BLAS.
 	}; ///< Struct to help store the models to render.
 	class RTX_Manager
 	{
@@ -53,6 +60,9 @@ namespace RTXSimplified
 
 		std::weak_ptr<RTX_Manager> self; ///< Smart "this" pointer.
 		std::vector<Model> models; ///< Models to render.
+		float weldEpsilon = 0.0f; ///< Distance under which addModel merges vertices, 0 = only identical ones.
+
+		ComPtr<ID3D12Resource> createUploadBuffer(const void* _data, UINT64 _size); ///< Creates an upload heap buffer holding a copy of the data.
 
 	public:
 
@@ -65,8 +75,13 @@ namespace RTXSimplified
 			std::string _missShader,   ///< Path to the no hit shader.
 			std::string _hitShader	   ///< Path to the closest hit shader. 
 		); ///< Initializes the library, uses the initializer class.
+		std::shared_ptr<RTX_Manager> initializeCPU(
+			int _width,				   ///< Width of the CPU image.
+			int _height				   ///< Height of the CPU image.
+		); ///< Initializes the library without a D3D12 device, scenes go through createCPUAccelerationStructure and frames through renderCPU.
 
-		int addModel(Vertex _vertices[], UINT _verticesAmount); ///< Adds a model to be rendered.
+		int addModel(Vertex _vertices[], UINT _verticesAmount, const BLASBuildOptions& _options = BLASBuildOptions()); ///< Adds a triangle soup to be rendered, welded into an indexed mesh first.
+		int addModel(const Vertex* _vertices, UINT _verticesAmount, const uint32_t* _indices, UINT _indicesAmount, const BLASBuildOptions& _options = BLASBuildOptions()); ///< Adds an indexed mesh to be rendered, only its CPU copy without a device.
 		int waitForPreviousFrame(); ///< Wait for frame to end.
 		void onRender(); ///< Handles on render events.
 		void onUpdate(); ///< Handles on update events.
@@ -76,7 +91,7 @@ namespace RTXSimplified
 		bool getInitialized();
 		std::shared_ptr<RTX_BVHmanager> getBVHManager();
 		std::shared_ptr<RTX_PathTracer> getPathTracer();
-		std::shared_ptr<RTX_Initializer> getInitializer();
+		std::shared_ptr<RTX_Initializer> getInitializer(); ///< Null after initializeCPU.
 		std::string getShadowShader();
 		std::string getRayGenShader();
 		std::string getMissShader();
@@ -91,6 +106,7 @@ namespace RTXSimplified
 		void setWidth(int _value);
 		void setHeight(int _value);
 		void setHWND(HWND _hwnd);
+		void setWeldEpsilon(float _value);
 	};
 }
 
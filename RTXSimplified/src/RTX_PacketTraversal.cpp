@@ -0,0 +1,447 @@
+#include "RTX_PacketTraversal.h"
+#include <algorithm> // std::swap
+
+namespace RTXSimplified
+{
+	static const uint32_t fullMask = (1u << packetWidth) - 1;
+#if defined(RTX_SIMD_AVX2)
+	static const bool intervalCulling = false; // 8 slab tests are a handful of AVX2 instructions, cheaper than the interval bound
+#else
+	static const bool intervalCulling = true; // One interval test replaces 8 scalar slab tests
+#endif
+
+	struct PacketSetup
+	{
+		alignas(32) float invX[packetWidth];	///< Inverse directions of each lane.
+		alignas(32) float invY[packetWidth];
+		alignas(32) float invZ[packetWidth];
+		alignas(32) float closest[packetWidth];	///< Current tMax of each lane, -FLT_MAX for lanes that are done.
+		bool coherent;							///< Every direction has the same signs, the interval test is valid.
+		Float3 originMin, originMax;			///< Bounds of the origins of the active lanes.
+		Float3 invMin, invMax;					///< Bounds of the inverse directions of the active lanes.
+		Float3 meanDirection;					///< Decides which child is visited first.
+		float tMinLow;							///< Smallest tMin of the active lanes.
+	}; // Per packet data computed once before traversal
+
+	static void setupPacket(const RayPacket& _packet, uint32_t _mask, const float* _closest, PacketSetup& _setup)
+	{
+		_setup.coherent = true;
+		_setup.originMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		_setup.originMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		_setup.invMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		_setup.invMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		_setup.meanDirection = { 0.0f, 0.0f, 0.0f };
+		_setup.tMinLow = FLT_MAX;
+
+		Float3 firstDirection = { 0.0f, 0.0f, 0.0f }; // Every active lane has to match the signs of the first one
+		bool first = true;
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			_setup.invX[i] = 1.0f / _packet.directionX[i];
+			_setup.invY[i] = 1.0f / _packet.directionY[i];
+			_setup.invZ[i] = 1.0f / _packet.directionZ[i];
+			bool active = (_mask & (1u << i)) != 0;
+			_setup.closest[i] = active ? minFloat(_packet.tMax[i], _closest[i]) : -FLT_MAX; // Inactive lanes never pass a test
+			if (!active)
+			{
+				continue;
+			}
+
+			Float3 origin = { _packet.originX[i], _packet.originY[i], _packet.originZ[i] };
+			Float3 direction = { _packet.directionX[i], _packet.directionY[i], _packet.directionZ[i] };
+			Float3 inverse = { _setup.invX[i], _setup.invY[i], _setup.invZ[i] };
+			if (first)
+			{
+				firstDirection = direction;
+				first = false;
+			}
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (direction[axis] == 0.0f || (direction[axis] < 0.0f) != (firstDirection[axis] < 0.0f)) // Mixed signs, the intervals would span infinity
+				{
+					_setup.coherent = false;
+				}
+			}
+			_setup.originMin = minFloat3(_setup.originMin, origin);
+			_setup.originMax = maxFloat3(_setup.originMax, origin);
+			_setup.invMin = minFloat3(_setup.invMin, inverse);
+			_setup.invMax = maxFloat3(_setup.invMax, inverse);
+			_setup.meanDirection = _setup.meanDirection + direction;
+			_setup.tMinLow = minFloat(_setup.tMinLow, _packet.tMin[i]);
+		}
+	}
+
+	static inline float largestClosest(const PacketSetup& _setup)
+	{
+		float largest = _setup.closest[0];
+		for (uint32_t i = 1; i < packetWidth; i++)
+		{
+			largest = maxFloat(largest, _setup.closest[i]);
+		}
+		return largest;
+	} // Furthest a ray of the packet can still accept a hit
+
+	static inline bool intervalOverlap(const PacketSetup& _setup, const BVHNode& _node, float _closestHigh)
+	{
+		// Bounds the slab distances of every ray at once, the packet misses the node if even the
+		// earliest possible exit comes before the latest possible entry
+		float nearLow = _setup.tMinLow, farHigh = _closestHigh;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float lowLow = (_node.aabbMin[axis] - _setup.originMax[axis]), lowHigh = (_node.aabbMin[axis] - _setup.originMin[axis]);
+			float highLow = (_node.aabbMax[axis] - _setup.originMax[axis]), highHigh = (_node.aabbMax[axis] - _setup.originMin[axis]);
+			if (_setup.invMin[axis] < 0.0f) // Rays enter through the upper plane
+			{
+				std::swap(lowLow, highLow);
+				std::swap(lowHigh, highHigh);
+			}
+			float entry0 = lowLow * _setup.invMin[axis], entry1 = lowLow * _setup.invMax[axis];
+			float entry2 = lowHigh * _setup.invMin[axis], entry3 = lowHigh * _setup.invMax[axis];
+			float exit0 = highLow * _setup.invMin[axis], exit1 = highLow * _setup.invMax[axis];
+			float exit2 = highHigh * _setup.invMin[axis], exit3 = highHigh * _setup.invMax[axis];
+			nearLow = maxFloat(nearLow, minFloat(minFloat(entry0, entry1), minFloat(entry2, entry3)));
+			farHigh = minFloat(farHigh, maxFloat(maxFloat(exit0, exit1), maxFloat(exit2, exit3)));
+		}
+		return nearLow <= farHigh;
+	}
+
+	static inline uint32_t slabTest(const RayPacket& _packet, const PacketSetup& _setup, const BVHNode& _node)
+	{
+#if defined(RTX_SIMD_AVX2)
+		__m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMin.x), _mm256_load_ps(_packet.originX)), _mm256_load_ps(_setup.invX));
+		__m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMax.x), _mm256_load_ps(_packet.originX)), _mm256_load_ps(_setup.invX));
+		__m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMin.y), _mm256_load_ps(_packet.originY)), _mm256_load_ps(_setup.invY));
+		__m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMax.y), _mm256_load_ps(_packet.originY)), _mm256_load_ps(_setup.invY));
+		__m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMin.z), _mm256_load_ps(_packet.originZ)), _mm256_load_ps(_setup.invZ));
+		__m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(_node.aabbMax.z), _mm256_load_ps(_packet.originZ)), _mm256_load_ps(_setup.invZ));
+		__m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx0, tx1), _mm256_min_ps(ty0, ty1)), _mm256_max_ps(_mm256_min_ps(tz0, tz1), _mm256_load_ps(_packet.tMin)));
+		__m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx0, tx1), _mm256_max_ps(ty0, ty1)), _mm256_min_ps(_mm256_max_ps(tz0, tz1), _mm256_load_ps(_setup.closest)));
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+#else
+		uint32_t hitMask = 0;
+		for (uint32_t i = 0; i < packetWidth; i++) // Scalar fallback, same maths one ray at a time
+		{
+			float tx0 = (_node.aabbMin.x - _packet.originX[i]) * _setup.invX[i], tx1 = (_node.aabbMax.x - _packet.originX[i]) * _setup.invX[i];
+			float ty0 = (_node.aabbMin.y - _packet.originY[i]) * _setup.invY[i], ty1 = (_node.aabbMax.y - _packet.originY[i]) * _setup.invY[i];
+			float tz0 = (_node.aabbMin.z - _packet.originZ[i]) * _setup.invZ[i], tz1 = (_node.aabbMax.z - _packet.originZ[i]) * _setup.invZ[i];
+			float tNear = maxFloat(maxFloat(minFloat(tx0, tx1), minFloat(ty0, ty1)), maxFloat(minFloat(tz0, tz1), _packet.tMin[i]));
+			float tFar = minFloat(minFloat(maxFloat(tx0, tx1), maxFloat(ty0, ty1)), minFloat(maxFloat(tz0, tz1), _setup.closest[i]));
+			hitMask |= (tNear <= tFar ? 1u : 0u) << i;
+		}
+		return hitMask;
+#endif
+	} // Lanes whose ray overlaps the node before its closest hit
+
+	static inline uint32_t intersectTriangle(const RayPacket& _packet, PacketSetup& _setup, const BVHTriangle& _triangle, float* _u, float* _v)
+	{
+#if defined(RTX_SIMD_AVX2)
+		const Float3 edge1 = _triangle.v1 - _triangle.v0;
+		const Float3 edge2 = _triangle.v2 - _triangle.v0;
+		// Moller-Trumbore with the triangle broadcast and one ray per lane
+		const __m256 dx = _mm256_load_ps(_packet.directionX), dy = _mm256_load_ps(_packet.directionY), dz = _mm256_load_ps(_packet.directionZ);
+		const __m256 e1x = _mm256_set1_ps(edge1.x), e1y = _mm256_set1_ps(edge1.y), e1z = _mm256_set1_ps(edge1.z);
+		const __m256 e2x = _mm256_set1_ps(edge2.x), e2y = _mm256_set1_ps(edge2.y), e2z = _mm256_set1_ps(edge2.z);
+		const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+		const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+		const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+		const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+		const __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+		const __m256 sx = _mm256_sub_ps(_mm256_load_ps(_packet.originX), _mm256_set1_ps(_triangle.v0.x));
+		const __m256 sy = _mm256_sub_ps(_mm256_load_ps(_packet.originY), _mm256_set1_ps(_triangle.v0.y));
+		const __m256 sz = _mm256_sub_ps(_mm256_load_ps(_packet.originZ), _mm256_set1_ps(_triangle.v0.z));
+		const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+		const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+		const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+		const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+		const __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+		const __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+		const __m256 absDet = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), det);
+		__m256 accept = _mm256_cmp_ps(absDet, _mm256_set1_ps(1e-12f), _CMP_GE_OQ);
+		accept = _mm256_and_ps(accept, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+		accept = _mm256_and_ps(accept, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ)));
+		accept = _mm256_and_ps(accept, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_load_ps(_packet.tMin), _CMP_GE_OQ), _mm256_cmp_ps(t, _mm256_load_ps(_setup.closest), _CMP_LT_OQ)));
+		uint32_t hitMask = static_cast<uint32_t>(_mm256_movemask_ps(accept));
+		if (hitMask != 0)
+		{
+			_mm256_store_ps(_setup.closest, _mm256_blendv_ps(_mm256_load_ps(_setup.closest), t, accept));
+			_mm256_storeu_ps(_u, _mm256_blendv_ps(_mm256_loadu_ps(_u), u, accept));
+			_mm256_storeu_ps(_v, _mm256_blendv_ps(_mm256_loadu_ps(_v), v, accept));
+		}
+		return hitMask;
+#else
+		uint32_t hitMask = 0;
+		for (uint32_t i = 0; i < packetWidth; i++) // Scalar fallback, same test as intersectTriangle in RTX_CPUMath.h
+		{
+			Ray ray = { { _packet.originX[i], _packet.originY[i], _packet.originZ[i] }, _packet.tMin[i],
+				{ _packet.directionX[i], _packet.directionY[i], _packet.directionZ[i] }, _setup.closest[i] };
+			if (RTXSimplified::intersectTriangle(ray, _triangle.v0, _triangle.v1, _triangle.v2, _setup.closest[i], _u[i], _v[i]))
+			{
+				hitMask |= 1u << i;
+			}
+		}
+		return hitMask;
+#endif
+	} // Tests one triangle against every lane, returns the lanes it became the closest hit for
+
+	template <bool anyHit>
+	static uint32_t traversePacket(const RTX_CPUBVH& _bvh, const RayPacket& _packet, PacketSetup& _setup, uint32_t _active, uint32_t* _hitTriangle, float* _u, float* _v)
+	{
+		const std::vector<BVHNode>& nodes = _bvh.getNodes();
+		const std::vector<BVHTriangle>& triangles = _bvh.getTriangles();
+		const std::vector<uint32_t>& triIndices = _bvh.getTriIndices();
+		uint32_t hitLanes = 0;
+		float closestHigh = largestClosest(_setup);
+
+		uint32_t stack[128]; // Build depth is capped, so this can not overflow
+		uint32_t stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0)
+		{
+			const BVHNode& node = nodes[stack[--stackSize]];
+			if (intervalCulling && _setup.coherent && !intervalOverlap(_setup, node, closestHigh)) // Whole packet misses, one test instead of 8
+			{
+				continue;
+			}
+			if ((slabTest(_packet, _setup, node) & _active) == 0)
+			{
+				continue;
+			}
+
+			if (node.triCount > 0) // Leaf, test every triangle against every ray
+			{
+				for (uint32_t i = 0; i < node.triCount; i++)
+				{
+					uint32_t triangle = triIndices[node.leftFirst + i];
+					uint32_t hitMask = intersectTriangle(_packet, _setup, triangles[triangle], _u, _v) & _active;
+					if (hitMask == 0)
+					{
+						continue;
+					}
+					hitLanes |= hitMask;
+					if (anyHit) // Blocked lanes are done, stop once every lane is
+					{
+						_active &= ~hitMask;
+						for (uint32_t lane = 0; lane < packetWidth; lane++)
+						{
+							if (hitMask & (1u << lane))
+							{
+								_setup.closest[lane] = -FLT_MAX;
+							}
+						}
+						if (_active == 0)
+						{
+							return hitLanes;
+						}
+						continue;
+					}
+					for (uint32_t lane = 0; lane < packetWidth; lane++)
+					{
+						if (hitMask & (1u << lane))
+						{
+							_hitTriangle[lane] = triangle;
+						}
+					}
+				}
+				closestHigh = largestClosest(_setup);
+				continue;
+			}
+
+			// Inner node, push the far child first so the near one is popped next
+			const BVHNode& left = nodes[node.leftFirst];
+			const BVHNode& right = nodes[node.leftFirst + 1];
+			Float3 centreOffset = (right.aabbMin + right.aabbMax) - (left.aabbMin + left.aabbMax);
+			if (dot(centreOffset, _setup.meanDirection) < 0.0f) // Packet travels towards the left child
+			{
+				stack[stackSize++] = node.leftFirst;
+				stack[stackSize++] = node.leftFirst + 1;
+			}
+			else
+			{
+				stack[stackSize++] = node.leftFirst + 1;
+				stack[stackSize++] = node.leftFirst;
+			}
+		}
+		return hitLanes;
+	}
+
+	uint32_t RTX_PacketTraversal::intersect(const RTX_CPUBVH& _bvh, const RayPacket& _packet, RayPacketHit& _hit)
+	{
+		if (_bvh.getNodes().empty() || (_packet.activeMask & fullMask) == 0)
+		{
+			return 0;
+		}
+
+		PacketSetup setup;
+		setupPacket(_packet, _packet.activeMask & fullMask, _hit.t, setup);
+		uint32_t hitTriangle[packetWidth];
+		alignas(32) float u[packetWidth], v[packetWidth];
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			hitTriangle[i] = UINT32_MAX;
+			u[i] = v[i] = 0.0f;
+		}
+
+		uint32_t hitLanes = traversePacket<false>(_bvh, _packet, setup, _packet.activeMask & fullMask, hitTriangle, u, v);
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			if (!(hitLanes & (1u << i)))
+			{
+				continue;
+			}
+			_hit.t[i] = setup.closest[i];
+			_hit.u[i] = u[i];
+			_hit.v[i] = v[i];
+			_hit.geometryIndex[i] = _bvh.getGeometryIndex(hitTriangle[i]);
+			_hit.primitiveIndex[i] = hitTriangle[i] - _bvh.getGeometryOffsets()[_hit.geometryIndex[i]];
+		}
+		return hitLanes;
+	}
+
+	uint32_t RTX_PacketTraversal::occluded(const RTX_CPUBVH& _bvh, const RayPacket& _packet, uint32_t _occludedMask)
+	{
+		uint32_t active = _packet.activeMask & ~_occludedMask & fullMask;
+		if (_bvh.getNodes().empty() || active == 0)
+		{
+			return _occludedMask;
+		}
+
+		PacketSetup setup;
+		float closest[packetWidth];
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			closest[i] = FLT_MAX;
+		}
+		setupPacket(_packet, active, closest, setup);
+		alignas(32) float u[packetWidth], v[packetWidth];
+
+		return _occludedMask | traversePacket<true>(_bvh, _packet, setup, active, nullptr, u, v);
+	}
+
+	uint32_t RTX_PacketTraversal::intersectBounds(const RayPacket& _packet, const AABB& _bounds, const float* _closest)
+	{
+		PacketSetup setup;
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			setup.invX[i] = 1.0f / _packet.directionX[i];
+			setup.invY[i] = 1.0f / _packet.directionY[i];
+			setup.invZ[i] = 1.0f / _packet.directionZ[i];
+			setup.closest[i] = minFloat(_packet.tMax[i], _closest[i]);
+		}
+		BVHNode node = { _bounds.min, 0, _bounds.max, 0 };
+		return slabTest(_packet, setup, node) & _packet.activeMask & fullMask;
+	}
+
+	RayPacket RTX_PacketTraversal::transform(const RayPacket& _packet, const float _transform[12])
+	{
+		RayPacket result = _packet;
+#if defined(RTX_SIMD_AVX2)
+		// Matrix elements broadcast, one ray per lane
+		const __m256 ox = _mm256_load_ps(_packet.originX), oy = _mm256_load_ps(_packet.originY), oz = _mm256_load_ps(_packet.originZ);
+		const __m256 dx = _mm256_load_ps(_packet.directionX), dy = _mm256_load_ps(_packet.directionY), dz = _mm256_load_ps(_packet.directionZ);
+		float* origins[3] = { result.originX, result.originY, result.originZ };
+		float* directions[3] = { result.directionX, result.directionY, result.directionZ };
+		for (int row = 0; row < 3; row++)
+		{
+			const __m256 m0 = _mm256_set1_ps(_transform[row * 4 + 0]), m1 = _mm256_set1_ps(_transform[row * 4 + 1]), m2 = _mm256_set1_ps(_transform[row * 4 + 2]);
+			__m256 direction = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, dx), _mm256_mul_ps(m1, dy)), _mm256_mul_ps(m2, dz));
+			__m256 origin = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, ox), _mm256_mul_ps(m1, oy)), _mm256_add_ps(_mm256_mul_ps(m2, oz), _mm256_set1_ps(_transform[row * 4 + 3])));
+			_mm256_store_ps(origins[row], origin);
+			_mm256_store_ps(directions[row], direction);
+		}
+#else
+		for (uint32_t i = 0; i < packetWidth; i++) // Points get the translation column, directions do not
+		{
+			float x = _packet.originX[i], y = _packet.originY[i], z = _packet.originZ[i];
+			result.originX[i] = _transform[0] * x + _transform[1] * y + _transform[2] * z + _transform[3];
+			result.originY[i] = _transform[4] * x + _transform[5] * y + _transform[6] * z + _transform[7];
+			result.originZ[i] = _transform[8] * x + _transform[9] * y + _transform[10] * z + _transform[11];
+			x = _packet.directionX[i], y = _packet.directionY[i], z = _packet.directionZ[i];
+			result.directionX[i] = _transform[0] * x + _transform[1] * y + _transform[2] * z;
+			result.directionY[i] = _transform[4] * x + _transform[5] * y + _transform[6] * z;
+			result.directionZ[i] = _transform[8] * x + _transform[9] * y + _transform[10] * z;
+		}
+#endif
+		return result;
+	}
+
+	RayPacket RTX_PacketTraversal::makePacket(const Ray* _rays, uint32_t _count)
+	{
+		RayPacket packet;
+		packet.activeMask = 0;
+		for (uint32_t i = 0; i < packetWidth; i++)
+		{
+			const Ray& ray = _rays[i < _count ? i : 0]; // Unused lanes repeat the first ray and stay inactive
+			packet.originX[i] = ray.origin.x;
+			packet.originY[i] = ray.origin.y;
+			packet.originZ[i] = ray.origin.z;
+			packet.directionX[i] = ray.direction.x;
+			packet.directionY[i] = ray.direction.y;
+			packet.directionZ[i] = ray.direction.z;
+			packet.tMin[i] = ray.tMin;
+			packet.tMax[i] = ray.tMax;
+			if (i < _count)
+			{
+				packet.activeMask |= 1u << i;
+			}
+		}
+		return packet;
+	}
+
+	Ray RTX_PacketTraversal::getRay(const RayPacket& _packet, uint32_t _lane)
+	{
+		Ray ray;
+		ray.origin = { _packet.originX[_lane], _packet.originY[_lane], _packet.originZ[_lane] };
+		ray.direction = { _packet.directionX[_lane], _packet.directionY[_lane], _packet.directionZ[_lane] };
+		ray.tMin = _packet.tMin[_lane];
+		ray.tMax = _packet.tMax[_lane];
+		return ray;
+	}
+
+	uint32_t RTX_PacketTraversal::generateCameraPackets(const float _viewInverse[16], const float _projectionInverse[16], uint32_t _width, uint32_t _height, std::vector<RayPacket>& _packets)
+	{
+		const uint32_t blockWidth = 4, blockHeight = 2; // 8 neighbouring pixels per packet
+		uint32_t blocksX = (_width + blockWidth - 1) / blockWidth;
+		uint32_t blocksY = (_height + blockHeight - 1) / blockHeight;
+		_packets.resize(static_cast<size_t>(blocksX) * blocksY);
+
+		Float3 origin = { _viewInverse[12], _viewInverse[13], _viewInverse[14] }; // Camera position is the translation row
+		std::vector<Ray> rays(packetWidth);
+		for (uint32_t by = 0; by < blocksY; by++)
+		{
+			for (uint32_t bx = 0; bx < blocksX; bx++)
+			{
+				uint32_t count = 0, mask = 0;
+				for (uint32_t lane = 0; lane < packetWidth; lane++)
+				{
+					uint32_t x = bx * blockWidth + lane % blockWidth, y = by * blockHeight + lane / blockWidth;
+					bool inside = x < _width && y < _height;
+					x = inside ? x : bx * blockWidth; // Outside the image, trace a copy of the first pixel
+					y = inside ? y : by * blockHeight;
+
+					// Pixel centre in normalized device coordinates, through the inverse projection then into world space
+					float ndcX = (x + 0.5f) / _width * 2.0f - 1.0f;
+					float ndcY = -((y + 0.5f) / _height * 2.0f - 1.0f);
+					Float3 target = {
+						ndcX * _projectionInverse[0] + ndcY * _projectionInverse[4] + _projectionInverse[8] + _projectionInverse[12],
+						ndcX * _projectionInverse[1] + ndcY * _projectionInverse[5] + _projectionInverse[9] + _projectionInverse[13],
+						ndcX * _projectionInverse[2] + ndcY * _projectionInverse[6] + _projectionInverse[10] + _projectionInverse[14] };
+					Float3 direction = {
+						target.x * _viewInverse[0] + target.y * _viewInverse[4] + target.z * _viewInverse[8],
+						target.x * _viewInverse[1] + target.y * _viewInverse[5] + target.z * _viewInverse[9],
+						target.x * _viewInverse[2] + target.y * _viewInverse[6] + target.z * _viewInverse[10] };
+					direction = direction * (1.0f / sqrtf(dot(direction, direction)));
+
+					rays[lane] = { origin, 0.0f, direction, 100000.0f };
+					mask |= (inside ? 1u : 0u) << lane;
+					count++;
+				}
+				RayPacket& packet = _packets[static_cast<size_t>(by) * blocksX + bx];
+				packet = makePacket(rays.data(), count);
+				packet.activeMask = mask;
+			}
+		}
+		return blocksX;
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef RTX_PACKETTRAVERSAL_H
+#define RTX_PACKETTRAVERSAL_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Ray, RayHit
+#include "RTX_CPUBVH.h" // Binary tree
+
+namespace RTXSimplified
+{
+	static const uint32_t packetWidth = 8; ///< Rays per packet, one AVX2 register.
+
+	struct RayPacket
+	{
+		alignas(32) float originX[packetWidth];		///< Ray origins, one lane per ray.
+		alignas(32) float originY[packetWidth];
+		alignas(32) float originZ[packetWidth];
+		alignas(32) float directionX[packetWidth];	///< Ray directions, do not need to be normalized.
+		alignas(32) float directionY[packetWidth];
+		alignas(32) float directionZ[packetWidth];
+		alignas(32) float tMin[packetWidth];		///< Closest accepted distance of each ray.
+		alignas(32) float tMax[packetWidth];		///< Furthest accepted distance of each ray.
+		uint32_t activeMask = 0;					///< Bit per lane holding a ray, partial packets at the image edges.
+	}; ///< 8 rays in structure of arrays form, traced together.
+
+	struct RayPacketHit
+	{
+		alignas(32) float t[packetWidth];			///< Distance along each ray, FLT_MAX = miss.
+		alignas(32) float u[packetWidth];			///< Barycentric of the second vertex.
+		alignas(32) float v[packetWidth];			///< Barycentric of the third vertex.
+		uint32_t primitiveIndex[packetWidth];		///< Triangle index inside its geometry, UINT32_MAX = miss.
+		uint32_t geometryIndex[packetWidth];		///< Index of the geometry inside the BLAS.
+		uint32_t instanceIndex[packetWidth];		///< Instance that was hit, filled by scene traversal.
+
+		void reset()
+		{
+			for (uint32_t i = 0; i < packetWidth; i++)
+			{
+				t[i] = FLT_MAX;
+				u[i] = v[i] = 0.0f;
+				primitiveIndex[i] = UINT32_MAX;
+				geometryIndex[i] = 0;
+				instanceIndex[i] = 0;
+			}
+		} ///< Marks every lane as a miss.
+	}; ///< Closest hits of a packet.
+
+	/**
+	*	\brief The class responsible for tracing coherent packets of rays through a CPU BVH.
+	*
+	*	Every ray of a packet visits the same nodes, so node bounds and triangles are loaded once for 8 rays.
+	*	Nodes are slab tested 8 rays at a time and leaves test each triangle against the 8 rays at once.
+	*	Without AVX2, packets whose directions share their signs are first bounded by interval arithmetic
+	*	on their origins and inverse directions, so a node the whole packet misses costs one scalar test
+	*	instead of 8. Camera rays and shadow rays towards a point light are coherent enough for this to pay.
+	*/
+	class RTX_PacketTraversal
+	{
+	public:
+		static uint32_t intersect(
+			const RTX_CPUBVH& _bvh,			///< Built binary tree.
+			const RayPacket& _packet,		///< Rays to trace.
+			RayPacketHit& _hit				///< Closest hits so far, only lanes with a closer hit are overwritten.
+		); ///< Finds the closest hit of each ray, returns the mask of lanes that got a closer hit.
+		static uint32_t occluded(
+			const RTX_CPUBVH& _bvh,			///< Built binary tree.
+			const RayPacket& _packet,		///< Shadow rays, tMax set to the light distance.
+			uint32_t _occludedMask = 0		///< Lanes already known to be blocked, not traced again.
+		); ///< Stops each ray at its first hit, returns the mask of blocked lanes.
+
+		static uint32_t intersectBounds(
+			const RayPacket& _packet,		///< Rays to test.
+			const AABB& _bounds,			///< Box to test against.
+			const float* _closest			///< Current closest hit of each lane.
+		); ///< Mask of active lanes that overlap the box before their closest hit.
+
+		static RayPacket transform(const RayPacket& _packet, const float _transform[12]); ///< Moves a packet by a 3x4 row major matrix, laid out like D3D12_RAYTRACING_INSTANCE_DESC::Transform. t values are preserved.
+		static RayPacket makePacket(const Ray* _rays, uint32_t _count); ///< Packs up to 8 rays.
+		static Ray getRay(const RayPacket& _packet, uint32_t _lane); ///< Unpacks one ray.
+		static uint32_t generateCameraPackets(
+			const float _viewInverse[16],		///< Inverse view matrix, row major as stored by updateCameraBuffer.
+			const float _projectionInverse[16],	///< Inverse projection matrix.
+			uint32_t _width,					///< Image width in pixels.
+			uint32_t _height,					///< Image height in pixels.
+			std::vector<RayPacket>& _packets	///< Filled with one packet per 4x2 pixel block, blocks row by row.
+		); ///< Primary rays through each pixel centre, returns the number of blocks per row.
+	};
+}
+#endif // !RTX_PACKETTRAVERSAL_H
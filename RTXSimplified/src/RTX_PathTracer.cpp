@@ -47,6 +47,7 @@ namespace RTXSimplified
 		);
 
 		rtxManager->getBVHManager()->updateTLAS();
+		rtxManager->getInitializer()->getUploadRing()->recordCopies(rtxManager->getInitializer()->getCommandList().Get()); // Camera and constants written since the last frame
 
 
 		// Bind heaps
@@ -132,8 +133,110 @@ namespace RTXSimplified
 		return 0;
 	}
 
+	std::vector<CPUHitGroupRecord> RTX_PathTracer::createCPUHitGroups()
+	{
+		std::vector<DirectX::XMFLOAT4> colors = rtxManager->getInitializer()	// What the instance buffers hold,
+			? rtxManager->getInitializer()->getInstanceColors()					// or what they would be created
+			: RTX_Initializer::getDefaultInstanceColors();						// with when there is no device
+		bool shadows = rtxManager->getShadowsEnabled();
+		std::vector<CPUHitGroupRecord> records;
+
+		CPUHitGroupRecord shadowRecord;
+		shadowRecord.program = CPU_HIT_PROGRAM_SHADOW;
+		for (size_t i = 0; i + 2 < colors.size(); i += 3) // HitGroup with the instance buffer, then its shadow group
+		{
+			CPUHitGroupRecord record;
+			record.program = CPU_HIT_PROGRAM_CLOSEST_HIT;
+			for (int c = 0; c < 3; c++)
+			{
+				record.colors[c] = { colors[i + c].x, colors[i + c].y, colors[i + c].z };
+			}
+			records.push_back(record);
+			if (shadows)
+			{
+				records.push_back(shadowRecord);
+			}
+		}
+
+		CPUHitGroupRecord planeRecord; // Then the plane and its shadow group
+		planeRecord.program = CPU_HIT_PROGRAM_PLANE;
+		records.push_back(planeRecord);
+		if (shadows)
+		{
+			records.push_back(shadowRecord);
+		}
+		return records;
+	}
+
+	int RTX_PathTracer::renderCPU()
+	{
+		if (!rtxManager->getInitializer()) // Error check
+		{
+			RTX_Exception::handleError("Rendering on the CPU without a camera buffer, pass the camera matrices to renderCPU.", false);
+			return 0;
+		}
+		std::vector<DirectX::XMMATRIX> camera = rtxManager->getInitializer()->getCameraMatrices();
+		if (camera.size() < 4) // Error check
+		{
+			RTX_Exception::handleError("Rendering on the CPU before the camera buffer was updated.", false);
+			return 0;
+		}
+		return renderCPU(camera[2], camera[3]);
+	}
+	int RTX_PathTracer::renderCPU(const DirectX::XMMATRIX& _viewInverse, const DirectX::XMMATRIX& _projectionInverse)
+	{
+		if (!cpuRenderer)
+		{
+			cpuRenderer = std::make_shared<RTX_CPURenderer>();
+		}
+
+		DirectX::XMFLOAT4X4 viewInverse, projectionInverse;
+		DirectX::XMStoreFloat4x4(&viewInverse, _viewInverse);
+		DirectX::XMStoreFloat4x4(&projectionInverse, _projectionInverse);
+
+		cpuRenderer->setCamera(&viewInverse.m[0][0], &projectionInverse.m[0][0]);
+		cpuRenderer->setOutputSize(rtxManager->getWidth(), rtxManager->getHeight());
+		cpuRenderer->setHitGroups(createCPUHitGroups());
+		cpuRenderer->setShadowsEnabled(rtxManager->getShadowsEnabled());
+
+		// Same instances as the GPU TLAS, any rebuild or refit means the old samples show another scene
+		const TLASUpdateStats& stats = rtxManager->getBVHManager()->getCPUTLAS().getUpdateStats();
+		uint32_t updates = stats.rebuildCount + stats.refitCount;
+		rtxManager->getBVHManager()->updateCPUTLAS();
+		if (stats.rebuildCount + stats.refitCount != updates)
+		{
+			cpuRenderer->resetAccumulation();
+		}
+		cpuRenderer->render(rtxManager->getBVHManager()->getCPUTLAS(), *rtxManager->getBVHManager()->getThreadPool());
+		return 0;
+	}
+
+	PathTracerBackend RTX_PathTracer::getBackend()
+	{
+		return backend;
+	}
+	const std::vector<uint8_t>& RTX_PathTracer::getCPUOutput()
+	{
+		if (!cpuRenderer)
+		{
+			cpuRenderer = std::make_shared<RTX_CPURenderer>();
+		}
+		return cpuRenderer->getOutput();
+	}
+	std::shared_ptr<RTX_CPURenderer> RTX_PathTracer::getCPURenderer()
+	{
+		if (!cpuRenderer)
+		{
+			cpuRenderer = std::make_shared<RTX_CPURenderer>();
+		}
+		return cpuRenderer;
+	}
 	void RTX_PathTracer::setRTXManager(std::shared_ptr<RTX_Manager> _rtxManager)
 	{
 		rtxManager = _rtxManager;
 	}
+	void RTX_PathTracer::setBackend(PathTracerBackend _backend)
+	{
+		backend = _backend;
+	}
 }
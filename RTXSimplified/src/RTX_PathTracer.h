@@ -8,25 +8,51 @@
 #include <dxgi1_4.h> // DXR
 #include <memory> // smart pointers
 #include <dxcapi.h> //DXR
+#include <DirectXMath.h> // XMMATRIX
+#include "RTX_CPURenderer.h" // CPU backend
 
 namespace RTXSimplified
 {
 	/*Forward declares*/
 	class RTX_Manager;
+
+	enum PathTracerBackend
+	{
+		PATH_TRACER_BACKEND_DXR = 0,	///< DispatchRays on the GPU.
+		PATH_TRACER_BACKEND_CPU = 1		///< RTX_CPURenderer over the CPU TLAS, for machines without a raytracing GPU.
+	}; ///< Where frames are traced.
+
 	/**
 	*	\brief The class responsible for tracing the path of light rays.
 	* 	
+	*	Frames are traced with DXR by default. The CPU backend runs the same programs over the CPU mirror
+	*	of the scene and writes an RGBA8 image laid out like the output resource. It does not need a
+	*	D3D12 device when the scene comes from createCPUAccelerationStructure and the camera is passed in.
 	*/
 	class RTX_PathTracer
 	{
 	private:
 		std::shared_ptr<RTX_Manager> rtxManager; ///< Stores a reference to the RTX manager class.
+		PathTracerBackend backend = PATH_TRACER_BACKEND_DXR; ///< Backend used by onRender.
+		std::shared_ptr<RTX_CPURenderer> cpuRenderer; ///< CPU backend, created on first use.
+
+		std::vector<CPUHitGroupRecord> createCPUHitGroups(); ///< Hit group records in the order createShaderBindingTable adds them.
 
 	public:
 		int populateCommandList(); ///< Populates the command list for execution.
+		int renderCPU(); ///< Adds a sample to the CPU image, with the camera of the camera buffer and the current instances. Stops tracing once the image converged.
+		int renderCPU(
+			const DirectX::XMMATRIX& _viewInverse,		 ///< Inverse of the view matrix.
+			const DirectX::XMMATRIX& _projectionInverse	 ///< Inverse of the projection matrix.
+		); ///< Same with the camera given directly, only needs the CPU TLAS so it also works after initializeCPU.
 
+		/*GETTERS*/
+		PathTracerBackend getBackend();
+		const std::vector<uint8_t>& getCPUOutput(); ///< RGBA8 image of the last renderCPU, width * height * 4 bytes.
+		std::shared_ptr<RTX_CPURenderer> getCPURenderer(); ///< CPU backend, for its accumulation and convergence settings.
 		/*SETTERS*/
 		void setRTXManager(std::shared_ptr<RTX_Manager> _rtxManager);
+		void setBackend(PathTracerBackend _backend);
 	};
 }
 
@@ -546,6 +546,22 @@ namespace RTXSimplified
 		// Increment the top level as SRV after the buffer
 		srvHandle.ptr += rtxManager->getInitializer()->getRTXDevice()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+		updateTLASView(); // Create the SRV
+		
+		srvHandle.ptr += rtxManager->getInitializer()->getRTXDevice()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		// Describe and create a constant buffer view for the camera
+		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
+		cbvDesc.BufferLocation = rtxManager->getInitializer()->getCameraBuffer()->GetGPUVirtualAddress();
+		cbvDesc.SizeInBytes = rtxManager->getInitializer()->getCameraBufferSize();
+		rtxManager->getInitializer()->getRTXDevice()->CreateConstantBufferView(&cbvDesc, srvHandle);
+		return 0;
+	}
+	int RTX_Pipeline::updateTLASView()
+	{
+		// The top level AS SRV sits right after the output UAV
+		D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = srvUavHeap->GetCPUDescriptorHandleForHeapStart();
+		srvHandle.ptr += rtxManager->getInitializer()->getRTXDevice()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;										// Create a desc for the SRV 
 		srvDesc.Format = DXGI_FORMAT_UNKNOWN;											// Unspecified format
 		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;  // AS dimension
@@ -554,13 +570,6 @@ namespace RTXSimplified
 			rtxManager->getBVHManager()->getTLASBuffers().result->GetGPUVirtualAddress();
 		
 		rtxManager->getInitializer()->getRTXDevice()->CreateShaderResourceView(nullptr, &srvDesc, srvHandle); // Create the SRV
-		
-		srvHandle.ptr += rtxManager->getInitializer()->getRTXDevice()->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-		// Describe and create a constant buffer view for the camera
-		D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-		cbvDesc.BufferLocation = rtxManager->getInitializer()->getCameraBuffer()->GetGPUVirtualAddress();
-		cbvDesc.SizeInBytes = rtxManager->getInitializer()->getCameraBufferSize();
-		rtxManager->getInitializer()->getRTXDevice()->CreateConstantBufferView(&cbvDesc, srvHandle);
 		return 0;
 	}
 	int RTX_Pipeline::createShaderBindingTable()
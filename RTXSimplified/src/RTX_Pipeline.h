@@ -161,6 +161,7 @@ namespace RTXSimplified
 		int createShaderSignatures(); ///< Creates the shader signatures.
 		ID3D12StateObject* generate(); ///< Generates the pipeline.
 		int createShaderResourceHeap(); ///< Creates shader resource heap.
+		int updateTLASView(); ///< Points the TLAS SRV at the current TLAS buffer, after the TLAS buffers were recreated.
 		int createShaderBindingTable(); ///< Creates shader binding table.
 
 		/*GETTERS*/
@@ -0,0 +1,117 @@
+#ifndef RTX_RAYQUEUE_H
+#define RTX_RAYQUEUE_H
+
+#include <vector> // std::vector
+#include <algorithm> // std::max
+#include <stdint.h> // uint32_t
+#include "RTX_CPUMath.h" // Ray
+#include "RTX_PacketTraversal.h" // RayPacket
+
+namespace RTXSimplified
+{
+	struct RayQueue
+	{
+		std::vector<float> originX;		///< Ray origins, one entry per ray.
+		std::vector<float> originY;
+		std::vector<float> originZ;
+		std::vector<float> directionX;	///< Ray directions.
+		std::vector<float> directionY;
+		std::vector<float> directionZ;
+		std::vector<float> tMin;		///< Closest accepted distance of each ray.
+		std::vector<float> tMax;		///< Furthest accepted distance of each ray.
+		std::vector<uint32_t> sample;	///< Sample slot the result of each ray goes to.
+		uint32_t size = 0;				///< Rays in the queue, the arrays only grow.
+
+		void clear()
+		{
+			size = 0;
+		} ///< Empties the queue, keeps the memory.
+		void push(const Ray& _ray, uint32_t _sample)
+		{
+			if (size == originX.size()) // Grown the same way as std::vector, amortized
+			{
+				size_t capacity = (std::max)(static_cast<size_t>(64), originX.size() * 2);
+				originX.resize(capacity); originY.resize(capacity); originZ.resize(capacity);
+				directionX.resize(capacity); directionY.resize(capacity); directionZ.resize(capacity);
+				tMin.resize(capacity); tMax.resize(capacity); sample.resize(capacity);
+			}
+			originX[size] = _ray.origin.x;
+			originY[size] = _ray.origin.y;
+			originZ[size] = _ray.origin.z;
+			directionX[size] = _ray.direction.x;
+			directionY[size] = _ray.direction.y;
+			directionZ[size] = _ray.direction.z;
+			tMin[size] = _ray.tMin;
+			tMax[size] = _ray.tMax;
+			sample[size] = _sample;
+			size++;
+		} ///< Appends a ray and the slot its result goes to.
+		RayPacket getPacket(uint32_t _first) const
+		{
+			RayPacket packet;
+			packet.activeMask = 0;
+			for (uint32_t i = 0; i < packetWidth; i++)
+			{
+				uint32_t index = _first + i < size ? _first + i : _first; // Unused lanes repeat the first ray and stay inactive
+				packet.originX[i] = originX[index];
+				packet.originY[i] = originY[index];
+				packet.originZ[i] = originZ[index];
+				packet.directionX[i] = directionX[index];
+				packet.directionY[i] = directionY[index];
+				packet.directionZ[i] = directionZ[index];
+				packet.tMin[i] = tMin[index];
+				packet.tMax[i] = tMax[index];
+				if (_first + i < size)
+				{
+					packet.activeMask |= 1u << i;
+				}
+			}
+			return packet;
+		} ///< Copies up to 8 rays starting at _first into a packet, lanes are straight copies of the arrays.
+	}; ///< Rays waiting for a trace stage, in structure of arrays form.
+
+	struct HitQueue
+	{
+		std::vector<float> positionX;		///< World hit positions.
+		std::vector<float> positionY;
+		std::vector<float> positionZ;
+		std::vector<float> u;				///< Barycentric of the second vertex.
+		std::vector<float> v;				///< Barycentric of the third vertex.
+		std::vector<uint32_t> hitGroupIndex;///< Record of the shader binding table that shades the hit.
+		std::vector<uint32_t> sample;		///< Sample slot the colour goes to.
+		uint32_t size = 0;					///< Hits in the queue, the arrays only grow.
+
+		void clear()
+		{
+			size = 0;
+		} ///< Empties the queue, keeps the memory.
+		void reserve(size_t _capacity)
+		{
+			if (_capacity > positionX.size()) // Grown the same way as std::vector, amortized
+			{
+				size_t capacity = (std::max)((std::max)(_capacity, static_cast<size_t>(64)), positionX.size() * 2);
+				positionX.resize(capacity); positionY.resize(capacity); positionZ.resize(capacity);
+				u.resize(capacity); v.resize(capacity);
+				hitGroupIndex.resize(capacity); sample.resize(capacity);
+			}
+		} ///< Makes room for _capacity hits.
+		void resize(uint32_t _size)
+		{
+			reserve(_size);
+			size = _size;
+		} ///< Sets the number of hits, new entries are left as they were.
+		void push(const Float3& _position, float _u, float _v, uint32_t _hitGroupIndex, uint32_t _sample)
+		{
+			reserve(size + 1);
+			positionX[size] = _position.x;
+			positionY[size] = _position.y;
+			positionZ[size] = _position.z;
+			u[size] = _u;
+			v[size] = _v;
+			hitGroupIndex[size] = _hitGroupIndex;
+			sample[size] = _sample;
+			size++;
+		} ///< Appends a hit and the slot its colour goes to.
+	}; ///< Hits waiting for the shading stage of one hit program, in structure of arrays form.
+}
+#endif // !RTX_RAYQUEUE_H
@@ -0,0 +1,256 @@
+#include "RTX_Sampler.h"
+#include <cmath> // expf
+#include <cfloat> // FLT_MAX
+#include <algorithm> // std::min, std::fill
+
+namespace RTXSimplified
+{
+	const uint32_t RTX_Sampler::latticeGenerator[4] = { 1, 182667, 469891, 498753 }; // Cools, Kuo and Nuyens, extensible in base 2 up to 2^20 points
+
+	static inline uint32_t reverseBits(uint32_t _value)
+	{
+		_value = ((_value >> 1) & 0x55555555u) | ((_value & 0x55555555u) << 1);
+		_value = ((_value >> 2) & 0x33333333u) | ((_value & 0x33333333u) << 2);
+		_value = ((_value >> 4) & 0x0F0F0F0Fu) | ((_value & 0x0F0F0F0Fu) << 4);
+		_value = ((_value >> 8) & 0x00FF00FFu) | ((_value & 0x00FF00FFu) << 8);
+		return (_value >> 16) | (_value << 16);
+	}
+
+	static inline uint32_t nestedUniformScramble(uint32_t _value, uint32_t _seed)
+	{
+		// Laine-Karras permutation on the reversed bits, every bit only depends on the bits above it, like an Owen scramble
+		_value = reverseBits(_value);
+		_value ^= _value * 0x3d20adeau;
+		_value += _seed;
+		_value *= (_seed >> 16) | 1u;
+		_value ^= _value * 0x05526c56u;
+		_value ^= _value * 0x53a22864u;
+		return reverseBits(_value);
+	}
+
+	static inline float toUnitFloat(uint32_t _value)
+	{
+		return (_value >> 8) * (1.0f / 16777216.0f); // 24 bits, so 1 is never reached
+	}
+
+	RTX_Sampler::RTX_Sampler()
+	{
+		buildSobolMatrices();
+	}
+
+	void RTX_Sampler::buildSobolMatrices()
+	{
+		// Degree, polynomial and initial direction numbers of dimensions 2 to 4, dimension 1 is the van der Corput sequence
+		static const uint32_t degrees[3] = { 1, 2, 3 };
+		static const uint32_t polynomials[3] = { 0, 1, 1 };
+		static const uint32_t initial[3][3] = { { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 } };
+
+		for (uint32_t bit = 0; bit < 32; bit++)
+		{
+			sobolMatrices[0][bit] = 1u << (31 - bit);
+		}
+		for (uint32_t d = 1; d < sobolDimensions; d++)
+		{
+			uint32_t s = degrees[d - 1], a = polynomials[d - 1];
+			uint32_t* v = sobolMatrices[d];
+			for (uint32_t bit = 0; bit < 32; bit++)
+			{
+				if (bit < s)
+				{
+					v[bit] = initial[d - 1][bit] << (31 - bit);
+					continue;
+				}
+				v[bit] = v[bit - s] ^ (v[bit - s] >> s);
+				for (uint32_t k = 1; k < s; k++)
+				{
+					if ((a >> (s - 1 - k)) & 1)
+					{
+						v[bit] ^= v[bit - k];
+					}
+				}
+			}
+		}
+	}
+
+	void RTX_Sampler::buildBlueNoiseMasks()
+	{
+		const uint32_t size = blueNoiseSize, count = size * size;
+		const float sigma = 1.5f; // Width of the energy filter, in pixels
+
+		// Gaussian energy of a pixel at every toroidal offset, so each update is one pass over the mask
+		std::vector<float> kernel(count);
+		for (uint32_t y = 0; y < size; y++)
+		{
+			for (uint32_t x = 0; x < size; x++)
+			{
+				float dx = static_cast<float>((std::min)(x, size - x)), dy = static_cast<float>((std::min)(y, size - y));
+				kernel[y * size + x] = expf(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+			}
+		}
+
+		blueNoiseMasks.assign(count * 2, 0);
+		std::vector<uint8_t> pattern(count);
+		std::vector<uint8_t> prototype(count);
+		std::vector<float> energy(count);
+		for (uint32_t m = 0; m < 2; m++)
+		{
+			auto toggle = [&](uint32_t _pixel, float _sign)
+			{
+				uint32_t px = _pixel % size, py = _pixel / size;
+				for (uint32_t y = 0; y < size; y++)
+				{
+					const float* row = &kernel[((y - py) & (size - 1)) * size]; // Size is a power of 2, the mask wraps the offset
+					for (uint32_t x = 0; x < size; x++)
+					{
+						energy[y * size + x] += _sign * row[(x - px) & (size - 1)];
+					}
+				}
+				pattern[_pixel] = _sign > 0.0f ? 1 : 0;
+			};
+			auto extreme = [&](uint8_t _value, bool _highest)
+			{
+				uint32_t best = 0;
+				float bestEnergy = _highest ? -1.0f : FLT_MAX;
+				for (uint32_t p = 0; p < count; p++)
+				{
+					if (pattern[p] == _value && (_highest ? energy[p] > bestEnergy : energy[p] < bestEnergy))
+					{
+						best = p;
+						bestEnergy = energy[p];
+					}
+				}
+				return best;
+			}; // Tightest cluster of ones or largest void of zeros
+
+			// Random initial tenth of the pixels, relaxed until the tightest cluster is the largest void
+			std::fill(pattern.begin(), pattern.end(), 0);
+			std::fill(energy.begin(), energy.end(), 0.0f);
+			uint32_t ones = 0;
+			for (uint32_t i = 0; ones < count / 10; i++)
+			{
+				uint32_t p = hash(i, m, 0x9e3779b9u) % count;
+				if (!pattern[p])
+				{
+					toggle(p, 1.0f);
+					ones++;
+				}
+			}
+			for (uint32_t i = 0; i < count; i++) // Settles in a few hundred swaps, the cap only guards against a cycle
+			{
+				uint32_t cluster = extreme(1, true);
+				toggle(cluster, -1.0f);
+				uint32_t gap = extreme(0, false);
+				toggle(gap, 1.0f);
+				if (gap == cluster)
+				{
+					break;
+				}
+			}
+			prototype = pattern;
+
+			// Ranks of the initial ones, tightest clusters removed first get the highest
+			uint16_t* mask = &blueNoiseMasks[m * count];
+			std::vector<float> prototypeEnergy = energy;
+			for (uint32_t rank = ones; rank > 0; rank--)
+			{
+				uint32_t cluster = extreme(1, true);
+				toggle(cluster, -1.0f);
+				mask[cluster] = static_cast<uint16_t>(rank - 1);
+			}
+
+			// Then every other pixel, each one filling the largest void left
+			pattern = prototype;
+			energy = prototypeEnergy;
+			for (uint32_t rank = ones; rank < count; rank++)
+			{
+				uint32_t gap = extreme(0, false);
+				toggle(gap, 1.0f);
+				mask[gap] = static_cast<uint16_t>(rank);
+			}
+		}
+	}
+
+	uint32_t RTX_Sampler::sobol(uint32_t _index, uint32_t _dimension) const
+	{
+		const uint32_t* matrix = sobolMatrices[_dimension];
+		uint32_t value = 0;
+		for (uint32_t bit = 0; _index != 0; _index >>= 1, bit++)
+		{
+			if (_index & 1)
+			{
+				value ^= matrix[bit];
+			}
+		}
+		return value;
+	}
+
+	float RTX_Sampler::sample(uint32_t _x, uint32_t _y, uint32_t _index, uint32_t _dimension) const
+	{
+		uint32_t pixelSeed = getPixelSeed(_x, _y);
+		uint32_t tableDimension = _dimension % sobolDimensions; // Higher dimensions are padded with differently scrambled copies
+		switch (type)
+		{
+		case SAMPLER_TYPE_SOBOL:
+		{
+			uint32_t index = nestedUniformScramble(_index, pixelSeed); // Shuffled per pixel, so pixels do not share their first points
+			return toUnitFloat(nestedUniformScramble(sobol(index, tableDimension), hash(pixelSeed, _dimension, 0x68bc21ebu)));
+		}
+		case SAMPLER_TYPE_LATTICE:
+		{
+			// Radical inverse of the index times the generator, modulo 1 in 0.32 fixed point, plus a random shift.
+			// Padded dimensions scale the generator by an odd number, so they do not repeat the points of the first four
+			uint32_t generator = latticeGenerator[tableDimension] * (1u + 2u * (_dimension / sobolDimensions));
+			return toUnitFloat(reverseBits(_index) * generator + hash(pixelSeed, _dimension, 0x02e5be93u));
+		}
+		case SAMPLER_TYPE_BLUE_NOISE:
+		{
+			// Every pixel walks the same Sobol points, shifted by its mask value, so neighbours stay apart
+			uint32_t offset = hash(seed, _dimension, 0x7f4a7c15u);
+			uint32_t maskX = (_x + offset) % blueNoiseSize, maskY = (_y + (offset >> 16)) % blueNoiseSize;
+			uint32_t rank = blueNoiseMasks[(_dimension & 1) * blueNoiseSize * blueNoiseSize + maskY * blueNoiseSize + maskX];
+			uint32_t shift = static_cast<uint32_t>((rank * 2 + 1) * (4294967296.0 / (2.0 * blueNoiseSize * blueNoiseSize)));
+			return toUnitFloat(sobol(_index, tableDimension) + shift);
+		}
+		default:
+			return toUnitFloat(hash(pixelSeed, _index, _dimension));
+		}
+	}
+
+	uint32_t RTX_Sampler::getPixelSeed(uint32_t _x, uint32_t _y) const
+	{
+		return hash(_x, _y, seed);
+	}
+
+	uint32_t RTX_Sampler::hash(uint32_t _a, uint32_t _b, uint32_t _c)
+	{
+		uint32_t h = _a * 0x8da6b343u ^ _b * 0xd8163841u ^ _c * 0xcb1ab31fu;
+		h ^= h >> 16;
+		h *= 0x7feb352du;
+		h ^= h >> 15;
+		h *= 0x846ca68bu;
+		h ^= h >> 16;
+		return h;
+	}
+
+	SamplerType RTX_Sampler::getType() const
+	{
+		return type;
+	}
+	void RTX_Sampler::setType(SamplerType _type)
+	{
+		if (_type > SAMPLER_TYPE_BLUE_NOISE) // Error check
+		{
+			RTX_Exception::handleError("Unknown sampler type.", false);
+			return;
+		}
+		if (_type == SAMPLER_TYPE_BLUE_NOISE && blueNoiseMasks.empty())
+		{
+			buildBlueNoiseMasks();
+		}
+		type = _type;
+	}
+	void RTX_Sampler::setSeed(uint32_t _seed)
+	{
+		seed = _seed;
+	}
+}
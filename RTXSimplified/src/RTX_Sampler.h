@@ -0,0 +1,63 @@
+#ifndef RTX_SAMPLER_H
+#define RTX_SAMPLER_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint32_t
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	enum SamplerType
+	{
+		SAMPLER_TYPE_RANDOM = 0,		///< Independent hashed values, no stratification.
+		SAMPLER_TYPE_SOBOL = 1,			///< Owen scrambled Sobol, every power of 2 prefix of a pixel's samples is stratified.
+		SAMPLER_TYPE_LATTICE = 2,		///< Extensible rank-1 lattice, randomly shifted per pixel.
+		SAMPLER_TYPE_BLUE_NOISE = 3		///< Sobol shifted by a tiled blue noise mask, the error of neighbouring pixels is spread to high frequencies.
+	}; ///< How sample values are generated.
+
+	/**
+	*	\brief The class responsible for the sample values of the CPU renderer.
+	*
+	*	Values are a pure function of the pixel, the sample index and the dimension, so tiles and threads
+	*	can draw them in any order. Each pixel gets a seed hashed from its coordinates and the frame seed,
+	*	and its samples are the first indices of a low discrepancy sequence decorrelated by that seed.
+	*	The Sobol generator matrices and the blue noise masks are built once into small tables, 512 bytes
+	*	and 16 KB, that stay in cache while a tile is traced.
+	*/
+	class RTX_Sampler
+	{
+	private:
+		SamplerType type = SAMPLER_TYPE_SOBOL; ///< Sequence used by sample.
+		uint32_t seed = 0; ///< Frame seed mixed into every pixel seed.
+		uint32_t sobolMatrices[4][32]; ///< Generator matrices of the first Sobol dimensions, one column per index bit, most significant bit first.
+		std::vector<uint16_t> blueNoiseMasks; ///< Two 64x64 void and cluster masks, ranks 0 to 4095. Built on first use.
+
+		static const uint32_t sobolDimensions = 4; ///< Higher dimensions reuse these with another scramble.
+		static const uint32_t blueNoiseSize = 64; ///< Width and height of a blue noise mask, tiled over the image.
+		static const uint32_t latticeGenerator[4]; ///< Generating vector of the rank-1 lattice.
+
+		void buildSobolMatrices(); ///< Direction numbers of Joe and Kuo.
+		void buildBlueNoiseMasks(); ///< Void and cluster, around 100 ms, so only when the blue noise type is first set.
+		uint32_t sobol(uint32_t _index, uint32_t _dimension) const; ///< Unscrambled Sobol point as 0.32 fixed point.
+
+	public:
+		RTX_Sampler();
+
+		float sample(
+			uint32_t _x,			///< Pixel column.
+			uint32_t _y,			///< Pixel row.
+			uint32_t _index,		///< Sample of the pixel, 0 for the first one.
+			uint32_t _dimension		///< Dimension of the sample, 0 and 1 for the position in the pixel.
+		) const; ///< Value in [0, 1).
+		uint32_t getPixelSeed(uint32_t _x, uint32_t _y) const; ///< Counter based seed of a pixel, no state is kept per pixel.
+
+		static uint32_t hash(uint32_t _a, uint32_t _b, uint32_t _c); ///< Decorrelated bits for every input triple.
+
+		/*GETTERS*/
+		SamplerType getType() const;
+		/*SETTERS*/
+		void setType(SamplerType _type);
+		void setSeed(uint32_t _seed); ///< Changes every value, for independent renders of the same view.
+	};
+}
+#endif // !RTX_SAMPLER_H
@@ -0,0 +1,100 @@
+#include "RTX_ScratchPool.h"
+
+namespace RTXSimplified
+{
+	RTX_ScratchPool::RTX_ScratchPool(std::function<ComPtr<ID3D12Resource>(UINT64)> _allocate)
+		: allocate(_allocate)
+	{
+	}
+
+	int RTX_ScratchPool::reserve(UINT64 _scratchSize)
+	{
+		if (batchFenceValue != 0) // Previous batch was closed, this starts a new one
+		{
+			batchFenceValue = 0;
+			batchRequirement = 0;
+			buildsUsingArena = 0;
+		}
+		if (_scratchSize > batchRequirement)
+		{
+			batchRequirement = _scratchSize;
+		}
+		return 0;
+	}
+
+	ID3D12Resource* RTX_ScratchPool::acquire(ID3D12GraphicsCommandList4* _commandList)
+	{
+		if (batchRequirement == 0) // Error check
+		{
+			RTX_Exception::handleError("Acquiring scratch memory without reserving it first.", true);
+		}
+
+		if (arenaSize < batchRequirement) // Arena missing or too small for the batch
+		{
+			if (arena) // Builds already recorded on it may still be running, keep it until the fence
+			{
+				retired.push_back(std::make_pair(arena, arenaSize));
+			}
+			arena = allocate(batchRequirement);
+			arenaSize = batchRequirement;
+			allocatedBytes += arenaSize;
+			allocationCount++;
+			if (allocatedBytes > peakBytes)
+			{
+				peakBytes = allocatedBytes;
+			}
+			buildsUsingArena = 0;
+		}
+		else if (buildsUsingArena > 0 && _commandList) // Previous build must be done with the scratch before it is overwritten
+		{
+			D3D12_RESOURCE_BARRIER uavBarrier;						// Store info about the UAV barrier
+			uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;		// type Unordered Access View
+			uavBarrier.UAV.pResource = arena.Get();					// wait for the scratch buffer
+			uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;	// no flags
+			_commandList->ResourceBarrier(1, &uavBarrier);			// build the barrier
+		}
+
+		buildsUsingArena++;
+		return arena.Get();
+	}
+
+	int RTX_ScratchPool::endBatch(UINT64 _fenceValue)
+	{
+		batchFenceValue = _fenceValue;
+		return 0;
+	}
+
+	int RTX_ScratchPool::releaseCompleted(UINT64 _completedFenceValue)
+	{
+		if (batchFenceValue == 0 || _completedFenceValue < batchFenceValue) // Batch still open or still on the GPU
+		{
+			return 1;
+		}
+
+		for (size_t i = 0; i < retired.size(); i++)
+		{
+			allocatedBytes -= retired[i].second;
+		}
+		retired.clear();
+		allocatedBytes -= arenaSize;
+		arena.Reset();
+		arenaSize = 0;
+		batchRequirement = 0;
+		buildsUsingArena = 0;
+
+		return 0;
+	}
+
+	UINT64 RTX_ScratchPool::getAllocatedBytes()
+	{
+		return allocatedBytes;
+	}
+	UINT64 RTX_ScratchPool::getPeakBytes()
+	{
+		return peakBytes;
+	}
+	UINT RTX_ScratchPool::getAllocationCount()
+	{
+		return allocationCount;
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef RTX_SCRATCHPOOL_H
+#define RTX_SCRATCHPOOL_H
+
+#include <d3d12.h> // ID3D12Resource
+#include <wrl.h> // Windows Runtime Library -> ComPtr
+#include <vector> // std::vector
+#include <functional> // std::function
+#include "RTX_Exception.h" // Error handling
+
+using Microsoft::WRL::ComPtr; ///< Smart pointer for interfaces
+
+namespace RTXSimplified
+{
+	/**
+	*	\brief The class responsible for sharing one scratch buffer between a batch of acceleration structure builds.
+	*
+	*	Every build of the batch reserves its scratch size first, then one arena of the largest size is
+	*	allocated and handed to each build in turn, with a UAV barrier in between. The arena is freed once
+	*	the fence signalled after the batch has completed. Allocation goes through a callback so the pool
+	*	can run against a mock device that only counts bytes.
+	*/
+	class RTX_ScratchPool
+	{
+	private:
+		std::function<ComPtr<ID3D12Resource>(UINT64)> allocate; ///< Creates a UAV buffer of the given size.
+		ComPtr<ID3D12Resource> arena; ///< Scratch buffer shared by the current batch.
+		UINT64 arenaSize = 0; ///< Size of the arena.
+		std::vector<std::pair<ComPtr<ID3D12Resource>, UINT64>> retired; ///< Arenas outgrown mid batch, still referenced by recorded builds.
+		UINT64 batchRequirement = 0; ///< Largest scratch size reserved in the current batch.
+		UINT buildsUsingArena = 0; ///< Builds recorded on the arena since the last barrier point.
+		UINT64 batchFenceValue = 0; ///< Fence value that marks the end of the batch, 0 = batch still open.
+		UINT64 allocatedBytes = 0; ///< Scratch memory currently alive.
+		UINT64 peakBytes = 0; ///< Highest value of allocatedBytes.
+		UINT allocationCount = 0; ///< Number of arenas created.
+
+	public:
+		RTX_ScratchPool(std::function<ComPtr<ID3D12Resource>(UINT64)> _allocate); ///< Constructor, takes the buffer allocator.
+
+		int reserve(UINT64 _scratchSize); ///< Adds a build to the batch.
+		ID3D12Resource* acquire(ID3D12GraphicsCommandList4* _commandList); ///< Scratch for the next build, waits on the previous build with a UAV barrier.
+		int endBatch(UINT64 _fenceValue); ///< Closes the batch, its memory can go once the fence reaches this value.
+		int releaseCompleted(UINT64 _completedFenceValue); ///< Frees the arena if the batch fence has completed, returns 1 if it is still in flight.
+
+		/*GETTERS*/
+		UINT64 getAllocatedBytes();
+		UINT64 getPeakBytes();
+		UINT getAllocationCount();
+	};
+}
+#endif // !RTX_SCRATCHPOOL_H
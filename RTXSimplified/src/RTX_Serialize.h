@@ -0,0 +1,71 @@
+#ifndef RTX_SERIALIZE_H
+#define RTX_SERIALIZE_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint64_t
+#include <string.h> // memcpy
+#include <type_traits> // std::is_trivially_copyable
+
+namespace RTXSimplified
+{
+	// Sections are padded to 16 bytes so arrays stay aligned inside a mapped file.
+	static const size_t serializeAlignment = 16;
+
+	/**
+	*	Appends a plain value to a serialized blob.
+	*/
+	template <typename T>
+	inline void writeValue(std::vector<char>& _out, const T& _value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be serialized.");
+		const char* bytes = reinterpret_cast<const char*>(&_value);
+		_out.insert(_out.end(), bytes, bytes + sizeof(T));
+		_out.resize((_out.size() + serializeAlignment - 1) & ~(serializeAlignment - 1), 0);
+	}
+
+	/**
+	*	Appends an array as its element count followed by the raw elements.
+	*/
+	template <typename T>
+	inline void writeArray(std::vector<char>& _out, const std::vector<T>& _array)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be serialized.");
+		writeValue(_out, static_cast<uint64_t>(_array.size()));
+		const char* bytes = reinterpret_cast<const char*>(_array.data());
+		_out.insert(_out.end(), bytes, bytes + _array.size() * sizeof(T));
+		_out.resize((_out.size() + serializeAlignment - 1) & ~(serializeAlignment - 1), 0);
+	}
+
+	/**
+	*	Reads a value written by writeValue. Moves _offset past it, returns false if the blob is too short.
+	*/
+	template <typename T>
+	inline bool readValue(const char* _data, size_t _size, size_t& _offset, T& _value)
+	{
+		if (_offset + sizeof(T) > _size)
+		{
+			return false;
+		}
+		memcpy(&_value, _data + _offset, sizeof(T));
+		_offset = (_offset + sizeof(T) + serializeAlignment - 1) & ~(serializeAlignment - 1);
+		return true;
+	}
+
+	/**
+	*	Reads an array written by writeArray. Moves _offset past it, returns false if the blob is too short.
+	*/
+	template <typename T>
+	inline bool readArray(const char* _data, size_t _size, size_t& _offset, std::vector<T>& _array)
+	{
+		uint64_t count = 0;
+		if (!readValue(_data, _size, _offset, count) || count > (_size - _offset) / sizeof(T))
+		{
+			return false;
+		}
+		_array.resize(static_cast<size_t>(count));
+		memcpy(_array.data(), _data + _offset, static_cast<size_t>(count) * sizeof(T));
+		_offset = (_offset + static_cast<size_t>(count) * sizeof(T) + serializeAlignment - 1) & ~(serializeAlignment - 1);
+		return true;
+	}
+}
+#endif // !RTX_SERIALIZE_H
@@ -1,42 +1,89 @@
 #include "RTX_TLAS.h"
+#include "RTX_CPUMath.h" // RTX_SIMD_SSE2
+#include <algorithm> // std::min, std::max, std::sort
 
 namespace RTXSimplified
 {
-	Instance::Instance(ID3D12Resource* _blas, const DirectX::XMMATRIX& _tr, UINT _iID, UINT _hgID)
-		: bottomLevelAS(_blas), transformMat(_tr), instanceID(_iID), hitGroupIndex(_hgID)
+	static_assert(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) == sizeof(InstanceTransform) + sizeof(InstanceDescTail), "Instance descriptors are a transform followed by a tail.");
+
+	/**
+	*	Copies one 64 byte descriptor. The upload heap is write combined, so with SSE2 the four
+	*	16 byte pieces are streamed straight to memory instead of going through the cache.
+	*/
+	static inline void copyDescriptor(D3D12_RAYTRACING_INSTANCE_DESC* _descriptor, const InstanceTransform& _transform, const InstanceDescTail& _tail, bool _stream)
+	{
+#if defined(RTX_SIMD_SSE2)
+		if (_stream)
+		{
+			float* destination = reinterpret_cast<float*>(_descriptor);
+			_mm_stream_ps(destination, _mm_load_ps(_transform.rows[0]));
+			_mm_stream_ps(destination + 4, _mm_load_ps(_transform.rows[1]));
+			_mm_stream_ps(destination + 8, _mm_load_ps(_transform.rows[2]));
+			_mm_stream_si128(reinterpret_cast<__m128i*>(destination + 12), _mm_load_si128(reinterpret_cast<const __m128i*>(&_tail)));
+			return;
+		}
+#endif
+		memcpy(_descriptor->Transform, _transform.rows, sizeof(InstanceTransform));
+		memcpy(reinterpret_cast<char*>(_descriptor) + sizeof(InstanceTransform), &_tail, sizeof(InstanceDescTail));
+	}
+
+	Instance::Instance(ID3D12Resource* _blas, UINT _iID, UINT _hgID, UINT _mask, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
+		: bottomLevelAS(_blas), instanceID(_iID), hitGroupIndex(_hgID), instanceMask(_mask), flags(_flags)
 	{
 	}
-	int RTX_TLAS::generate(ID3D12GraphicsCommandList4* _commandList, ID3D12Resource* _scratchBuffer, ID3D12Resource* _resultBuffer, ID3D12Resource* _descriptorBuffer, bool _updateOnly, ID3D12Resource* _previousResult)
+	int RTX_TLAS::generate(ID3D12GraphicsCommandList4* _commandList, ID3D12Resource* _scratchBuffer, ID3D12Resource* _resultBuffer, ID3D12Resource* _descriptorBuffer, RTX_UploadRing* _uploadRing, bool _updateOnly, ID3D12Resource* _previousResult)
 	{
-		// Copy the descriptors in the descriptor buffer.
-		D3D12_RAYTRACING_INSTANCE_DESC* instanceDescs;
-		_descriptorBuffer->Map(0, nullptr, reinterpret_cast<void**>(&instanceDescs));
-		if (!instanceDescs) // Error check
+		if (_updateOnly && dirtyInstances.empty()) // Nothing moved, the TLAS from last frame is still valid
+		{
+			return 0;
+		}
+		if (_updateOnly && countChanged) // Error check
 		{
-			RTX_Exception::handleError("Failed to map the instance descriptor buffer.", true);
+			RTX_Exception::handleError("Trying to update a TLAS whose instance count changed, it needs a full build.", true);
 		}
 
 		UINT instanceCount = static_cast<UINT>(instances.size()); // Get the number of instances
-		
-		if (!_updateOnly) // If this is the first generation
+
+		// Descriptors that changed, grouped in runs of neighbours, all of them for a full build
+		std::vector<DescriptorRun> runs;
+		UINT runDescriptors = collectDirtyRuns(runs, !_updateOnly);
+		if (!_updateOnly)
 		{
-			ZeroMemory(instanceDescs, descriptorSize); // Initialize the memory to be used to 0
+			countChanged = false;
+			rebuildRequested = false;
 		}
 
-		// For each instance
-		for (uint32_t i = 0; i < instanceCount; i++)
+		if (runDescriptors > 0)
 		{
-			/* Make a descriptor */
-			instanceDescs[i].InstanceID = instances[i].instanceID; // Copy the iID
-			instanceDescs[i].InstanceContributionToHitGroupIndex = instances[i].hitGroupIndex; // Copy the gID
-			instanceDescs[i].Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE; // Use default flags
-			DirectX::XMMATRIX matrix = DirectX::XMMatrixTranspose(instances[i].transformMat); // Needs to be transposed cause GLM and instance desc mats are different.
-			memcpy(instanceDescs[i].Transform, &matrix, sizeof(instanceDescs[i].Transform)); // Copy the matrix
-			instanceDescs[i].AccelerationStructure = instances[i].bottomLevelAS->GetGPUVirtualAddress(); // Copy BLAS.
-			instanceDescs[i].InstanceMask = 0xFF; // Default always visible value
-		}
+			// Write them packed in the upload ring, the descriptor buffer may still be read by a build in flight
+			UploadAllocation upload = _uploadRing->allocate(runDescriptors * sizeof(D3D12_RAYTRACING_INSTANCE_DESC), D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT);
+			if (!upload.cpuAddress) // Error check
+			{
+				RTX_Exception::handleError("No upload memory for the instance descriptors.", true);
+			}
+			writeDescriptors(static_cast<D3D12_RAYTRACING_INSTANCE_DESC*>(upload.cpuAddress), runs);
 
-		_descriptorBuffer->Unmap(0, nullptr);
+			// Then copy each run to its place in the descriptor buffer
+			D3D12_RESOURCE_BARRIER barrier = {};											// Store info about the transition
+			barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;							// type transition
+			barrier.Transition.pResource = _descriptorBuffer;								// of the descriptor buffer
+			barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;		// all of it
+			barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;	// from where builds read it
+			barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;					// to copy destination
+			_commandList->ResourceBarrier(1, &barrier);
+			UINT written = 0;
+			for (size_t r = 0; r < runs.size(); r++)
+			{
+				_commandList->CopyBufferRegion(
+					_descriptorBuffer, runs[r].first * sizeof(D3D12_RAYTRACING_INSTANCE_DESC),	// to the run's place
+					upload.resource, upload.offset + written * sizeof(D3D12_RAYTRACING_INSTANCE_DESC), // from the ring
+					runs[r].count * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+				written += runs[r].count;
+			}
+			barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;				// and back
+			barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+			_commandList->ResourceBarrier(1, &barrier);
+		}
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS localFlags = flags; // Use the flags generated before to check if update or construct.
 		if (localFlags == D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE && _updateOnly)
@@ -70,6 +117,14 @@ namespace RTXSimplified
 		buildDesc.SourceAccelerationStructureData = _updateOnly ? _previousResult->GetGPUVirtualAddress() : 0; // get previous BLAS if available
 
 		_commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr); // Build the AS
+		if (_updateOnly)
+		{
+			refitCount++;
+		}
+		else
+		{
+			rebuildCount++;
+		}
 
 		/*UAV barrier -> used to ensure this buffer is complete before moving on*/
 		D3D12_RESOURCE_BARRIER uavBarrier;						// Store info about the UAV barrier
@@ -80,6 +135,78 @@ namespace RTXSimplified
 
 		return 0;
 	}
+	UINT RTX_TLAS::collectDirtyRuns(std::vector<DescriptorRun>& _runs, bool _all)
+	{
+		_runs.clear();
+		UINT instanceCount = static_cast<UINT>(instances.size());
+		UINT descriptorCount = 0;
+		if (_all)
+		{
+			if (instanceCount > 0)
+			{
+				DescriptorRun run;
+				run.first = 0;
+				run.count = instanceCount;
+				_runs.push_back(run);
+			}
+			descriptorCount = instanceCount;
+			std::fill(dirtyFlags.begin(), dirtyFlags.end(), static_cast<uint8_t>(0));
+		}
+		else
+		{
+			std::sort(dirtyInstances.begin(), dirtyInstances.end()); // Neighbours end up next to each other
+			for (size_t d = 0; d < dirtyInstances.size(); d++)
+			{
+				UINT i = dirtyInstances[d];
+				if (!_runs.empty() && _runs.back().first + _runs.back().count == i) // Extends the previous run
+				{
+					_runs.back().count++;
+				}
+				else
+				{
+					DescriptorRun run;
+					run.first = i;
+					run.count = 1;
+					_runs.push_back(run);
+				}
+				dirtyFlags[i] = 0;
+			}
+			descriptorCount = static_cast<UINT>(dirtyInstances.size());
+		}
+		dirtyInstances.clear();
+		return descriptorCount;
+	}
+	int RTX_TLAS::writeDescriptors(D3D12_RAYTRACING_INSTANCE_DESC* _descriptors, const std::vector<DescriptorRun>& _runs)
+	{
+		bool stream = (reinterpret_cast<uintptr_t>(_descriptors) & 15) == 0; // Ring allocations always are
+		for (size_t r = 0; r < _runs.size(); r++)
+		{
+			for (UINT i = _runs[r].first; i < _runs[r].first + _runs[r].count; i++)
+			{
+				copyDescriptor(_descriptors++, transforms[i], descTails[i], stream);
+			}
+		}
+#if defined(RTX_SIMD_SSE2)
+		_mm_sfence(); // Streamed stores are visible before the GPU is told to read them
+#endif
+		return 0;
+	}
+	void RTX_TLAS::toInstanceTransform(const DirectX::XMMATRIX& _matrix, InstanceTransform& _transform)
+	{
+		DirectX::XMMATRIX matrix = DirectX::XMMatrixTranspose(_matrix); // Needs to be transposed cause GLM and instance desc mats are different.
+		memcpy(_transform.rows, &matrix, sizeof(_transform.rows)); // Only the first 3 rows are stored
+	}
+	int RTX_TLAS::packDescTail(UINT _instance)
+	{
+		D3D12_RAYTRACING_INSTANCE_DESC descriptor = {}; // Let the compiler place the bit fields
+		descriptor.InstanceID = instances[_instance].instanceID; // Copy the iID
+		descriptor.InstanceMask = instances[_instance].instanceMask & 0xFF; // Copy the visibility mask, only 8 bits are stored
+		descriptor.InstanceContributionToHitGroupIndex = instances[_instance].hitGroupIndex; // Copy the gID
+		descriptor.Flags = instances[_instance].flags; // Copy the culling and opacity overrides
+		descriptor.AccelerationStructure = instances[_instance].bottomLevelAS ? instances[_instance].bottomLevelAS->GetGPUVirtualAddress() : 0; // Copy BLAS, 0 leaves the instance inactive
+		memcpy(&descTails[_instance], reinterpret_cast<const char*>(&descriptor) + sizeof(InstanceTransform), sizeof(InstanceDescTail));
+		return 0;
+	}
 	int RTX_TLAS::computeASBufferSize(ID3D12Device5* _device, bool _allowUpdate, UINT64* _scratchSizeInBytes, UINT64* _resultSizeInBytes, UINT64* _descriptorsSizeInBytes)
 	{
 		flags = _allowUpdate				// Set whether updates are allowed or not
@@ -89,7 +216,7 @@ namespace RTXSimplified
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS prebuildDesc = {};			// Contains info about work requested.
 		prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;		// its a top level AS
 		prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;							// how geometry descriptions are specified
-		prebuildDesc.NumDescs = static_cast<UINT>(instances.size());					// the number of descs matches the number of instances
+		prebuildDesc.NumDescs = (std::max)(capacity, static_cast<UINT>(instances.size())); // room for every instance, or the reserved capacity
 		prebuildDesc.Flags = flags;														// apply flags
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {}; // Stores sizes of scratch and result
@@ -105,7 +232,8 @@ namespace RTXSimplified
 		
 		// Calculte descriptor size from instance count
 		// size = size of a descriptor * nr of instances, alligned to 256-bytes
-		descriptorSize = ROUND_UP(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(instances.size()), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		capacity = prebuildDesc.NumDescs; // The buffers about to be made fit this many
+		descriptorSize = ROUND_UP(sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(capacity), D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
 		// Feedback results
 		*_scratchSizeInBytes = scratchSize;
@@ -114,9 +242,233 @@ namespace RTXSimplified
 
 		return 0;
 	}
-	int RTX_TLAS::addInstance(ID3D12Resource* _bottomLevelAS, const DirectX::XMMATRIX& _transform, UINT _instanceID, UINT _hitGroupIndex)
+	InstanceHandle RTX_TLAS::addInstance(ID3D12Resource* _bottomLevelAS, const DirectX::XMMATRIX& _transform, UINT _instanceID, UINT _hitGroupIndex, UINT _instanceMask, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
 	{
-		instances.emplace_back(Instance(_bottomLevelAS, _transform, _instanceID, _hitGroupIndex));
+		if (_instanceMask > 0xFF) // Error check
+		{
+			RTX_Exception::handleError("Instance mask only has 8 bits, the upper ones are dropped.", false);
+		}
+
+		uint32_t slot = firstFreeSlot; // Reuse a freed slot, its generation already moved on
+		if (slot == UINT32_MAX)
+		{
+			slot = static_cast<uint32_t>(slots.size());
+			slots.push_back(InstanceSlot());
+		}
+		else
+		{
+			firstFreeSlot = slots[slot].nextFree;
+		}
+		slots[slot].denseIndex = static_cast<uint32_t>(instances.size());
+		slots[slot].nextFree = UINT32_MAX;
+
+		instances.emplace_back(Instance(_bottomLevelAS, _instanceID, _hitGroupIndex, _instanceMask, _flags));
+		transforms.emplace_back();
+		toInstanceTransform(_transform, transforms.back());
+		descTails.emplace_back();
+		packDescTail(static_cast<UINT>(instances.size() - 1));
+		denseSlots.push_back(slot);
+		dirtyFlags.push_back(0);
+		markDirty(static_cast<UINT>(instances.size() - 1)); // New instances always need writing
+		countChanged = true;
+
+		InstanceHandle handle;
+		handle.slot = slot;
+		handle.generation = slots[slot].generation;
+		return handle;
+	}
+	int RTX_TLAS::removeInstance(InstanceHandle _instance)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to remove an instance that is not in the TLAS.", false);
+			return 1;
+		}
+
+		uint32_t removed = slots[_instance.slot].denseIndex;
+		uint32_t last = static_cast<uint32_t>(instances.size() - 1);
+		if (dirtyFlags[last]) // The last index is about to disappear, drop it from the dirty list
+		{
+			for (size_t d = 0; d < dirtyInstances.size(); d++)
+			{
+				if (dirtyInstances[d] == last)
+				{
+					dirtyInstances[d] = dirtyInstances.back();
+					dirtyInstances.pop_back();
+					break;
+				}
+			}
+			dirtyFlags[last] = 0;
+		}
+		if (removed != last) // Move the last instance into the hole
+		{
+			instances[removed] = instances[last];
+			transforms[removed] = transforms[last];
+			descTails[removed] = descTails[last];
+			denseSlots[removed] = denseSlots[last];
+			slots[denseSlots[removed]].denseIndex = removed;
+			markDirty(removed);
+		}
+		instances.pop_back();
+		transforms.pop_back();
+		descTails.pop_back();
+		denseSlots.pop_back();
+		dirtyFlags.pop_back();
+
+		InstanceSlot& slot = slots[_instance.slot]; // Free the slot, outstanding handles to it go stale
+		slot.denseIndex = UINT32_MAX;
+		slot.generation++;
+		slot.nextFree = firstFreeSlot;
+		firstFreeSlot = _instance.slot;
+		countChanged = true;
 		return 0;
 	}
+	int RTX_TLAS::reserve(UINT _capacity)
+	{
+		capacity = (std::max)(capacity, _capacity); // Applied by the next computeASBufferSize
+		return 0;
+	}
+	bool RTX_TLAS::isValid(InstanceHandle _instance)
+	{
+		return _instance.slot < slots.size()
+			&& slots[_instance.slot].generation == _instance.generation
+			&& slots[_instance.slot].denseIndex != UINT32_MAX;
+	}
+	int RTX_TLAS::markDirty(UINT _instance)
+	{
+		if (_instance >= instances.size()) // Error check
+		{
+			RTX_Exception::handleError("Trying to mark an instance that is not in the TLAS.", false);
+			return 1;
+		}
+		if (!dirtyFlags[_instance]) // Only queue it once per frame
+		{
+			dirtyFlags[_instance] = 1;
+			dirtyInstances.push_back(_instance);
+		}
+		return 0;
+	}
+	int RTX_TLAS::markAllDirty()
+	{
+		for (UINT i = 0; i < instances.size(); i++)
+		{
+			markDirty(i);
+		}
+		return 0;
+	}
+	int RTX_TLAS::requestRebuild()
+	{
+		rebuildRequested = true;
+		return 0;
+	}
+	bool RTX_TLAS::isDirty()
+	{
+		return !dirtyInstances.empty() || countChanged || rebuildRequested;
+	}
+	bool RTX_TLAS::needsRebuild()
+	{
+		return countChanged || rebuildRequested;
+	}
+	UINT RTX_TLAS::getRebuildCount()
+	{
+		return rebuildCount;
+	}
+	UINT RTX_TLAS::getRefitCount()
+	{
+		return refitCount;
+	}
+	UINT RTX_TLAS::getDirtyCount()
+	{
+		return static_cast<UINT>(dirtyInstances.size());
+	}
+	UINT RTX_TLAS::getInstanceCount()
+	{
+		return static_cast<UINT>(instances.size());
+	}
+	UINT RTX_TLAS::getCapacity()
+	{
+		return capacity;
+	}
+	const std::vector<Instance>& RTX_TLAS::getInstances()
+	{
+		return instances;
+	}
+	const std::vector<InstanceTransform>& RTX_TLAS::getTransforms()
+	{
+		return transforms;
+	}
+	UINT RTX_TLAS::getInstanceIndex(InstanceHandle _instance)
+	{
+		return isValid(_instance) ? slots[_instance.slot].denseIndex : UINT32_MAX;
+	}
+	InstanceHandle RTX_TLAS::getHandle(UINT _instanceIndex)
+	{
+		InstanceHandle handle;
+		if (_instanceIndex >= instances.size()) // Error check
+		{
+			RTX_Exception::handleError("Trying to get the handle of an instance that is not in the TLAS.", false);
+			return handle;
+		}
+		handle.slot = denseSlots[_instanceIndex];
+		handle.generation = slots[handle.slot].generation;
+		return handle;
+	}
+	void RTX_TLAS::setInstanceBLAS(InstanceHandle _instance, ID3D12Resource* _bottomLevelAS)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to change the BLAS of an instance that is not in the TLAS.", false);
+			return;
+		}
+		UINT index = slots[_instance.slot].denseIndex;
+		instances[index].bottomLevelAS = _bottomLevelAS;
+		packDescTail(index);
+		markDirty(index);
+	}
+	void RTX_TLAS::setInstanceTransform(InstanceHandle _instance, const DirectX::XMMATRIX& _transform)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to move an instance that is not in the TLAS.", false);
+			return;
+		}
+		UINT index = slots[_instance.slot].denseIndex;
+		toInstanceTransform(_transform, transforms[index]);
+		markDirty(index);
+	}
+	void RTX_TLAS::setInstanceTransform(InstanceHandle _instance, const InstanceTransform& _transform)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to move an instance that is not in the TLAS.", false);
+			return;
+		}
+		UINT index = slots[_instance.slot].denseIndex;
+		transforms[index] = _transform;
+		markDirty(index);
+	}
+	void RTX_TLAS::setInstanceMask(InstanceHandle _instance, UINT _instanceMask)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to change the mask of an instance that is not in the TLAS.", false);
+			return;
+		}
+		UINT index = slots[_instance.slot].denseIndex;
+		instances[index].instanceMask = _instanceMask;
+		packDescTail(index);
+		markDirty(index);
+	}
+	void RTX_TLAS::setInstanceFlags(InstanceHandle _instance, D3D12_RAYTRACING_INSTANCE_FLAGS _flags)
+	{
+		if (!isValid(_instance)) // Error check
+		{
+			RTX_Exception::handleError("Trying to change the flags of an instance that is not in the TLAS.", false);
+			return;
+		}
+		UINT index = slots[_instance.slot].denseIndex;
+		instances[index].flags = _flags;
+		packDescTail(index);
+		markDirty(index);
+	}
 }
\ No newline at end of file
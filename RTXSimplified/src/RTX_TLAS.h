@@ -5,6 +5,7 @@
 #include <wrl.h> // Windows Runtime Library -> UINT64
 #include <vector> // std::vector
 #include "RTX_Exception.h" // Error handling
+#include "RTX_UploadRing.h" // Descriptor uploads
 #include <DirectXMath.h> // XMMATRIX -> 4*4 matrix aligned on a 16-byte boundary 
 						 //				that maps to four hardware vector registers
 
@@ -18,17 +19,65 @@ using Microsoft::WRL::ComPtr; ///< Smart pointer for interfaces
 
 namespace RTXSimplified
 {
+	enum InstanceMaskBits
+	{
+		INSTANCE_MASK_PRIMARY = 0x01,	///< Seen by camera and reflection rays.
+		INSTANCE_MASK_SHADOW = 0x02,	///< Casts shadows, leave it out for decorative geometry.
+		INSTANCE_MASK_ALL = 0xFF		///< Seen by every ray, the default.
+	}; ///< InstanceMask bits used by this project, rays pass the matching bit as their InstanceInclusionMask.
+
 	struct Instance
 	{
-		Instance(ID3D12Resource* _blas, const DirectX::XMMATRIX& _tr, UINT _iID, UINT _hgID); ///< Custom constructor.
+		Instance(ID3D12Resource* _blas, UINT _iID, UINT _hgID, UINT _mask, D3D12_RAYTRACING_INSTANCE_FLAGS _flags); ///< Custom constructor.
 
-		ID3D12Resource* bottomLevelAS; ///< BLAS.
-		const DirectX::XMMATRIX& transformMat; ///< Transform matrix.
+		ID3D12Resource* bottomLevelAS; ///< BLAS, nullptr for an inactive instance.
 		UINT instanceID; ///< Instance ID visisble in the shader.
 		UINT hitGroupIndex; ///< Hit group index to fetch the shaders from the shader binding table.
-	}; ///< Structure used to store an instance of the TLAS.
+		UINT instanceMask; ///< 8 bit visibility mask, the instance is skipped by rays whose inclusion mask shares no bit with it.
+		D3D12_RAYTRACING_INSTANCE_FLAGS flags; ///< Culling and opacity overrides.
+	}; ///< Structure used to store an instance of the TLAS, its transform lives in a separate array.
+
+	struct alignas(16) InstanceTransform
+	{
+		float rows[3][4]; ///< 3x4 row major, the layout of D3D12_RAYTRACING_INSTANCE_DESC::Transform.
+	}; ///< Transform of an instance, stored ready to copy into its descriptor.
+
+	struct alignas(16) InstanceDescTail
+	{
+		UINT idAndMask;			///< InstanceID in the low 24 bits, InstanceMask in the high 8.
+		UINT hitGroupAndFlags;	///< InstanceContributionToHitGroupIndex in the low 24 bits, Flags in the high 8.
+		UINT64 blasAddress;		///< GPU address of the BLAS, looked up once instead of every upload.
+	}; ///< Last 16 bytes of an instance descriptor, packed when the instance changes.
+
+	struct DescriptorRun
+	{
+		UINT first = 0; ///< First instance of the run.
+		UINT count = 0; ///< Instances in the run.
+	}; ///< Neighbouring descriptors uploaded with one copy.
+
+	struct InstanceHandle
+	{
+		uint32_t slot = UINT32_MAX;	///< Slot in the slot table, never moves.
+		uint32_t generation = 0;	///< Generation of the slot when the handle was made, stale handles do not match.
+	}; ///< Stable reference to a TLAS instance, stays valid while other instances are added and removed.
+
+	struct InstanceSlot
+	{
+		uint32_t denseIndex = UINT32_MAX;	///< Position of the instance in the packed array, UINT32_MAX when the slot is free.
+		uint32_t generation = 0;			///< Bumped every time the slot is freed.
+		uint32_t nextFree = UINT32_MAX;		///< Next free slot, only used while this one is free.
+	}; ///< Entry of the slot table, maps a handle to the packed instance array.
 	/**
 	*	\brief The class responsible for creating and managing the top level accelleration structure.
+	*
+	*	Instances are kept in a slot map: a packed array in InstanceIndex() order, which is what the
+	*	descriptors are written from, and a slot table that generational handles point into. Removing
+	*	an instance moves the last one into its place, so adds and removes are O(1) and handles to
+	*	other instances stay valid. A changed instance count needs a full build instead of an update.
+	*	The packed array is split in three: transforms and descriptor tails already in the layout of
+	*	D3D12_RAYTRACING_INSTANCE_DESC, so uploading a descriptor is a 64 byte copy, and the rest of
+	*	the instance for the CPU side. Descriptors are written to the upload ring and copied into a
+	*	default heap buffer, only the runs that changed on an update.
 	*/
 	class RTX_TLAS
 	{
@@ -36,15 +85,30 @@ namespace RTXSimplified
 		UINT64 scratchSize; ///< Used to store temporary information.
 		UINT64 resultSize; ///< Stores the resulting size of the TLAS instance.
 		UINT64 descriptorSize; ///< Stores the resulting size of the TLAS instance.
-		std::vector<Instance> instances; ///< Stores the instances contained in the TLAS.
+		std::vector<Instance> instances; ///< Stores the instances contained in the TLAS, packed.
+		std::vector<InstanceTransform> transforms; ///< Transform of each packed instance.
+		std::vector<InstanceDescTail> descTails; ///< Descriptor tail of each packed instance.
+		std::vector<uint32_t> denseSlots; ///< Slot of each packed instance, to fix the slot table when instances move.
+		std::vector<InstanceSlot> slots; ///< Slot table the handles point into.
+		uint32_t firstFreeSlot = UINT32_MAX; ///< Head of the free slot list.
+		UINT capacity = 0; ///< Instance count the buffers are sized for, at least the current count.
+		bool countChanged = false; ///< Instances were added or removed since the last full build.
+		bool rebuildRequested = false; ///< The tree degraded too much to keep refitting it, see requestRebuild.
+		UINT rebuildCount = 0; ///< Full builds queued by generate.
+		UINT refitCount = 0; ///< Updates queued by generate.
+		std::vector<uint8_t> dirtyFlags; ///< 1 for each instance whose descriptor needs rewriting.
+		std::vector<UINT> dirtyInstances; ///< Indices of the dirty instances, so clean ones are never visited.
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags; ///< Construction flags, indicating whether the AS supports iterative updates.
 
+		int packDescTail(UINT _instance); ///< Repacks the descriptor tail after the instance changed.
+
 	public:
 		int generate(
 			ID3D12GraphicsCommandList4* _commandList, ///< Command list to queue the generation to.
 			ID3D12Resource* _scratchBuffer,			 ///< Scratch buffer used. 
 			ID3D12Resource* _resultBuffer,			 ///< Stores the AS.
-			ID3D12Resource* _descriptorBuffer,		 ///< Stores the descriptors.
+			ID3D12Resource* _descriptorBuffer,		 ///< Stores the descriptors, default heap, kept in NON_PIXEL_SHADER_RESOURCE state.
+			RTX_UploadRing* _uploadRing,			 ///< Where the changed descriptors are written before the copy.
 			bool _updateOnly,						 ///< True = refit existing AS.
 			ID3D12Resource* _previousResult			 ///< Previous AS, used for iterative updates.
 		); ///< Generates the TLAS (queues it up on the command list).
@@ -54,14 +118,49 @@ namespace RTXSimplified
 			UINT64* _scratchSizeInBytes,	///< Temporary scratch memory.
 			UINT64* _resultSizeInBytes,		///< Temporary result memory.
 			UINT64* _descriptorsSizeInBytes	///< Temporary descriptor memory.
-		); ///< Computes the size of the accelleration structure based on device and data.
-		int addInstance(
+		); ///< Computes the size of the accelleration structure based on device and data, for the capacity if that is larger.
+		InstanceHandle addInstance(
 			ID3D12Resource* _bottomLevelAS,		 ///< BLAS
 			const DirectX::XMMATRIX& _transform, ///< Transform matrix.
 			UINT _instanceID,					 ///< Instance ID visible in the shader.
-			UINT _hitGroupIndex					 ///< Hit group index.
-		); ///< Adds instance of TLAS on the GPU.
-		
+			UINT _hitGroupIndex,				 ///< Hit group index.
+			UINT _instanceMask = 0xFF,			 ///< Visibility mask, 0xFF = seen by every ray.
+			D3D12_RAYTRACING_INSTANCE_FLAGS _flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE ///< Culling and opacity overrides.
+		); ///< Adds instance of TLAS on the GPU, O(1).
+		int removeInstance(InstanceHandle _instance); ///< Removes an instance, the last one takes its place, O(1).
+		int reserve(UINT _capacity); ///< Sizes the buffers for this many instances, so streaming in more does not reallocate.
+		bool isValid(InstanceHandle _instance); ///< False for handles of removed instances.
+		int markDirty(UINT _instance); ///< Flags an instance so its descriptor is rewritten on the next update.
+		int markAllDirty(); ///< Flags every instance, so the next update rewrites every descriptor.
+		int requestRebuild(); ///< Makes the next generate a full build, when refits moved instances too far from where the tree was built.
+		UINT collectDirtyRuns(
+			std::vector<DescriptorRun>& _runs,	///< Filled with the runs, in instance order.
+			bool _all							///< True = every instance, false = only the dirty ones.
+		); ///< Groups the descriptors to upload in runs of neighbours and clears the dirty list, returns how many there are.
+		int writeDescriptors(
+			D3D12_RAYTRACING_INSTANCE_DESC* _descriptors,	///< Mapped memory, room for every descriptor of the runs.
+			const std::vector<DescriptorRun>& _runs			///< Runs from collectDirtyRuns.
+		); ///< Copies the descriptors of the runs out of the store back to back, streaming past the cache when the memory is 16 byte aligned.
+		static void toInstanceTransform(const DirectX::XMMATRIX& _matrix, InstanceTransform& _transform); ///< Transposes a matrix into descriptor layout.
+
+		/*GETTERS*/
+		bool isDirty(); ///< True if any instance changed since the last generate.
+		bool needsRebuild(); ///< True if instances were added or removed or a rebuild was requested, generate can not update in place then.
+		UINT getRebuildCount(); ///< Full builds queued so far.
+		UINT getRefitCount(); ///< Refits queued so far.
+		UINT getDirtyCount(); ///< Number of instances waiting for an update.
+		UINT getInstanceCount();
+		UINT getCapacity();
+		const std::vector<Instance>& getInstances(); ///< Packed instances, in InstanceIndex() order.
+		const std::vector<InstanceTransform>& getTransforms(); ///< Transforms of the packed instances, in the same order.
+		UINT getInstanceIndex(InstanceHandle _instance); ///< Current InstanceIndex() of an instance, UINT32_MAX for a stale handle.
+		InstanceHandle getHandle(UINT _instanceIndex); ///< Handle of the instance at an InstanceIndex().
+		/*SETTERS*/
+		void setInstanceBLAS(InstanceHandle _instance, ID3D12Resource* _bottomLevelAS); ///< Points an instance to a different BLAS and flags it.
+		void setInstanceTransform(InstanceHandle _instance, const DirectX::XMMATRIX& _transform); ///< Moves an instance and flags it.
+		void setInstanceTransform(InstanceHandle _instance, const InstanceTransform& _transform); ///< Moves an instance using a transform already in descriptor layout.
+		void setInstanceMask(InstanceHandle _instance, UINT _instanceMask); ///< Changes which rays see an instance and flags it.
+		void setInstanceFlags(InstanceHandle _instance, D3D12_RAYTRACING_INSTANCE_FLAGS _flags); ///< Changes the culling and opacity overrides of an instance and flags it.
 	};
 }
 #endif // !RTX_TLAS_H
@@ -0,0 +1,115 @@
+#include "RTX_TaskGraph.h"
+#include <iostream> // timings report
+
+namespace RTXSimplified
+{
+	uint32_t RTX_TaskGraph::addTask(const std::string& _name, std::function<void()> _work, const std::vector<uint32_t>& _dependencies)
+	{
+		uint32_t index = static_cast<uint32_t>(tasks.size());
+		for (size_t d = 0; d < _dependencies.size(); d++)
+		{
+			if (_dependencies[d] >= index) // Error check, only earlier tasks can be depended on
+			{
+				RTX_Exception::handleError("Task " + _name + " depends on a task that was not added yet.", true);
+			}
+		}
+
+		std::unique_ptr<GraphTask> task(new GraphTask());
+		task->name = _name;
+		task->work = std::move(_work);
+		task->dependencyCount = static_cast<uint32_t>(_dependencies.size());
+		tasks.push_back(std::move(task));
+		for (size_t d = 0; d < _dependencies.size(); d++)
+		{
+			tasks[_dependencies[d]]->dependents.push_back(index);
+		}
+		return index;
+	}
+
+	void RTX_TaskGraph::launch(uint32_t _task, RTX_ThreadPool* _pool, std::atomic<uint32_t>* _counter)
+	{
+		_pool->submit([this, _task, _pool, _counter]()
+		{
+			GraphTask& task = *tasks[_task];
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			task.work();
+			std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+			task.timing.startMs = std::chrono::duration<double, std::milli>(start - runStart).count();
+			task.timing.durationMs = std::chrono::duration<double, std::milli>(end - start).count();
+			task.timing.thread = _pool->getCurrentThreadIndex();
+
+			for (size_t d = 0; d < task.dependents.size(); d++) // Queued before this task counts as done, so run can not return early
+			{
+				if (tasks[task.dependents[d]]->remaining.fetch_sub(1) == 1) // Last dependency
+				{
+					launch(task.dependents[d], _pool, _counter);
+				}
+			}
+		}, _counter);
+	}
+
+	int RTX_TaskGraph::run(RTX_ThreadPool& _pool)
+	{
+		runStart = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			tasks[i]->remaining.store(tasks[i]->dependencyCount);
+			tasks[i]->timing = TaskTiming();
+			tasks[i]->timing.name = tasks[i]->name;
+		}
+
+		std::atomic<uint32_t> counter(0);
+		for (uint32_t i = 0; i < tasks.size(); i++)
+		{
+			if (tasks[i]->dependencyCount == 0) // Ready straight away
+			{
+				launch(i, &_pool, &counter);
+			}
+		}
+		_pool.wait(&counter);
+		totalTimeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runStart).count();
+
+		return 0;
+	}
+
+	int RTX_TaskGraph::print()
+	{
+		std::cout << "Task graph: " << tasks.size() << " tasks, " << totalTimeMs << " ms wall, " << getBusyTimeMs() << " ms busy" << std::endl;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			const TaskTiming& timing = tasks[i]->timing;
+			std::cout << "  " << timing.name << ": " << timing.startMs << " -> " << timing.startMs + timing.durationMs << " ms on thread " << timing.thread << std::endl;
+		}
+		return 0;
+	}
+
+	int RTX_TaskGraph::clear()
+	{
+		tasks.clear();
+		totalTimeMs = 0.0;
+		return 0;
+	}
+
+	std::vector<TaskTiming> RTX_TaskGraph::getTimings()
+	{
+		std::vector<TaskTiming> timings;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			timings.push_back(tasks[i]->timing);
+		}
+		return timings;
+	}
+	double RTX_TaskGraph::getTotalTimeMs()
+	{
+		return totalTimeMs;
+	}
+	double RTX_TaskGraph::getBusyTimeMs()
+	{
+		double busy = 0.0;
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			busy += tasks[i]->timing.durationMs;
+		}
+		return busy;
+	}
+}
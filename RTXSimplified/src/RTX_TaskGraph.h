@@ -0,0 +1,67 @@
+#ifndef RTX_TASKGRAPH_H
+#define RTX_TASKGRAPH_H
+
+#include <vector> // std::vector
+#include <string> // task names
+#include <memory> // std::unique_ptr
+#include <functional> // std::function
+#include <atomic> // dependency counters
+#include <chrono> // timings
+#include <stdint.h> // uint32_t
+#include "RTX_ThreadPool.h" // Workers
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	struct TaskTiming
+	{
+		std::string name;			///< Name given to addTask.
+		double startMs = 0.0;		///< Start, relative to the start of run.
+		double durationMs = 0.0;	///< Time spent in the task.
+		uint32_t thread = 0;		///< Pool thread that ran it, 0 = the thread that called run.
+	}; ///< When and where one task of a graph ran.
+
+	struct GraphTask
+	{
+		std::string name;					///< Shown in the timings.
+		std::function<void()> work;			///< What the task does.
+		std::vector<uint32_t> dependents;	///< Tasks waiting on this one.
+		uint32_t dependencyCount = 0;		///< Tasks this one waits on.
+		std::atomic<uint32_t> remaining;	///< Dependencies not finished yet in the current run.
+		TaskTiming timing;					///< Filled by run.
+	}; ///< One node of a task graph.
+
+	/**
+	*	\brief The class responsible for running tasks with dependencies on the thread pool.
+	*
+	*	Tasks are added with the tasks they depend on, which have to be added first, so a graph
+	*	can never hold a cycle. Run queues every task without dependencies; each finished task
+	*	queues the dependents it was the last dependency of, so independent work spreads over
+	*	the pool and a task starts as soon as everything it needs is done.
+	*/
+	class RTX_TaskGraph
+	{
+	private:
+		std::vector<std::unique_ptr<GraphTask>> tasks; ///< Every task, in the order they were added.
+		std::chrono::high_resolution_clock::time_point runStart; ///< Start of the current run.
+		double totalTimeMs = 0.0; ///< Wall time of the last run.
+
+		void launch(uint32_t _task, RTX_ThreadPool* _pool, std::atomic<uint32_t>* _counter); ///< Queues a task whose dependencies are done.
+
+	public:
+		uint32_t addTask(
+			const std::string& _name,						///< Name shown in the timings.
+			std::function<void()> _work,					///< Work to run.
+			const std::vector<uint32_t>& _dependencies = {}	///< Tasks that have to finish first.
+		); ///< Adds a task, returns its index to depend on.
+		int run(RTX_ThreadPool& _pool); ///< Runs every task and waits for them, the calling thread helps.
+		int print(); ///< Writes the timings of the last run to the console.
+		int clear(); ///< Removes every task.
+
+		/*GETTERS*/
+		std::vector<TaskTiming> getTimings(); ///< Timings of the last run, in the order the tasks were added.
+		double getTotalTimeMs(); ///< Wall time of the last run.
+		double getBusyTimeMs(); ///< Sum of the task durations of the last run, busy / total = achieved parallelism.
+	};
+}
+#endif // !RTX_TASKGRAPH_H
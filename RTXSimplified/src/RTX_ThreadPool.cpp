@@ -0,0 +1,186 @@
+#include "RTX_ThreadPool.h"
+
+namespace RTXSimplified
+{
+	static thread_local const RTX_ThreadPool* currentPool = nullptr; // Pool the calling thread works for
+	static thread_local uint32_t currentQueue = 0; // Its queue in that pool
+
+	RTX_ThreadPool::RTX_ThreadPool(unsigned _threadCount)
+		: queuedCount(0), stealCount(0)
+	{
+		if (_threadCount == 0) // Use every hardware thread by default
+		{
+			_threadCount = std::thread::hardware_concurrency();
+		}
+		if (_threadCount == 0) // hardware_concurrency can fail to report
+		{
+			_threadCount = 1;
+		}
+
+		// Every queue exists before any worker can steal from it
+		for (unsigned i = 0; i < _threadCount; i++)
+		{
+			queues.emplace_back(new WorkerQueue());
+		}
+		// The calling thread also runs tasks while it waits, so spawn one less worker.
+		for (unsigned i = 1; i < _threadCount; i++)
+		{
+			workers.emplace_back(&RTX_ThreadPool::workerLoop, this, i);
+		}
+	}
+
+	RTX_ThreadPool::~RTX_ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true; // Tell the workers to exit
+		}
+		sleepCondition.notify_all();
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void RTX_ThreadPool::workerLoop(uint32_t _queueIndex)
+	{
+		currentPool = this;
+		currentQueue = _queueIndex;
+		while (true)
+		{
+			std::function<void()> task;
+			if (takeTask(_queueIndex, task))
+			{
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepCondition.wait(lock, [this] { return stopping || queuedCount.load() > 0; }); // Sleep until there is work
+			if (stopping && queuedCount.load() == 0)
+			{
+				return;
+			}
+		}
+	}
+
+	bool RTX_ThreadPool::takeTask(uint32_t _queueIndex, std::function<void()>& _task)
+	{
+		{
+			WorkerQueue& own = *queues[_queueIndex];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				_task = std::move(own.tasks.back()); // Newest task first, it is the most likely to be in cache
+				own.tasks.pop_back();
+				queuedCount.fetch_sub(1);
+				return true;
+			}
+		}
+
+		uint32_t queueCount = static_cast<uint32_t>(queues.size());
+		for (uint32_t i = 1; i < queueCount; i++) // Own queue is empty, steal from the next ones round the ring
+		{
+			WorkerQueue& victim = *queues[(_queueIndex + i) % queueCount];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				_task = std::move(victim.tasks.front()); // Oldest task, usually the biggest piece of a split
+				victim.tasks.pop_front();
+				queuedCount.fetch_sub(1);
+				stealCount.fetch_add(1);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool RTX_ThreadPool::runPendingTask()
+	{
+		std::function<void()> task;
+		if (!takeTask(getQueueIndex(), task))
+		{
+			return false;
+		}
+		task();
+		return true;
+	}
+
+	uint32_t RTX_ThreadPool::getQueueIndex()
+	{
+		return currentPool == this ? currentQueue : 0;
+	}
+
+	void RTX_ThreadPool::submit(std::function<void()> _task, std::atomic<uint32_t>* _counter)
+	{
+		_counter->fetch_add(1); // Count the task before anyone can wait on it
+		{
+			WorkerQueue& queue = *queues[getQueueIndex()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.emplace_back([_task, _counter]()
+				{
+					_task();
+					_counter->fetch_sub(1); // Signal completion
+				});
+		}
+		queuedCount.fetch_add(1);
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex); // A worker between its check and its wait would miss the notify otherwise
+		}
+		sleepCondition.notify_one();
+	}
+
+	void RTX_ThreadPool::wait(std::atomic<uint32_t>* _counter)
+	{
+		while (_counter->load() > 0)
+		{
+			if (!runPendingTask()) // Nothing to help with, the remaining tasks are running elsewhere
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void RTX_ThreadPool::parallelFor(uint32_t _count, uint32_t _grainSize, const std::function<void(uint32_t, uint32_t)>& _body)
+	{
+		if (_grainSize == 0)
+		{
+			_grainSize = 1;
+		}
+		if (_count <= _grainSize || workers.empty()) // Not worth splitting
+		{
+			_body(0, _count);
+			return;
+		}
+
+		// Aim for a few chunks per thread so uneven chunks balance out.
+		uint32_t chunkCount = static_cast<uint32_t>((workers.size() + 1) * 4);
+		uint32_t chunkSize = (_count + chunkCount - 1) / chunkCount;
+		if (chunkSize < _grainSize)
+		{
+			chunkSize = _grainSize;
+		}
+
+		std::atomic<uint32_t> counter(0);
+		for (uint32_t begin = chunkSize; begin < _count; begin += chunkSize) // Queue every chunk but the first
+		{
+			uint32_t end = begin + chunkSize < _count ? begin + chunkSize : _count;
+			submit([&_body, begin, end]() { _body(begin, end); }, &counter);
+		}
+		_body(0, chunkSize < _count ? chunkSize : _count); // Run the first chunk here
+		wait(&counter);
+	}
+
+	unsigned RTX_ThreadPool::getThreadCount()
+	{
+		return static_cast<unsigned>(workers.size()) + 1;
+	}
+	uint32_t RTX_ThreadPool::getStealCount()
+	{
+		return stealCount.load();
+	}
+	uint32_t RTX_ThreadPool::getCurrentThreadIndex()
+	{
+		return getQueueIndex();
+	}
+}
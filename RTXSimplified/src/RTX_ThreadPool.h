@@ -0,0 +1,68 @@
+#ifndef RTX_THREADPOOL_H
+#define RTX_THREADPOOL_H
+
+#include <vector> // std::vector
+#include <deque> // task queues
+#include <memory> // std::unique_ptr
+#include <thread> // std::thread
+#include <mutex> // std::mutex
+#include <condition_variable> // worker wake up
+#include <functional> // std::function
+#include <atomic> // task counters
+#include <stdint.h> // uint32_t
+
+namespace RTXSimplified
+{
+	struct WorkerQueue
+	{
+		std::deque<std::function<void()>> tasks; ///< Tasks waiting to be picked up.
+		std::mutex mutex; ///< Guards the deque, only contended when another thread steals.
+	}; ///< Task queue owned by one thread of the pool.
+
+	/**
+	*	\brief The class responsible for running CPU work across all cores.
+	*
+	*	Tasks are grouped under a counter. Threads waiting on a counter run queued tasks
+	*	instead of sleeping, so tasks can safely spawn and wait on other tasks.
+	*	Every worker owns a queue: tasks it submits go to the back of its own queue and it takes
+	*	them back newest first, while idle threads steal the oldest task from the front of
+	*	someone else's queue. Threads outside the pool share queue 0.
+	*/
+	class RTX_ThreadPool
+	{
+	private:
+		std::vector<std::thread> workers; ///< Worker threads.
+		std::vector<std::unique_ptr<WorkerQueue>> queues; ///< Queue 0 for outside threads, then one per worker.
+		std::atomic<uint32_t> queuedCount; ///< Tasks sitting in any queue, workers sleep while it is 0.
+		std::atomic<uint32_t> stealCount; ///< Tasks taken from another thread's queue.
+		std::mutex sleepMutex; ///< Guards sleeping and stopping.
+		std::condition_variable sleepCondition; ///< Wakes up workers when tasks are added.
+		bool stopping = false; ///< Set when the pool is being destroyed.
+
+		void workerLoop(uint32_t _queueIndex); ///< Main loop of each worker thread.
+		bool takeTask(uint32_t _queueIndex, std::function<void()>& _task); ///< Pops from the own queue, steals from the others when it is empty.
+		bool runPendingTask(); ///< Runs one queued task on the calling thread, returns false if there was none.
+		uint32_t getQueueIndex(); ///< Queue of the calling thread, 0 when it is not a worker of this pool.
+
+	public:
+		RTX_ThreadPool(unsigned _threadCount = 0); ///< Creates the workers, 0 = one per hardware thread.
+		~RTX_ThreadPool(); ///< Joins all the workers.
+
+		void submit(
+			std::function<void()> _task,		///< Work to run.
+			std::atomic<uint32_t>* _counter		///< Incremented now, decremented once the task finished.
+		); ///< Queues a task on the calling thread's queue.
+		void wait(std::atomic<uint32_t>* _counter); ///< Helps running tasks until the counter reaches 0.
+		void parallelFor(
+			uint32_t _count,									///< Number of items.
+			uint32_t _grainSize,								///< Minimum items per task.
+			const std::function<void(uint32_t, uint32_t)>& _body	///< Called with [begin, end) ranges.
+		); ///< Splits a loop across the pool and waits for it.
+
+		/*GETTERS*/
+		unsigned getThreadCount();
+		uint32_t getStealCount(); ///< Tasks that ran on another thread than the one that queued them.
+		uint32_t getCurrentThreadIndex(); ///< 0 outside the pool, 1 to getThreadCount() - 1 on the workers.
+	};
+}
+#endif // !RTX_THREADPOOL_H
@@ -0,0 +1,148 @@
+#include "RTX_UploadRing.h"
+#include <cstring> // memcpy
+
+namespace RTXSimplified
+{
+	RTX_UploadRing::RTX_UploadRing(std::function<ComPtr<ID3D12Resource>(UINT64)> _allocate, UINT64 _size)
+		: size(_size)
+	{
+		buffer = _allocate(_size);
+		if (!buffer) // Error check
+		{
+			RTX_Exception::handleError("Failed to create the upload ring.", true);
+		}
+		D3D12_RANGE readRange = { 0, 0 }; // The CPU never reads from the ring
+		HRESULT hr = buffer->Map(0, &readRange, reinterpret_cast<void**>(&mappedData)); // Stays mapped, upload heaps allow it
+		RTX_Exception::handleError(&hr, "Error mapping the upload ring.");
+		gpuBase = buffer->GetGPUVirtualAddress();
+	}
+
+	RTX_UploadRing::~RTX_UploadRing()
+	{
+		if (buffer && mappedData)
+		{
+			buffer->Unmap(0, nullptr);
+		}
+	}
+
+	UploadAllocation RTX_UploadRing::allocate(UINT64 _size, UINT64 _alignment)
+	{
+		UploadAllocation allocation;
+		UINT64 offset = (head + _alignment - 1) & ~(_alignment - 1); // Align up
+		UINT64 consumed = offset + _size - head; // Padding included
+		if (offset + _size > size) // Does not fit before the end, wrap around and skip the rest
+		{
+			offset = 0;
+			consumed = size - head + _size;
+		}
+		if (_size > size || usedBytes + consumed > size) // Error check, would overwrite memory still in flight
+		{
+			RTX_Exception::handleError("Upload ring is full, increase its size.", false);
+			return allocation;
+		}
+
+		head = offset + _size;
+		usedBytes += consumed;
+		frameBytes += consumed;
+		if (usedBytes > peakBytes)
+		{
+			peakBytes = usedBytes;
+		}
+
+		allocation.resource = buffer.Get();
+		allocation.offset = offset;
+		allocation.cpuAddress = mappedData + offset;
+		allocation.gpuAddress = gpuBase + offset;
+		return allocation;
+	}
+
+	UploadAllocation RTX_UploadRing::upload(const void* _data, UINT64 _size, UINT64 _alignment)
+	{
+		UploadAllocation allocation = allocate(_size, _alignment);
+		if (allocation.cpuAddress)
+		{
+			memcpy(allocation.cpuAddress, _data, static_cast<size_t>(_size));
+		}
+		return allocation;
+	}
+
+	int RTX_UploadRing::queueCopy(ID3D12Resource* _destination, UINT64 _destinationOffset, const UploadAllocation& _source, UINT64 _size, D3D12_RESOURCE_STATES _state)
+	{
+		if (!_source.resource) // Error check
+		{
+			RTX_Exception::handleError("Queueing a copy from a failed upload.", false);
+			return 1;
+		}
+		UploadCopy copy;
+		copy.destination = _destination;
+		copy.destinationOffset = _destinationOffset;
+		copy.source = _source.resource;
+		copy.sourceOffset = _source.offset;
+		copy.size = _size;
+		copy.state = _state;
+		pendingCopies.push_back(copy);
+		return 0;
+	}
+
+	int RTX_UploadRing::recordCopies(ID3D12GraphicsCommandList* _commandList)
+	{
+		for (size_t i = 0; i < pendingCopies.size(); i++)
+		{
+			const UploadCopy& copy = pendingCopies[i];
+			D3D12_RESOURCE_BARRIER barrier = {};											// Store info about the transition
+			barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;							// type transition
+			barrier.Transition.pResource = copy.destination;								// of the destination
+			barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;		// all of it
+			barrier.Transition.StateBefore = copy.state;									// from where the GPU reads it
+			barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;					// to copy destination
+			_commandList->ResourceBarrier(1, &barrier);
+			_commandList->CopyBufferRegion(copy.destination, copy.destinationOffset, copy.source, copy.sourceOffset, copy.size);
+			barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;				// and back
+			barrier.Transition.StateAfter = copy.state;
+			_commandList->ResourceBarrier(1, &barrier);
+		}
+		pendingCopies.clear();
+		return 0;
+	}
+
+	int RTX_UploadRing::endFrame(UINT64 _fenceValue)
+	{
+		if (frameBytes == 0) // Nothing to give back later
+		{
+			return 0;
+		}
+		UploadFrame frame;
+		frame.fenceValue = _fenceValue;
+		frame.bytes = frameBytes;
+		frames.push_back(frame);
+		frameBytes = 0;
+		return 0;
+	}
+
+	int RTX_UploadRing::releaseCompleted(UINT64 _completedFenceValue)
+	{
+		while (!frames.empty() && frames.front().fenceValue <= _completedFenceValue) // Frames finish in order
+		{
+			usedBytes -= frames.front().bytes;
+			frames.pop_front();
+		}
+		if (usedBytes == 0) // Empty, start from the front so big allocations do not wrap
+		{
+			head = 0;
+		}
+		return 0;
+	}
+
+	UINT64 RTX_UploadRing::getSize()
+	{
+		return size;
+	}
+	UINT64 RTX_UploadRing::getUsedBytes()
+	{
+		return usedBytes;
+	}
+	UINT64 RTX_UploadRing::getPeakBytes()
+	{
+		return peakBytes;
+	}
+}
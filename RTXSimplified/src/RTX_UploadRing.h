@@ -0,0 +1,92 @@
+#ifndef RTX_UPLOADRING_H
+#define RTX_UPLOADRING_H
+
+#include <d3d12.h> // ID3D12Resource
+#include <wrl.h> // Windows Runtime Library -> ComPtr
+#include <vector> // std::vector
+#include <deque> // frames in flight
+#include <functional> // std::function
+#include "RTX_Exception.h" // Error handling
+
+using Microsoft::WRL::ComPtr; ///< Smart pointer for interfaces
+
+namespace RTXSimplified
+{
+	struct UploadAllocation
+	{
+		ID3D12Resource* resource = nullptr;		///< Ring buffer the memory lives in, nullptr if the ring was full.
+		UINT64 offset = 0;						///< Offset in the ring buffer.
+		void* cpuAddress = nullptr;				///< Where the CPU writes.
+		D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0; ///< Where the GPU reads.
+	}; ///< Piece of the upload ring, valid until the fence of its frame completes.
+
+	struct UploadFrame
+	{
+		UINT64 fenceValue = 0;	///< Fence signalled after the frame.
+		UINT64 bytes = 0;		///< Ring bytes used by the frame, padding included.
+	}; ///< Frame still in flight on the GPU.
+
+	struct UploadCopy
+	{
+		ID3D12Resource* destination = nullptr;	///< Default heap buffer to fill.
+		UINT64 destinationOffset = 0;			///< Offset in the destination.
+		ID3D12Resource* source = nullptr;		///< Ring buffer.
+		UINT64 sourceOffset = 0;				///< Offset in the ring.
+		UINT64 size = 0;						///< Bytes to copy.
+		D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER; ///< State the destination is in before and after the copy.
+	}; ///< Copy queued until the next command list is recorded.
+
+	/**
+	*	\brief The class responsible for per-frame uploads from the CPU to the GPU.
+	*
+	*	One upload heap buffer is mapped once and handed out front to back in aligned pieces. The
+	*	pieces of a frame are given back together once the fence signalled after that frame completes,
+	*	so the CPU can fill the next frame while the GPU still reads the previous ones. Data the GPU
+	*	keeps reading across frames is copied into a default heap buffer with queueCopy.
+	*	Allocation goes through a callback like RTX_ScratchPool, so the ring can run on a mock buffer.
+	*/
+	class RTX_UploadRing
+	{
+	private:
+		ComPtr<ID3D12Resource> buffer; ///< The ring, in an upload heap.
+		UINT8* mappedData = nullptr; ///< CPU address of the ring, mapped for its whole life.
+		D3D12_GPU_VIRTUAL_ADDRESS gpuBase = 0; ///< GPU address of the ring.
+		UINT64 size = 0; ///< Size of the ring.
+		UINT64 head = 0; ///< Next free byte.
+		UINT64 usedBytes = 0; ///< Bytes of all frames in flight and of the current one.
+		UINT64 frameBytes = 0; ///< Bytes used by the current frame.
+		UINT64 peakBytes = 0; ///< Highest value of usedBytes.
+		std::deque<UploadFrame> frames; ///< Frames in flight, oldest first.
+		std::vector<UploadCopy> pendingCopies; ///< Copies for the next command list.
+
+	public:
+		RTX_UploadRing(std::function<ComPtr<ID3D12Resource>(UINT64)> _allocate, UINT64 _size); ///< Creates and maps the ring, takes the buffer allocator.
+		~RTX_UploadRing(); ///< Unmaps the ring.
+
+		UploadAllocation allocate(
+			UINT64 _size,		///< Bytes needed.
+			UINT64 _alignment	///< Power of 2, 256 for constant buffers, 16 for instance descriptors.
+		); ///< Hands out memory for the current frame, an empty allocation if the frames in flight hold the whole ring.
+		UploadAllocation upload(
+			const void* _data,	///< Data to copy.
+			UINT64 _size,		///< Bytes to copy.
+			UINT64 _alignment	///< Power of 2.
+		); ///< Allocates and copies the data in.
+		int queueCopy(
+			ID3D12Resource* _destination,			///< Default heap buffer.
+			UINT64 _destinationOffset,				///< Offset in the destination.
+			const UploadAllocation& _source,		///< Memory from this ring.
+			UINT64 _size,							///< Bytes to copy.
+			D3D12_RESOURCE_STATES _state = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER ///< State of the destination outside the copy.
+		); ///< Queues a copy to a buffer the GPU keeps, recorded by recordCopies.
+		int recordCopies(ID3D12GraphicsCommandList* _commandList); ///< Records every queued copy with the transitions around it.
+		int endFrame(UINT64 _fenceValue); ///< Closes the current frame, its memory comes back once the fence reaches this value.
+		int releaseCompleted(UINT64 _completedFenceValue); ///< Gives back the memory of every completed frame.
+
+		/*GETTERS*/
+		UINT64 getSize();
+		UINT64 getUsedBytes(); ///< Bytes held by frames in flight and the current frame.
+		UINT64 getPeakBytes(); ///< Highest use so far, to size the ring.
+	};
+}
+#endif // !RTX_UPLOADRING_H
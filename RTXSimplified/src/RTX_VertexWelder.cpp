@@ -0,0 +1,107 @@
+#include "RTX_VertexWelder.h"
+#include "RTX_Hash.h" // Bucket hashing
+#include <math.h> // floorf
+
+namespace RTXSimplified
+{
+	static uint64_t hashCell(int64_t _x, int64_t _y, int64_t _z)
+	{
+		return mixHash(static_cast<uint64_t>(_x) * 0x9e3779b97f4a7c15ULL
+			^ static_cast<uint64_t>(_y) * 0xc2b2ae3d27d4eb4fULL
+			^ static_cast<uint64_t>(_z) * 0x165667b19e3779f9ULL);
+	} // Hash of one grid cell of the spatial hash
+
+	uint32_t RTX_VertexWelder::weld(const void* _vertexData, uint32_t _vertexCount, uint32_t _stride, float _epsilon, std::vector<char>& _welded, std::vector<uint32_t>& _indices)
+	{
+		/*ERROR CHECKS*/
+		if (_vertexData == nullptr && _vertexCount > 0)
+		{
+			RTX_Exception::handleError("Trying to weld a vertex buffer with no data.", true);
+		}
+		if (_stride < 3 * sizeof(float)) // Vertices start with R32G32B32_FLOAT
+		{
+			RTX_Exception::handleError("Vertex stride is smaller than a position.", true);
+		}
+
+		const char* vertices = static_cast<const char*>(_vertexData);
+		const uint32_t positionSize = 3 * sizeof(float);
+		const float inverseCellSize = _epsilon > 0.0f ? 1.0f / _epsilon : 0.0f;
+		const float epsilonSquared = _epsilon * _epsilon;
+
+		uint32_t bucketCount = 16; // Power of two, at least twice the vertices so chains stay short
+		while (bucketCount < 2 * static_cast<uint64_t>(_vertexCount))
+		{
+			bucketCount <<= 1;
+		}
+		std::vector<uint32_t> buckets(bucketCount, invalidIndex); // First unique vertex of each bucket
+		std::vector<uint32_t> next; // Next unique vertex in the same bucket
+		next.reserve(_vertexCount);
+
+		_welded.clear();
+		_welded.reserve(static_cast<size_t>(_vertexCount) * _stride);
+		_indices.resize(_vertexCount);
+		uint32_t uniqueCount = 0;
+
+		for (uint32_t i = 0; i < _vertexCount; i++)
+		{
+			const char* vertex = vertices + static_cast<size_t>(i) * _stride;
+			uint32_t match = invalidIndex;
+			uint32_t bucket;
+
+			if (_epsilon <= 0.0f) // Exact weld, the whole vertex is the key
+			{
+				bucket = static_cast<uint32_t>(hashBytes(vertex, _stride)) & (bucketCount - 1);
+				for (uint32_t j = buckets[bucket]; j != invalidIndex; j = next[j])
+				{
+					if (memcmp(&_welded[static_cast<size_t>(j) * _stride], vertex, _stride) == 0)
+					{
+						match = j;
+						break;
+					}
+				}
+			}
+			else // Distance weld, the neighbours can sit in any of the 27 surrounding cells
+			{
+				float position[3];
+				memcpy(position, vertex, positionSize);
+				int64_t cell[3];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					cell[axis] = static_cast<int64_t>(floorf(position[axis] * inverseCellSize));
+				}
+				bucket = static_cast<uint32_t>(hashCell(cell[0], cell[1], cell[2])) & (bucketCount - 1);
+
+				for (int z = -1; z <= 1 && match == invalidIndex; z++)
+				for (int y = -1; y <= 1 && match == invalidIndex; y++)
+				for (int x = -1; x <= 1 && match == invalidIndex; x++)
+				{
+					uint32_t neighbour = static_cast<uint32_t>(hashCell(cell[0] + x, cell[1] + y, cell[2] + z)) & (bucketCount - 1);
+					for (uint32_t j = buckets[neighbour]; j != invalidIndex; j = next[j])
+					{
+						const char* candidate = &_welded[static_cast<size_t>(j) * _stride];
+						float other[3];
+						memcpy(other, candidate, positionSize);
+						float dx = other[0] - position[0], dy = other[1] - position[1], dz = other[2] - position[2];
+						if (dx * dx + dy * dy + dz * dz <= epsilonSquared
+							&& memcmp(candidate + positionSize, vertex + positionSize, _stride - positionSize) == 0) // Same colour, normal...
+						{
+							match = j;
+							break;
+						}
+					}
+				}
+			}
+
+			if (match == invalidIndex) // First time this vertex is seen
+			{
+				match = uniqueCount++;
+				_welded.insert(_welded.end(), vertex, vertex + _stride);
+				next.push_back(buckets[bucket]);
+				buckets[bucket] = match;
+			}
+			_indices[i] = match;
+		}
+
+		return uniqueCount;
+	}
+}
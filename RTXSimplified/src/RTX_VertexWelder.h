@@ -0,0 +1,34 @@
+#ifndef RTX_VERTEXWELDER_H
+#define RTX_VERTEXWELDER_H
+
+#include <vector> // std::vector
+#include <stdint.h> // uint32_t
+#include "RTX_Exception.h" // Error handling
+
+namespace RTXSimplified
+{
+	/**
+	*	\brief The class responsible for turning triangle soups into indexed meshes.
+	*
+	*	Vertices are looked up in a spatial hash on their position as they are read. A vertex is merged
+	*	with an earlier one when the positions are within the weld distance and every other attribute
+	*	byte is identical, so colours or normals on hard edges are kept apart. The output keeps the
+	*	vertex layout of the input, positions are expected to be the first 3 floats of each vertex.
+	*/
+	class RTX_VertexWelder
+	{
+	private:
+		static const uint32_t invalidIndex = 0xFFFFFFFF; ///< Marks an empty bucket or the end of a chain.
+
+	public:
+		static uint32_t weld(
+			const void* _vertexData,		///< Triangle soup, 3 vertices per triangle.
+			uint32_t _vertexCount,			///< Number of vertices.
+			uint32_t _stride,				///< Size of a vertex.
+			float _epsilon,					///< Weld distance, 0 = only merge bit identical vertices.
+			std::vector<char>& _welded,		///< Filled with the unique vertices.
+			std::vector<uint32_t>& _indices	///< Filled with one index per input vertex.
+		); ///< Dedupes the vertices of a soup, returns the number of unique vertices.
+	};
+}
+#endif // !RTX_VERTEXWELDER_H